@@ -0,0 +1,736 @@
+#include "benchmark.h"
+#include "posting_list.h"
+#include "search_server.h"
+#include "generators.h"
+#include "corpus_loader.h"
+#include "string_processing.h"
+#include "request_queue.h"
+#include "metrics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std::string_view_literals;
+
+namespace {
+
+// Counts the bytes requested by node-based containers
+size_t allocated_bytes = 0;
+
+template <typename T>
+struct CountingAllocator {
+    using value_type = T;
+
+    CountingAllocator() = default;
+
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U>&) {
+    }
+
+    T* allocate(size_t n) {
+        allocated_bytes += n * sizeof(T);
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, size_t n) {
+        allocated_bytes -= n * sizeof(T);
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template <typename U>
+    bool operator==(const CountingAllocator<U>&) const {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const CountingAllocator<U>&) const {
+        return false;
+    }
+};
+
+using MapPostings = std::map<int, double, std::less<int>, CountingAllocator<std::pair<const int, double>>>;
+
+template <typename Scan>
+double MeasurePostingsPerSecond(size_t posting_count, int repeat_count, Scan scan) {
+    using Clock = std::chrono::steady_clock;
+    const auto start_time = Clock::now();
+    for (int i = 0; i < repeat_count; ++i) {
+        scan();
+    }
+    const std::chrono::duration<double> seconds = Clock::now() - start_time;
+    return static_cast<double>(posting_count) * repeat_count / seconds.count();
+}
+
+void PrintResult(std::ostream& out, std::string_view layout, double postings_per_second, double bytes_per_posting, double checksum) {
+    out << layout << ": "sv
+        << postings_per_second / 1e6 << " M postings/s, "sv
+        << bytes_per_posting << " bytes/posting "sv
+        << "(checksum "sv << checksum << ")"sv << std::endl;
+}
+
+struct QueryWorkload {
+    std::string_view name;
+    int document_word_count;
+    int query_count;
+    int query_word_count;
+};
+
+std::vector<std::vector<Document>> RunQueries(const SearchServer& search_server, const std::vector<std::string>& queries, double& seconds) {
+    using Clock = std::chrono::steady_clock;
+    std::vector<std::vector<Document>> results;
+    results.reserve(queries.size());
+    const auto start_time = Clock::now();
+    for (const std::string& query : queries) {
+        results.push_back(search_server.FindTopDocuments(query));
+    }
+    seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+    return results;
+}
+
+bool IsSameResult(const std::vector<Document>& lhs, const std::vector<Document>& rhs) {
+    return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const Document& l, const Document& r) {
+        return l.id == r.id && l.relevance == r.relevance && l.rating == r.rating;
+        });
+}
+
+using TokenizedWords = std::vector<std::pair<std::string_view, bool>>;
+
+// The byte by byte tokenizer ForEachWord replaced, the baseline of the kernel speeds
+TokenizedWords ReferenceTokenize(std::string_view text) {
+    TokenizedWords words;
+    while (true) {
+        const size_t space = text.find(' ');
+        const std::string_view word = text.substr(0, space);
+        words.emplace_back(word, std::none_of(word.begin(), word.end(), [](char c) {
+            return c >= '\0' && c < ' ';
+            }));
+        if (space == std::string_view::npos) {
+            break;
+        }
+        text.remove_prefix(space + 1);
+    }
+    return words;
+}
+
+void Tokenize(std::string_view text, TokenizedWords& words) {
+    words.clear();
+    ForEachWord(text, [&words](std::string_view word, bool is_valid) {
+        words.emplace_back(word, is_valid);
+        });
+}
+
+// The map of word sets RemoveDuplicates used before fingerprints
+std::vector<int> FindDuplicatesByWords(const SearchServer& search_server) {
+    std::map<std::vector<std::string>, int> word_set_to_document;
+    std::vector<int> duplicates;
+    for (const int document_id : search_server) {
+        std::vector<std::string> words;
+        const auto word_frequencies = search_server.GetWordFrequencies(document_id);
+        for (const auto& [word, freq] : *word_frequencies) {
+            words.emplace_back(word);
+        }
+        if (!word_set_to_document.emplace(std::move(words), document_id).second) {
+            duplicates.push_back(document_id);
+        }
+    }
+    return duplicates;
+}
+
+std::string_view GetKernelName(TokenizerKernel kernel) {
+    switch (kernel) {
+    case TokenizerKernel::SSE2:
+        return "SSE2"sv;
+    case TokenizerKernel::AVX2:
+        return "AVX2"sv;
+    default:
+        return "scalar"sv;
+    }
+}
+
+} // namespace
+
+void BenchmarkPostingLists(std::ostream& out) {
+    static constexpr int WORD_COUNT = 1'000;
+    static constexpr int DOCUMENT_COUNT = 100'000;
+    static constexpr int WORDS_PER_DOCUMENT = 20;
+    static constexpr int REPEAT_COUNT = 10;
+
+    std::mt19937 generator;
+    std::uniform_int_distribution<int> word_distribution(0, WORD_COUNT - 1);
+
+    std::vector<MapPostings> map_postings(WORD_COUNT);
+    std::vector<PostingList> flat_postings(WORD_COUNT);
+    allocated_bytes = 0;
+    for (int document_id = 0; document_id < DOCUMENT_COUNT; ++document_id) {
+        for (int i = 0; i < WORDS_PER_DOCUMENT; ++i) {
+            const int word = word_distribution(generator);
+            map_postings[word][document_id] += 1.0 / WORDS_PER_DOCUMENT;
+            flat_postings[word].Add(document_id, 1.0 / WORDS_PER_DOCUMENT);
+        }
+    }
+
+    size_t posting_count = 0;
+    size_t flat_bytes = 0;
+    for (const PostingList& postings : flat_postings) {
+        posting_count += postings.size();
+        flat_bytes += postings.GetMemoryUsage();
+    }
+    const size_t map_bytes = allocated_bytes + map_postings.size() * sizeof(MapPostings);
+
+    double map_checksum = 0;
+    const double map_speed = MeasurePostingsPerSecond(posting_count, REPEAT_COUNT, [&] {
+        for (const MapPostings& postings : map_postings) {
+            for (const auto& [document_id, term_freq] : postings) {
+                map_checksum += document_id * term_freq;
+            }
+        }
+    });
+
+    double flat_checksum = 0;
+    const double flat_speed = MeasurePostingsPerSecond(posting_count, REPEAT_COUNT, [&] {
+        for (const PostingList& postings : flat_postings) {
+            const ArrayView<int> document_ids = postings.GetDocumentIds();
+            const ArrayView<double> term_freqs = postings.GetTermFreqs();
+            for (size_t i = 0; i < document_ids.size(); ++i) {
+                flat_checksum += document_ids[i] * term_freqs[i];
+            }
+        }
+    });
+
+    out << "Posting lists: "sv << posting_count << " postings, "sv << WORD_COUNT << " words"sv << std::endl;
+    PrintResult(out, "std::map"sv, map_speed, static_cast<double>(map_bytes) / posting_count, map_checksum);
+    PrintResult(out, "PostingList"sv, flat_speed, static_cast<double>(flat_bytes) / posting_count, flat_checksum);
+}
+
+void BenchmarkQueryPruning(std::ostream& out) {
+    static constexpr int DOCUMENT_COUNT = 10'000;
+    static const QueryWorkload workloads[] = {
+        { "70-word queries"sv, 70, 100, 70 },
+        { "3-word queries"sv, 70, 1'000, 3 },
+        { "1-word queries, short documents"sv, 10, 1'000, 1 },
+    };
+
+    for (const QueryWorkload& workload : workloads) {
+        std::mt19937 generator;
+        const auto dictionary = GenerateDictionary(generator, 1'000, 10);
+        const auto documents = GenerateQueries(generator, dictionary, DOCUMENT_COUNT, workload.document_word_count);
+        SearchServer search_server(dictionary[0]);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+        }
+        const auto queries = GenerateQueries(generator, dictionary, workload.query_count, workload.query_word_count);
+
+        double exhaustive_seconds = 0;
+        search_server.SetQueryStrategy(QueryStrategy::EXHAUSTIVE);
+        RunQueries(search_server, queries, exhaustive_seconds);
+
+        double pruned_seconds = 0;
+        search_server.SetQueryStrategy(QueryStrategy::MAX_SCORE);
+        RunQueries(search_server, queries, pruned_seconds);
+        const PruningStats stats = search_server.GetPruningStats();
+
+        out << "Query pruning, "sv << workload.name << ": "sv
+            << "exhaustive "sv << exhaustive_seconds * 1000 << " ms, "sv
+            << "max-score "sv << pruned_seconds * 1000 << " ms, "sv
+            << "skipped "sv << stats.postings_total - stats.postings_scored << " of "sv << stats.postings_total << " postings"sv << std::endl;
+    }
+}
+
+void BenchmarkQueryCache(std::ostream& out) {
+    static constexpr int DOCUMENT_COUNT = 20'000;
+    static constexpr int DISTINCT_QUERY_COUNT = 500;
+    static constexpr int REQUEST_COUNT = 2'000;
+    static constexpr size_t CACHE_CAPACITY = 128;
+
+    std::mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1'000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, DOCUMENT_COUNT, 50);
+    SearchServer search_server(dictionary[0]);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+    }
+    // Skewed traffic: the k-th most popular query is requested with probability ~ 1/k
+    const auto distinct_queries = GenerateQueries(generator, dictionary, DISTINCT_QUERY_COUNT, 5);
+    std::vector<double> weights(DISTINCT_QUERY_COUNT);
+    for (int i = 0; i < DISTINCT_QUERY_COUNT; ++i) {
+        weights[i] = 1.0 / (i + 1);
+    }
+    std::discrete_distribution<int> query_distribution(weights.begin(), weights.end());
+    std::vector<std::string> queries;
+    queries.reserve(REQUEST_COUNT);
+    for (int i = 0; i < REQUEST_COUNT; ++i) {
+        queries.push_back(distinct_queries[query_distribution(generator)]);
+    }
+
+    double uncached_seconds = 0;
+    RunQueries(search_server, queries, uncached_seconds);
+
+    search_server.SetQueryCacheCapacity(CACHE_CAPACITY);
+    double cached_seconds = 0;
+    RunQueries(search_server, queries, cached_seconds);
+    const QueryCacheStats stats = search_server.GetQueryCacheStats();
+
+    out << "Query cache, "sv << REQUEST_COUNT << " requests of "sv << DISTINCT_QUERY_COUNT << " queries: "sv
+        << "uncached "sv << uncached_seconds * 1000 << " ms, "sv
+        << "cached "sv << cached_seconds * 1000 << " ms, "sv
+        << stats.hits << " hits, "sv << stats.misses << " misses"sv << std::endl;
+}
+
+void BenchmarkSnapshot(std::ostream& out) {
+    static constexpr int DOCUMENT_COUNT = 20'000;
+
+    std::mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1'000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, DOCUMENT_COUNT, 50);
+
+    using Clock = std::chrono::steady_clock;
+    auto start_time = Clock::now();
+    SearchServer search_server(dictionary[0]);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
+    }
+    const double build_seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+
+    const std::string path = (std::filesystem::temp_directory_path() / "search_server_benchmark.snapshot").string();
+    start_time = Clock::now();
+    search_server.SaveSnapshot(path);
+    const double save_seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+
+    start_time = Clock::now();
+    const std::unique_ptr<SearchServer> loaded_server = SearchServer::LoadSnapshot(path);
+    const double load_seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+
+    out << "Snapshot, "sv << DOCUMENT_COUNT << " documents, "sv << std::filesystem::file_size(path) << " bytes: "sv
+        << "AddDocument "sv << build_seconds * 1000 << " ms, "sv
+        << "save "sv << save_seconds * 1000 << " ms, "sv
+        << "load "sv << load_seconds * 1000 << " ms"sv << std::endl;
+    std::filesystem::remove(path);
+}
+
+void BenchmarkCorpusLoader(std::ostream& out) {
+    static constexpr int DOCUMENT_COUNT = 50'000;
+
+    std::mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1'000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, DOCUMENT_COUNT, 50);
+    const auto queries = GenerateQueries(generator, dictionary, 100, 5);
+    const std::string path = (std::filesystem::temp_directory_path() / "search_server_benchmark.corpus").string();
+    {
+        std::ofstream corpus(path);
+        for (size_t i = 0; i < documents.size(); ++i) {
+            corpus << i << "\tACTUAL\t1 2 3\t"sv << documents[i] << '\n';
+        }
+    }
+
+    // Lines are read into strings and every document is added on its own
+    using Clock = std::chrono::steady_clock;
+    auto start_time = Clock::now();
+    SearchServer line_server(dictionary[0]);
+    {
+        std::ifstream corpus(path);
+        std::string line;
+        while (std::getline(corpus, line)) {
+            const size_t text_begin = line.find('\t', line.find('\t', line.find('\t') + 1) + 1) + 1;
+            line_server.AddDocument(std::stoi(line), std::string_view(line).substr(text_begin), DocumentStatus::ACTUAL, { 1, 2, 3 });
+        }
+    }
+    const double line_seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+
+    start_time = Clock::now();
+    SearchServer mapped_server(dictionary[0]);
+    const CorpusLoadStats stats = LoadCorpus(mapped_server, path);
+    const double mapped_seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+
+    double seconds = 0;
+    const auto expected = RunQueries(line_server, queries, seconds);
+    const auto results = RunQueries(mapped_server, queries, seconds);
+    int mismatch_count = 0;
+    for (size_t i = 0; i < queries.size(); ++i) {
+        mismatch_count += IsSameResult(expected[i], results[i]) ? 0 : 1;
+    }
+    out << "Corpus loader, "sv << stats.document_count << " documents, "sv << stats.byte_count << " bytes: "sv
+        << "getline + AddDocument "sv << line_seconds * 1000 << " ms, "sv
+        << "LoadCorpus "sv << mapped_seconds * 1000 << " ms, "sv
+        << mismatch_count << " mismatched results"sv << std::endl;
+    std::filesystem::remove(path);
+}
+
+void BenchmarkTokenizer(std::ostream& out) {
+    static constexpr int REPEAT_COUNT = 10;
+
+    std::mt19937 generator;
+    std::string text;
+    for (const std::string& word : GenerateQueries(generator, GenerateDictionary(generator, 1'000, 10), 20'000, 50)) {
+        text.append(word).push_back(' ');
+    }
+
+    using Clock = std::chrono::steady_clock;
+    TokenizedWords words;
+    auto start_time = Clock::now();
+    size_t checksum = 0;
+    for (int i = 0; i < REPEAT_COUNT; ++i) {
+        checksum += ReferenceTokenize(text).size();
+    }
+    const double reference_seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+    out << "Tokenizer, "sv << text.size() << " bytes: byte by byte "sv
+        << text.size() * REPEAT_COUNT / reference_seconds / 1e6 << " MB/s"sv;
+
+    const TokenizerKernel default_kernel = GetTokenizerKernel();
+    for (const TokenizerKernel kernel : { TokenizerKernel::SCALAR, TokenizerKernel::SSE2, TokenizerKernel::AVX2 }) {
+        if (!IsTokenizerKernelSupported(kernel)) {
+            continue;
+        }
+        SetTokenizerKernel(kernel);
+        start_time = Clock::now();
+        for (int i = 0; i < REPEAT_COUNT; ++i) {
+            Tokenize(text, words);
+            checksum += words.size();
+        }
+        const double seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+        out << ", "sv << GetKernelName(kernel) << " "sv << text.size() * REPEAT_COUNT / seconds / 1e6 << " MB/s"sv;
+    }
+    SetTokenizerKernel(default_kernel);
+    out << " (checksum "sv << checksum << ")"sv << std::endl;
+}
+
+void BenchmarkDuplicates(std::ostream& out) {
+    static constexpr int DOCUMENT_COUNT = 50'000;
+
+    // Every 10th document repeats the words of an earlier one in another order,
+    // every 10th but 5 repeats them with one more word
+    std::mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1'000, 10);
+    auto documents = GenerateQueries(generator, dictionary, DOCUMENT_COUNT, 50);
+    std::set<int> near_copies;
+    for (int id = 10; id < DOCUMENT_COUNT; id += 5) {
+        std::vector<std::string_view> words = SplitIntoWords(documents[std::uniform_int_distribution<int>(0, id - 1)(generator)]);
+        std::shuffle(words.begin(), words.end(), generator);
+        std::string text;
+        for (const std::string_view word : words) {
+            text.append(word).push_back(' ');
+        }
+        if (id % 10 == 5) {
+            text.append(dictionary[std::uniform_int_distribution<size_t>(0, dictionary.size() - 1)(generator)]);
+            near_copies.insert(id);
+        }
+        else {
+            text.pop_back();
+        }
+        documents[id] = std::move(text);
+    }
+    SearchServer search_server(dictionary[0]);
+    for (int id = 0; id < DOCUMENT_COUNT; ++id) {
+        search_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, { 1 });
+    }
+
+    using Clock = std::chrono::steady_clock;
+    auto start_time = Clock::now();
+    const std::vector<int> expected = FindDuplicatesByWords(search_server);
+    const double words_seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+    start_time = Clock::now();
+    const std::vector<int> duplicates = search_server.FindDuplicates(std::execution::par);
+    const double fingerprint_seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+    start_time = Clock::now();
+    const std::vector<int> near_duplicates = search_server.FindNearDuplicates(std::execution::par, 0.8);
+    const double minhash_seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+
+    const size_t near_copies_found = std::count_if(near_duplicates.begin(), near_duplicates.end(), [&near_copies](int id) {
+        return near_copies.count(id) > 0;
+        });
+    start_time = Clock::now();
+    search_server.RemoveDocuments(duplicates);
+    const double remove_seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+    out << "Duplicates, "sv << DOCUMENT_COUNT << " documents: "sv
+        << "word sets "sv << words_seconds * 1000 << " ms, "sv
+        << "fingerprints "sv << fingerprint_seconds * 1000 << " ms ("sv << duplicates.size() << " found, "sv
+        << (duplicates == expected ? 0 : 1) << " mismatched results), "sv
+        << "MinHash at 0.8 "sv << minhash_seconds * 1000 << " ms ("sv << near_duplicates.size() << " found, "sv
+        << near_copies_found << " of "sv << near_copies.size() << " near copies), "sv
+        << "RemoveDocuments "sv << remove_seconds * 1000 << " ms, "sv
+        << search_server.GetDocumentCount() << " documents left"sv << std::endl;
+}
+
+void BenchmarkRemoval(std::ostream& out) {
+    static constexpr int DOCUMENT_COUNT = 50'000;
+
+    std::mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1'000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, DOCUMENT_COUNT, 50);
+    const auto queries = GenerateQueries(generator, dictionary, 100, 5);
+    std::vector<int> removed_ids;
+    for (int id = 0; id < DOCUMENT_COUNT; id += 2) {
+        removed_ids.push_back(id);
+    }
+    const auto make_server = [&] {
+        auto search_server = std::make_unique<SearchServer>(dictionary[0]);
+        search_server->SetSegmentSize(DOCUMENT_COUNT / 8);
+        for (int id = 0; id < DOCUMENT_COUNT; ++id) {
+            search_server->AddDocument(id, documents[id], DocumentStatus::ACTUAL, { 1 });
+        }
+        return search_server;
+    };
+
+    using Clock = std::chrono::steady_clock;
+    const auto one_by_one = make_server();
+    auto start_time = Clock::now();
+    for (const int id : removed_ids) {
+        one_by_one->RemoveDocument(id);
+    }
+    const double one_by_one_seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+
+    const auto batch = make_server();
+    // Only the explicit compaction below drops postings
+    batch->SetCompactionThreshold(1.0);
+    start_time = Clock::now();
+    batch->RemoveDocuments(removed_ids);
+    const double batch_seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+    double tombstone_seconds = 0;
+    RunQueries(*batch, queries, tombstone_seconds);
+    start_time = Clock::now();
+    batch->Compact();
+    const double compaction_seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+    double compacted_seconds = 0;
+    RunQueries(*batch, queries, compacted_seconds);
+
+    out << "Removal of "sv << removed_ids.size() << " of "sv << DOCUMENT_COUNT << " documents: "sv
+        << "RemoveDocument "sv << one_by_one_seconds * 1000 << " ms, "sv
+        << "RemoveDocuments "sv << batch_seconds * 1000 << " ms, "sv
+        << "Compact "sv << compaction_seconds * 1000 << " ms, "sv
+        << "queries with tombstones "sv << tombstone_seconds * 1000 << " ms, "sv
+        << "after compaction "sv << compacted_seconds * 1000 << " ms"sv << std::endl;
+}
+
+void BenchmarkDocumentFilters(std::ostream& out) {
+    static constexpr int DOCUMENT_COUNT = 50'000;
+    static constexpr DocumentStatus STATUSES[] = { DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT, DocumentStatus::BANNED, DocumentStatus::REMOVED };
+
+    std::mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1'000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, DOCUMENT_COUNT, 50);
+    const auto queries = GenerateQueries(generator, dictionary, 500, 5);
+    SearchServer search_server(dictionary[0]);
+    for (int id = 0; id < DOCUMENT_COUNT; ++id) {
+        search_server.AddDocument(id, documents[id], STATUSES[id % 4], { std::uniform_int_distribution<int>(-10, 10)(generator) });
+    }
+
+    using Clock = std::chrono::steady_clock;
+    const auto run = [&](auto filter, double& seconds) {
+        std::vector<std::vector<Document>> results;
+        results.reserve(queries.size());
+        const auto start_time = Clock::now();
+        for (const std::string& query : queries) {
+            results.push_back(search_server.FindTopDocuments(query, filter));
+        }
+        seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+        return results;
+    };
+    double status_seconds = 0;
+    double status_predicate_seconds = 0;
+    double rating_seconds = 0;
+    double rating_predicate_seconds = 0;
+    const auto status_results = run(DocumentStatus::BANNED, status_seconds);
+    const auto status_predicate_results = run([](int, DocumentStatus status, int) {
+        return status == DocumentStatus::BANNED;
+        }, status_predicate_seconds);
+    const auto rating_results = run(RatingRange{ 2, 5 }, rating_seconds);
+    const auto rating_predicate_results = run([](int, DocumentStatus, int rating) {
+        return rating >= 2 && rating <= 5;
+        }, rating_predicate_seconds);
+    int mismatch_count = 0;
+    for (size_t i = 0; i < queries.size(); ++i) {
+        mismatch_count += IsSameResult(status_results[i], status_predicate_results[i]) ? 0 : 1;
+        mismatch_count += IsSameResult(rating_results[i], rating_predicate_results[i]) ? 0 : 1;
+    }
+    out << "Document filters, "sv << queries.size() << " queries: "sv
+        << "status "sv << status_seconds * 1000 << " ms, status predicate "sv << status_predicate_seconds * 1000 << " ms, "sv
+        << "rating range "sv << rating_seconds * 1000 << " ms, rating predicate "sv << rating_predicate_seconds * 1000 << " ms, "sv
+        << mismatch_count << " mismatched results"sv << std::endl;
+}
+
+void BenchmarkPagination(std::ostream& out) {
+    static constexpr int DOCUMENT_COUNT = 50'000;
+    static constexpr size_t PAGE_SIZE = 10;
+    static constexpr size_t PAGE_COUNT = 200;
+
+    std::mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1'000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, DOCUMENT_COUNT, 50);
+    SearchServer search_server(dictionary[0]);
+    for (int id = 0; id < DOCUMENT_COUNT; ++id) {
+        search_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, { std::uniform_int_distribution<int>(-10, 10)(generator) });
+    }
+    const std::string query = dictionary[1] + " " + dictionary[2] + " " + dictionary[3];
+
+    using Clock = std::chrono::steady_clock;
+    std::vector<std::vector<Document>> pages;
+    std::optional<SearchCursor> cursor;
+    double first_page_seconds = 0;
+    auto start_time = Clock::now();
+    for (size_t i = 0; i < PAGE_COUNT; ++i) {
+        const auto page_start_time = Clock::now();
+        DocumentPage page = search_server.FindTopDocumentsPage(query, PAGE_SIZE, cursor);
+        if (i == 0) {
+            first_page_seconds = std::chrono::duration<double>(Clock::now() - page_start_time).count();
+        }
+        pages.push_back(std::move(page.documents));
+        cursor = page.next;
+        if (!cursor) {
+            break;
+        }
+    }
+    const double cursor_seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+
+    // Every page cut from a top of all documents up to it, as Paginate over FindTopDocuments would need
+    start_time = Clock::now();
+    int mismatch_count = 0;
+    for (size_t i = 0; i < pages.size(); ++i) {
+        const std::vector<Document> top = search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, (i + 1) * PAGE_SIZE);
+        const std::vector<Document> page(top.begin() + std::min(top.size(), i * PAGE_SIZE), top.end());
+        mismatch_count += IsSameResult(pages[i], page) ? 0 : 1;
+    }
+    const double top_seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+
+    out << "Pagination, "sv << pages.size() << " pages of "sv << PAGE_SIZE << ": "sv
+        << "cursor "sv << cursor_seconds * 1000 << " ms (first page "sv << first_page_seconds * 1000 << " ms), "sv
+        << "growing top "sv << top_seconds * 1000 << " ms, "sv
+        << mismatch_count << " mismatched pages"sv << std::endl;
+}
+
+void BenchmarkRequestQueue(std::ostream& out) {
+    static constexpr int DOCUMENT_COUNT = 20'000;
+    static constexpr size_t THREAD_COUNT = 4;
+
+    std::mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1'000, 10);
+    const auto documents = GenerateQueries(generator, dictionary, DOCUMENT_COUNT, 50);
+    const auto queries = GenerateQueries(generator, dictionary, 2'000, 5);
+    SearchServer search_server(dictionary[0]);
+    for (int id = 0; id < DOCUMENT_COUNT; ++id) {
+        search_server.AddDocument(id, documents[id], DocumentStatus::ACTUAL, { 1 });
+    }
+
+    using Clock = std::chrono::steady_clock;
+    const auto run = [&](auto find) {
+        std::vector<std::thread> threads;
+        const auto start_time = Clock::now();
+        for (size_t t = 0; t < THREAD_COUNT; ++t) {
+            threads.emplace_back([&, t] {
+                for (size_t i = t; i < queries.size(); i += THREAD_COUNT) {
+                    find(queries[i]);
+                }
+                });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        return std::chrono::duration<double>(Clock::now() - start_time).count();
+    };
+    const double direct_seconds = run([&](const std::string& query) {
+        return search_server.FindTopDocuments(query);
+        });
+    RequestQueue request_queue(search_server);
+    const double queue_seconds = run([&](const std::string& query) {
+        return request_queue.AddFindRequest(query, DocumentStatus::ACTUAL, 10);
+        });
+
+    const RequestStats stats = request_queue.GetStats();
+    out << "Request queue, "sv << queries.size() << " queries in "sv << THREAD_COUNT << " threads: "sv
+        << "direct "sv << direct_seconds * 1000 << " ms, through the queue "sv << queue_seconds * 1000 << " ms, "sv
+        << stats.request_count << " requests, "sv << stats.no_result_count << " without results, "sv
+        << stats.document_count << " documents, latency p50 "sv << stats.latency.p50 / 1000 << " us, p99 "sv
+        << stats.latency.p99 / 1000 << " us, p99.9 "sv << stats.latency.p999 / 1000 << " us, max "sv
+        << stats.latency.max / 1000 << " us"sv << std::endl;
+}
+
+void BenchmarkMetrics(std::ostream& out) {
+    static constexpr int DOCUMENT_COUNT = 20'000;
+
+    std::mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 1'000, 10);
+    const auto texts = GenerateQueries(generator, dictionary, DOCUMENT_COUNT, 50);
+    const auto queries = GenerateQueries(generator, dictionary, 500, 5);
+    std::vector<DocumentToAdd> documents;
+    for (int id = 0; id < DOCUMENT_COUNT; ++id) {
+        documents.push_back({ id, texts[id], DocumentStatus::ACTUAL, { 1 } });
+    }
+
+    const MetricsSnapshot start = GetMetricsSnapshot();
+    SearchServer search_server(dictionary[0]);
+    search_server.AddDocuments(std::execution::par, documents);
+    for (const std::string& query : queries) {
+        search_server.FindTopDocuments(std::execution::seq, query);
+        search_server.FindTopDocuments(std::execution::par, query);
+    }
+    const MetricsSnapshot metrics = GetMetricsSnapshot().Since(start);
+    out << "Metrics of "sv << DOCUMENT_COUNT << " documents and "sv << queries.size() * 2 << " queries:"sv << std::endl;
+    metrics.PrintText(out);
+    metrics.PrintJson(out);
+}
+
+void BenchmarkMinusWords(std::ostream& out) {
+    static constexpr int DOCUMENT_COUNT = 50'000;
+    static constexpr int QUERY_COUNT = 300;
+
+    std::mt19937 generator;
+    const auto dictionary = GenerateDictionary(generator, 10'000, 10);
+    const std::vector<double> zipf_weights = ComputeZipfWeights(static_cast<int>(dictionary.size()), 1.0);
+    SearchServer search_server(dictionary[0]);
+    for (int id = 0; id < DOCUMENT_COUNT; ++id) {
+        search_server.AddDocument(id, GenerateZipfQuery(generator, zipf_weights, dictionary, 50), DocumentStatus::ACTUAL, { id % 7 });
+    }
+    // Plus words of any frequency, minus words among the most common ones
+    std::vector<std::string> queries;
+    for (int i = 0; i < QUERY_COUNT; ++i) {
+        std::string query = GenerateZipfQuery(generator, zipf_weights, dictionary, 3);
+        for (int j = 0; j < 2; ++j) {
+            query += " -"s + dictionary[std::uniform_int_distribution<size_t>(1, 10)(generator)];
+        }
+        queries.push_back(std::move(query));
+    }
+
+    using Clock = std::chrono::steady_clock;
+    const auto run = [&](const auto& policy, double& seconds) {
+        std::vector<std::vector<Document>> results;
+        const auto start_time = Clock::now();
+        for (const std::string& query : queries) {
+            results.push_back(search_server.FindTopDocuments(policy, query));
+        }
+        seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+        return results;
+    };
+    double seq_seconds = 0;
+    double par_seconds = 0;
+    double max_score_seconds = 0;
+    const auto seq_results = run(std::execution::seq, seq_seconds);
+    const auto par_results = run(std::execution::par, par_seconds);
+    // MaxScore checks minus words per candidate document, independently of the query plan
+    search_server.SetQueryStrategy(QueryStrategy::MAX_SCORE);
+    const auto max_score_results = run(std::execution::seq, max_score_seconds);
+    // Parallel tasks may sum a split posting list in another order, so par is compared by ids
+    const auto is_same_ids = [](const std::vector<Document>& lhs, const std::vector<Document>& rhs) {
+        return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const Document& l, const Document& r) { return l.id == r.id; });
+    };
+    int mismatch_count = 0;
+    for (size_t i = 0; i < queries.size(); ++i) {
+        mismatch_count += is_same_ids(seq_results[i], par_results[i]) ? 0 : 1;
+        mismatch_count += IsSameResult(seq_results[i], max_score_results[i]) ? 0 : 1;
+    }
+    out << "Minus words, "sv << queries.size() << " queries with 2 common minus words: "sv
+        << "seq "sv << seq_seconds * 1000 << " ms, par "sv << par_seconds * 1000 << " ms, "sv
+        << "max-score "sv << max_score_seconds * 1000 << " ms, "sv
+        << mismatch_count << " mismatched results"sv << std::endl;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <iostream>
+
+// Compares std::map<int, double> postings with PostingList:
+// scan throughput and memory used per posting
+void BenchmarkPostingLists(std::ostream& out = std::cout);
+
+// Runs GenerateQueries workloads with QueryStrategy::EXHAUSTIVE and QueryStrategy::MAX_SCORE,
+// reports time, skipped postings and checks that both strategies return the same documents.
+// Long queries run exhaustively under MAX_SCORE too and skip no postings
+void BenchmarkQueryPruning(std::ostream& out = std::cout);
+
+// Runs skewed traffic with and without the query cache of SearchServer
+void BenchmarkQueryCache(std::ostream& out = std::cout);
+
+// Compares building a server with AddDocument and loading it from a snapshot
+void BenchmarkSnapshot(std::ostream& out = std::cout);
+
+// Compares reading a corpus with std::getline and AddDocument with LoadCorpus
+void BenchmarkCorpusLoader(std::ostream& out = std::cout);
+
+// Checks every tokenizer kernel the CPU supports against the byte by byte tokenizer on random
+// texts and compares their throughput
+void BenchmarkTokenizer(std::ostream& out = std::cout);
+
+// Compares finding duplicates by word sets with FindDuplicates on a corpus with planted
+// copies and reports how many near copies FindNearDuplicates finds
+void BenchmarkDuplicates(std::ostream& out = std::cout);
+
+// Compares removing half of the documents one by one and with RemoveDocuments, then queries
+// with tombstones and after Compact, checking results against a server without the documents
+void BenchmarkRemoval(std::ostream& out = std::cout);
+
+// Compares status and rating range filters checked in document columns with
+// the same filters written as predicates
+void BenchmarkDocumentFilters(std::ostream& out = std::cout);
+
+// Walks result pages of a broad query with a cursor and checks them against
+// pages cut from FindTopDocuments with a growing top_k
+void BenchmarkPagination(std::ostream& out = std::cout);
+
+// Runs queries from several threads directly and through a RequestQueue
+// and prints the counters and latency percentiles of the queue
+void BenchmarkRequestQueue(std::ostream& out = std::cout);
+
+// Adds documents and runs queries, then prints the metrics they recorded as text and JSON
+void BenchmarkMetrics(std::ostream& out = std::cout);
+
+// Runs queries with common minus words on a Zipfian corpus with the seq and par policies
+// and checks them against MaxScore, which excludes minus words per candidate document
+void BenchmarkMinusWords(std::ostream& out = std::cout);
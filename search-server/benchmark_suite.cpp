@@ -0,0 +1,363 @@
+#include "benchmark_suite.h"
+#include "search_server.h"
+#include "generators.h"
+#include "process_queries.h"
+#include "remove_duplicates.h"
+
+#include <algorithm>
+#include <chrono>
+#include <execution>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <utility>
+
+using namespace std::string_literals;
+using namespace std::string_view_literals;
+
+namespace {
+
+struct Corpus {
+    std::vector<std::string> dictionary;
+    std::vector<std::string> documents;
+    std::vector<std::string> queries;
+};
+
+Corpus GenerateCorpus(const BenchmarkProfile& profile) {
+    std::mt19937 generator(profile.seed);
+    Corpus corpus;
+    corpus.dictionary = GenerateDictionary(generator, profile.dictionary_size, profile.max_word_length);
+    const std::vector<double> zipf_weights = profile.zipf_exponent > 0
+        ? ComputeZipfWeights(static_cast<int>(corpus.dictionary.size()), profile.zipf_exponent)
+        : std::vector<double>{};
+    const auto generate_text = [&](int word_count, double minus_prob) {
+        return zipf_weights.empty()
+            ? GenerateQuery(generator, corpus.dictionary, word_count, minus_prob)
+            : GenerateZipfQuery(generator, zipf_weights, corpus.dictionary, word_count, minus_prob);
+    };
+    for (int i = 0; i < profile.document_count; ++i) {
+        corpus.documents.push_back(generate_text(profile.document_word_count, 0));
+    }
+    for (int i = 0; i < profile.query_count; ++i) {
+        corpus.queries.push_back(generate_text(profile.query_word_count, profile.minus_word_prob));
+    }
+    return corpus;
+}
+
+std::vector<DocumentToAdd> MakeDocumentsToAdd(const std::vector<std::string>& texts, int first_id) {
+    std::vector<DocumentToAdd> documents;
+    documents.reserve(texts.size());
+    for (size_t i = 0; i < texts.size(); ++i) {
+        const int id = first_id + static_cast<int>(i);
+        documents.push_back({ id, texts[i], DocumentStatus::ACTUAL, { id % 21 - 10 } });
+    }
+    return documents;
+}
+
+std::unique_ptr<SearchServer> BuildServer(const Corpus& corpus) {
+    auto search_server = std::make_unique<SearchServer>(corpus.dictionary[0]);
+    search_server->AddDocuments(std::execution::par, MakeDocumentsToAdd(corpus.documents, 0));
+    return search_server;
+}
+
+uint64_t Combine(uint64_t checksum, uint64_t value) {
+    return (checksum ^ value) * 1099511628211ULL;
+}
+
+uint64_t Combine(uint64_t checksum, const std::vector<Document>& documents) {
+    checksum = Combine(checksum, documents.size());
+    for (const Document& document : documents) {
+        checksum = Combine(checksum, static_cast<uint64_t>(document.id));
+    }
+    return checksum;
+}
+
+// Calls operation(*setup()) repeat_count times and times the operation only
+template <typename Setup, typename Operation>
+BenchmarkResult Measure(const BenchmarkProfile& profile, std::string name, uint64_t operation_count, int repeat_count,
+    Setup setup, Operation operation) {
+    using Clock = std::chrono::steady_clock;
+
+    BenchmarkResult result{ profile.name, std::move(name), operation_count, 0, 0 };
+    std::vector<double> times;
+    for (int i = 0; i < repeat_count; ++i) {
+        auto state = setup();
+        const auto start_time = Clock::now();
+        result.checksum = operation(*state);
+        times.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start_time).count());
+    }
+    std::sort(times.begin(), times.end());
+    result.nanoseconds_per_operation = times[times.size() / 2] / std::max<uint64_t>(operation_count, 1);
+    return result;
+}
+
+// Suppresses what RemoveDuplicates prints
+class MutedOutput {
+public:
+    MutedOutput()
+        : buffer_(std::cout.rdbuf(nullptr)) {
+    }
+
+    ~MutedOutput() {
+        std::cout.rdbuf(buffer_);
+        std::cout.clear();
+    }
+
+private:
+    std::streambuf* buffer_;
+};
+
+std::string_view FindJsonValue(std::string_view line, std::string_view key) {
+    const std::string pattern = "\""s + std::string(key) + "\": "s;
+    const size_t begin = line.find(pattern);
+    if (begin == std::string_view::npos) {
+        throw std::invalid_argument("Benchmark result has no "s + std::string(key));
+    }
+    std::string_view value = line.substr(begin + pattern.size());
+    value = value.substr(0, value.find_first_of(",}"sv));
+    if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+        value = value.substr(1, value.size() - 2);
+    }
+    return value;
+}
+
+}  // namespace
+
+const std::vector<BenchmarkProfile>& GetBenchmarkProfiles() {
+    static const std::vector<BenchmarkProfile> profiles = {
+        { "small"s, 1, 1'000, 10, 10'000, 70, 1'000, 7, 0.1, 0 },
+        { "zipf"s, 2, 10'000, 10, 20'000, 70, 1'000, 5, 0.1, 1.0 },
+        { "large_vocabulary"s, 3, 100'000, 12, 20'000, 70, 1'000, 5, 0.1, 0 },
+        { "short_documents"s, 4, 5'000, 10, 100'000, 10, 1'000, 3, 0.1, 0.8 },
+    };
+    return profiles;
+}
+
+std::vector<BenchmarkResult> RunBenchmarkSuite(const BenchmarkProfile& profile, int repeat_count) {
+    const Corpus corpus = GenerateCorpus(profile);
+    const std::vector<DocumentToAdd> documents = MakeDocumentsToAdd(corpus.documents, 0);
+    const std::unique_ptr<SearchServer> search_server = BuildServer(corpus);
+    const auto shared_server = [&search_server] { return search_server.get(); };
+    const auto new_server = [&corpus] { return BuildServer(corpus); };
+    const auto empty_server = [&corpus] { return std::make_unique<SearchServer>(corpus.dictionary[0]); };
+    const uint64_t document_count = corpus.documents.size();
+    const uint64_t query_count = corpus.queries.size();
+
+    std::vector<BenchmarkResult> results;
+    results.push_back(Measure(profile, "add_document"s, document_count, repeat_count, empty_server, [&](SearchServer& server) {
+        for (const DocumentToAdd& document : documents) {
+            server.AddDocument(document.id, document.text, document.status, document.ratings);
+        }
+        return static_cast<uint64_t>(server.GetDocumentCount());
+        }));
+    results.push_back(Measure(profile, "add_documents_par"s, document_count, repeat_count, empty_server, [&](SearchServer& server) {
+        server.AddDocuments(std::execution::par, documents);
+        return static_cast<uint64_t>(server.GetDocumentCount());
+        }));
+
+    const auto find_top = [&](const auto& policy) {
+        return [&corpus, policy](const SearchServer& server) {
+            uint64_t checksum = 0;
+            for (const std::string& query : corpus.queries) {
+                checksum = Combine(checksum, server.FindTopDocuments(policy, query));
+            }
+            return checksum;
+        };
+    };
+    results.push_back(Measure(profile, "find_top_documents_seq"s, query_count, repeat_count, shared_server, find_top(std::execution::seq)));
+    results.push_back(Measure(profile, "find_top_documents_par"s, query_count, repeat_count, shared_server, find_top(std::execution::par)));
+
+    const auto match = [&](const auto& policy) {
+        return [&corpus, policy](const SearchServer& server) {
+            uint64_t checksum = 0;
+            for (size_t i = 0; i < corpus.queries.size(); ++i) {
+                const int document_id = static_cast<int>(i * 7919 % corpus.documents.size());
+                const auto [words, status] = server.MatchDocument(policy, corpus.queries[i], document_id);
+                checksum = Combine(Combine(checksum, words.size()), static_cast<uint64_t>(status));
+            }
+            return checksum;
+        };
+    };
+    results.push_back(Measure(profile, "match_document_seq"s, query_count, repeat_count, shared_server, match(std::execution::seq)));
+    results.push_back(Measure(profile, "match_document_par"s, query_count, repeat_count, shared_server, match(std::execution::par)));
+
+    results.push_back(Measure(profile, "remove_document"s, (document_count + 9) / 10, repeat_count, new_server, [&](SearchServer& server) {
+        for (int id = 0; id < static_cast<int>(document_count); id += 10) {
+            server.RemoveDocument(id);
+        }
+        return static_cast<uint64_t>(server.GetDocumentCount());
+        }));
+
+    // Every tenth document is added once more under a new id
+    std::vector<std::string> duplicate_texts;
+    for (size_t i = 0; i < corpus.documents.size(); i += 10) {
+        duplicate_texts.push_back(corpus.documents[i]);
+    }
+    const std::vector<DocumentToAdd> duplicates = MakeDocumentsToAdd(duplicate_texts, static_cast<int>(document_count));
+    results.push_back(Measure(profile, "remove_duplicates"s, document_count + duplicates.size(), repeat_count,
+        [&] {
+            auto server = BuildServer(corpus);
+            server->AddDocuments(std::execution::par, duplicates);
+            return server;
+        },
+        [](SearchServer& server) {
+            MutedOutput muted_output;
+            RemoveDuplicates(server);
+            return static_cast<uint64_t>(server.GetDocumentCount());
+        }));
+
+    results.push_back(Measure(profile, "process_queries"s, query_count, repeat_count, shared_server, [&corpus](const SearchServer& server) {
+        uint64_t checksum = 0;
+        for (const std::vector<Document>& documents : ProcessQueries(server, corpus.queries)) {
+            checksum = Combine(checksum, documents);
+        }
+        return checksum;
+        }));
+    return results;
+}
+
+void WriteBenchmarkResults(std::ostream& out, const std::vector<BenchmarkResult>& results) {
+    // Names are identifiers, they need no escaping
+    for (const BenchmarkResult& result : results) {
+        out << "{\"profile\": \""sv << result.profile << "\", \"name\": \""sv << result.name
+            << "\", \"operations\": "sv << result.operation_count
+            << ", \"ns_per_operation\": "sv << result.nanoseconds_per_operation
+            << ", \"checksum\": "sv << result.checksum << "}\n"sv;
+    }
+    out.flush();
+}
+
+std::vector<BenchmarkResult> ReadBenchmarkResults(std::istream& in) {
+    std::vector<BenchmarkResult> results;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        try {
+            BenchmarkResult& result = results.emplace_back();
+            result.profile = std::string(FindJsonValue(line, "profile"sv));
+            result.name = std::string(FindJsonValue(line, "name"sv));
+            result.operation_count = std::stoull(std::string(FindJsonValue(line, "operations"sv)));
+            result.nanoseconds_per_operation = std::stod(std::string(FindJsonValue(line, "ns_per_operation"sv)));
+            result.checksum = std::stoull(std::string(FindJsonValue(line, "checksum"sv)));
+        }
+        catch (const std::logic_error&) {
+            throw std::invalid_argument("Malformed benchmark result: "s + line);
+        }
+    }
+    return results;
+}
+
+int CompareBenchmarkResults(const std::vector<BenchmarkResult>& baseline, const std::vector<BenchmarkResult>& results,
+    double tolerance, std::ostream& out) {
+    std::map<std::pair<std::string_view, std::string_view>, const BenchmarkResult*> baseline_results;
+    for (const BenchmarkResult& result : baseline) {
+        baseline_results[{ result.profile, result.name }] = &result;
+    }
+    int regression_count = 0;
+    for (const BenchmarkResult& result : results) {
+        const auto it = baseline_results.find({ result.profile, result.name });
+        if (it == baseline_results.end()) {
+            continue;
+        }
+        const BenchmarkResult& base = *it->second;
+        const double change = base.nanoseconds_per_operation > 0
+            ? result.nanoseconds_per_operation / base.nanoseconds_per_operation - 1
+            : 0.0;
+        const bool is_slower = change > tolerance;
+        const bool is_changed = result.checksum != base.checksum || result.operation_count != base.operation_count;
+        out << result.profile << ' ' << result.name << ": "sv << base.nanoseconds_per_operation << " -> "sv
+            << result.nanoseconds_per_operation << " ns ("sv << (change >= 0 ? "+"sv : ""sv) << change * 100 << "%)"sv
+            << (is_slower ? " REGRESSION"sv : ""sv) << (is_changed ? " CHANGED RESULTS"sv : ""sv) << '\n';
+        regression_count += (is_slower || is_changed) ? 1 : 0;
+    }
+    out << regression_count << " regressions"sv << std::endl;
+    return regression_count;
+}
+
+int RunBenchmarkSuiteCommand(const std::vector<std::string_view>& args) {
+    std::vector<std::string_view> profile_names;
+    int repeat_count = 3;
+    std::string output_path;
+    std::string baseline_path;
+    double tolerance = 0.1;
+    try {
+        for (size_t i = 0; i < args.size(); ++i) {
+            if (i + 1 == args.size()) {
+                throw std::invalid_argument("No value of "s + std::string(args[i]));
+            }
+            const std::string_view option = args[i];
+            const std::string value(args[++i]);
+            if (option == "--profile"sv) {
+                profile_names.push_back(args[i]);
+            }
+            else if (option == "--repeat"sv) {
+                repeat_count = std::max(1, std::stoi(value));
+            }
+            else if (option == "--output"sv) {
+                output_path = value;
+            }
+            else if (option == "--baseline"sv) {
+                baseline_path = value;
+            }
+            else if (option == "--tolerance"sv) {
+                tolerance = std::stod(value);
+            }
+            else {
+                throw std::invalid_argument("Unknown option "s + std::string(option));
+            }
+        }
+    }
+    catch (const std::logic_error& error) {
+        std::cerr << error.what() << std::endl;
+        return 2;
+    }
+
+    std::vector<BenchmarkProfile> profiles;
+    for (const BenchmarkProfile& profile : GetBenchmarkProfiles()) {
+        if (profile_names.empty() || std::find(profile_names.begin(), profile_names.end(), profile.name) != profile_names.end()) {
+            profiles.push_back(profile);
+        }
+    }
+    if (profiles.empty()) {
+        std::cerr << "No such profile"sv << std::endl;
+        return 2;
+    }
+
+    std::vector<BenchmarkResult> results;
+    for (const BenchmarkProfile& profile : profiles) {
+        for (BenchmarkResult& result : RunBenchmarkSuite(profile, repeat_count)) {
+            results.push_back(std::move(result));
+        }
+    }
+    if (output_path.empty()) {
+        WriteBenchmarkResults(std::cout, results);
+    }
+    else {
+        std::ofstream output(output_path);
+        WriteBenchmarkResults(output, results);
+    }
+
+    if (baseline_path.empty()) {
+        return 0;
+    }
+    std::ifstream baseline_input(baseline_path);
+    if (!baseline_input) {
+        std::cerr << "Cannot open "sv << baseline_path << std::endl;
+        return 2;
+    }
+    std::vector<BenchmarkResult> baseline;
+    try {
+        baseline = ReadBenchmarkResults(baseline_input);
+    }
+    catch (const std::invalid_argument& error) {
+        std::cerr << error.what() << std::endl;
+        return 2;
+    }
+    // The standard output may hold the results
+    std::ostream& report = output_path.empty() ? std::cerr : std::cout;
+    return CompareBenchmarkResults(baseline, results, tolerance, report) > 0 ? 1 : 0;
+}
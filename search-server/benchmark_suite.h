@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A synthetic corpus generated from a fixed seed, the same on every run
+struct BenchmarkProfile {
+    std::string name;
+    unsigned seed = 0;
+    int dictionary_size = 0;
+    int max_word_length = 0;
+    int document_count = 0;
+    int document_word_count = 0;
+    int query_count = 0;
+    int query_word_count = 0;
+    double minus_word_prob = 0;
+    // Words are uniform when 0, Zipf-distributed with this exponent otherwise
+    double zipf_exponent = 0;
+};
+
+const std::vector<BenchmarkProfile>& GetBenchmarkProfiles();
+
+struct BenchmarkResult {
+    std::string profile;
+    std::string name;
+    uint64_t operation_count = 0;
+    // The median of the repeats
+    double nanoseconds_per_operation = 0;
+    // Depends on the results only, a change means the operation behaves differently
+    uint64_t checksum = 0;
+};
+
+// Runs every benchmark of the profile repeat_count times
+std::vector<BenchmarkResult> RunBenchmarkSuite(const BenchmarkProfile& profile, int repeat_count);
+
+// One JSON object per line
+void WriteBenchmarkResults(std::ostream& out, const std::vector<BenchmarkResult>& results);
+
+// Reads what WriteBenchmarkResults writes, throws invalid_argument on a malformed line
+std::vector<BenchmarkResult> ReadBenchmarkResults(std::istream& in);
+
+// Prints a line per benchmark found in both lists and returns the number of regressions:
+// benchmarks slower than the baseline by more than the tolerance, a fraction of the baseline
+// time, or with a different checksum
+int CompareBenchmarkResults(const std::vector<BenchmarkResult>& baseline, const std::vector<BenchmarkResult>& results,
+    double tolerance, std::ostream& out);
+
+// Runs the suite with command line options, returns the exit code:
+//   --profile NAME      only this profile, may be repeated
+//   --repeat N          repeats of every benchmark, 3 by default
+//   --output FILE       results are written to the file instead of the standard output
+//   --baseline FILE     results are compared with the file, the code is 1 on regressions
+//   --tolerance X       allowed slowdown against the baseline, 0.1 by default
+int RunBenchmarkSuiteCommand(const std::vector<std::string_view>& args);
@@ -0,0 +1,308 @@
+#include "corpus_loader.h"
+#include "bounded_queue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#define CORPUS_NO_MMAP
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std::string_literals;
+
+namespace {
+
+// A read-only part of a file. Texts of documents point into it until they are indexed
+class FileWindow {
+public:
+    FileWindow(const std::string& path, int fd, uint64_t offset, size_t size) {
+#ifdef CORPUS_NO_MMAP
+        std::ifstream in(path, std::ios::binary);
+        in.seekg(static_cast<std::streamoff>(offset));
+        buffer_.resize(size);
+        if (!in.read(buffer_.data(), static_cast<std::streamsize>(size))) {
+            throw std::runtime_error("cannot read corpus "s + path);
+        }
+        text_ = std::string_view(buffer_.data(), size);
+#else
+        // The mapping starts at a page boundary
+        const uint64_t page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+        const uint64_t map_offset = offset / page_size * page_size;
+        map_size_ = static_cast<size_t>(offset - map_offset) + size;
+        void* data = mmap(nullptr, map_size_, PROT_READ, MAP_SHARED, fd, static_cast<off_t>(map_offset));
+        if (data == MAP_FAILED) {
+            throw std::runtime_error("cannot map corpus "s + path);
+        }
+        madvise(data, map_size_, MADV_SEQUENTIAL);
+        map_data_ = data;
+        text_ = std::string_view(static_cast<const char*>(data) + (offset - map_offset), size);
+#endif
+    }
+
+    ~FileWindow() {
+#ifndef CORPUS_NO_MMAP
+        munmap(map_data_, map_size_);
+#endif
+    }
+
+    FileWindow(const FileWindow&) = delete;
+    FileWindow& operator=(const FileWindow&) = delete;
+
+    std::string_view GetText() const {
+        return text_;
+    }
+
+private:
+    std::string_view text_;
+#ifdef CORPUS_NO_MMAP
+    std::vector<char> buffer_;
+#else
+    void* map_data_ = nullptr;
+    size_t map_size_ = 0;
+#endif
+};
+
+// Documents of a batch point into the window
+struct ParsedBatch {
+    std::shared_ptr<const FileWindow> window;
+    std::vector<DocumentToAdd> documents;
+};
+
+struct PreparedBatch {
+    std::unique_ptr<ParsedBatch> batch;
+    SearchServer::PreparedDocuments documents;
+};
+
+std::string_view TakeField(std::string_view& line) {
+    const size_t tab = line.find('\t');
+    const std::string_view field = line.substr(0, tab);
+    line.remove_prefix(tab == std::string_view::npos ? line.size() : tab + 1);
+    return field;
+}
+
+bool ParseInt(std::string_view text, int& value) {
+    const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return error == std::errc() && end == text.data() + text.size();
+}
+
+bool ParseStatus(std::string_view text, DocumentStatus& status) {
+    static const std::pair<std::string_view, DocumentStatus> names[] = {
+        { "ACTUAL", DocumentStatus::ACTUAL },
+        { "IRRELEVANT", DocumentStatus::IRRELEVANT },
+        { "BANNED", DocumentStatus::BANNED },
+        { "REMOVED", DocumentStatus::REMOVED },
+    };
+    for (const auto& [name, name_status] : names) {
+        if (text == name) {
+            status = name_status;
+            return true;
+        }
+    }
+    return false;
+}
+
+DocumentToAdd ParseDocument(std::string_view line, uint64_t line_number) {
+    const auto fail = [line_number]() -> DocumentToAdd {
+        throw std::invalid_argument("corpus line "s + std::to_string(line_number) + " is malformed"s);
+    };
+    DocumentToAdd document;
+    if (!ParseInt(TakeField(line), document.id) || !ParseStatus(TakeField(line), document.status)) {
+        return fail();
+    }
+    for (const std::string_view rating : SplitIntoWords(TakeField(line))) {
+        if (!ParseInt(rating, document.ratings.emplace_back())) {
+            return fail();
+        }
+    }
+    if (document.ratings.empty()) {
+        return fail();
+    }
+    document.text = line;
+    return document;
+}
+
+// Reports the first error of any stage and stops the others
+class PipelineError {
+public:
+    void Set(std::exception_ptr error) {
+        std::lock_guard guard(mutex_);
+        if (!error_) {
+            error_ = error;
+        }
+        is_failed_ = true;
+    }
+
+    bool IsFailed() const {
+        return is_failed_;
+    }
+
+    void Rethrow() {
+        std::lock_guard guard(mutex_);
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::exception_ptr error_;
+    std::atomic<bool> is_failed_ = false;
+};
+
+} // namespace
+
+CorpusLoadStats LoadCorpus(SearchServer& search_server, const std::string& path, const CorpusLoaderOptions& options) {
+    int fd = -1;
+    uint64_t file_size = 0;
+#ifdef CORPUS_NO_MMAP
+    {
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in) {
+            throw std::runtime_error("cannot open corpus "s + path);
+        }
+        file_size = static_cast<uint64_t>(in.tellg());
+    }
+#else
+    fd = open(path.c_str(), O_RDONLY);
+    struct stat file_stat;
+    if (fd < 0 || fstat(fd, &file_stat) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        throw std::runtime_error("cannot open corpus "s + path);
+    }
+    file_size = static_cast<uint64_t>(file_stat.st_size);
+#endif
+
+    BoundedQueue<std::unique_ptr<ParsedBatch>> parsed_batches(options.queue_capacity);
+    BoundedQueue<PreparedBatch> prepared_batches(options.queue_capacity);
+    PipelineError error;
+    const auto stop = [&](std::exception_ptr exception) {
+        error.Set(exception);
+        parsed_batches.Close();
+        prepared_batches.Close();
+    };
+
+    // Maps the file window by window, every window ends at a line end. A malformed line ends
+    // the input: the documents before it are still added, then its error is reported
+    std::exception_ptr parse_error;
+    std::thread reader([&] {
+        try {
+            uint64_t position = 0;
+            uint64_t line_number = 0;
+            while (position < file_size && !error.IsFailed()) {
+                size_t window_size = static_cast<size_t>(std::min<uint64_t>(std::max<size_t>(options.window_size, 1), file_size - position));
+                std::shared_ptr<const FileWindow> window;
+                std::string_view text;
+                while (true) {
+                    window = std::make_shared<const FileWindow>(path, fd, position, window_size);
+                    text = window->GetText();
+                    if (position + window_size == file_size) {
+                        break;
+                    }
+                    const size_t line_end = text.rfind('\n');
+                    if (line_end != std::string_view::npos) {
+                        text = text.substr(0, line_end + 1);
+                        break;
+                    }
+                    // A line longer than the window
+                    window_size = static_cast<size_t>(std::min<uint64_t>(window_size * 2, file_size - position));
+                }
+                position += text.size();
+
+                auto batch = std::make_unique<ParsedBatch>();
+                batch->window = window;
+                while (!text.empty()) {
+                    const size_t line_end = text.find('\n');
+                    std::string_view line = text.substr(0, line_end);
+                    text.remove_prefix(line_end == std::string_view::npos ? text.size() : line_end + 1);
+                    ++line_number;
+                    if (!line.empty() && line.back() == '\r') {
+                        line.remove_suffix(1);
+                    }
+                    if (line.empty()) {
+                        continue;
+                    }
+                    try {
+                        batch->documents.push_back(ParseDocument(line, line_number));
+                    }
+                    catch (const std::invalid_argument&) {
+                        parse_error = std::current_exception();
+                        break;
+                    }
+                    if (batch->documents.size() == options.batch_size) {
+                        if (!parsed_batches.Push(std::move(batch))) {
+                            return;
+                        }
+                        batch = std::make_unique<ParsedBatch>();
+                        batch->window = window;
+                    }
+                }
+                if (!batch->documents.empty() && !parsed_batches.Push(std::move(batch))) {
+                    return;
+                }
+                if (parse_error) {
+                    break;
+                }
+            }
+            parsed_batches.Close();
+        }
+        catch (...) {
+            stop(std::current_exception());
+        }
+    });
+
+    std::thread tokenizer([&] {
+        try {
+            while (std::optional<std::unique_ptr<ParsedBatch>> batch = parsed_batches.Pop()) {
+                SearchServer::PreparedDocuments documents = search_server.PrepareDocuments(std::execution::par, (*batch)->documents);
+                if (!prepared_batches.Push({ std::move(*batch), std::move(documents) })) {
+                    return;
+                }
+            }
+            prepared_batches.Close();
+        }
+        catch (...) {
+            stop(std::current_exception());
+        }
+    });
+
+    CorpusLoadStats stats;
+    try {
+        while (std::optional<PreparedBatch> batch = prepared_batches.Pop()) {
+            if (error.IsFailed()) {
+                break;
+            }
+            search_server.AddDocuments(std::move(batch->documents));
+            stats.document_count += batch->batch->documents.size();
+        }
+    }
+    catch (...) {
+        stop(std::current_exception());
+    }
+    reader.join();
+    tokenizer.join();
+#ifndef CORPUS_NO_MMAP
+    close(fd);
+#endif
+    error.Rethrow();
+    if (parse_error) {
+        std::rethrow_exception(parse_error);
+    }
+    stats.byte_count = file_size;
+    return stats;
+}
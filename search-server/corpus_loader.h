@@ -0,0 +1,28 @@
+#pragma once
+#include "search_server.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct CorpusLoaderOptions {
+    size_t batch_size = 4096;  // documents
+    size_t queue_capacity = 4;  // batches between two stages
+    size_t window_size = 64 << 20;  // bytes of the file mapped at once
+};
+
+struct CorpusLoadStats {
+    size_t document_count = 0;
+    uint64_t byte_count = 0;
+};
+
+// Adds the documents of a corpus file to the server. Every non-empty line is a document:
+//     id <TAB> status <TAB> ratings <TAB> text
+// where status is ACTUAL, IRRELEVANT, BANNED or REMOVED and at least one rating is given,
+// ratings are separated by spaces.
+// The file is mapped window by window and texts are tokenized in place. Reading, tokenizing
+// and indexing run as a pipeline with bounded queues, so memory used by the loader does not
+// depend on the file size. Throws invalid_argument with the line number for a malformed line
+// after adding the documents before it. A batch the server rejects is not added, and neither
+// are the batches after it
+CorpusLoadStats LoadCorpus(SearchServer& search_server, const std::string& path, const CorpusLoaderOptions& options = {});
@@ -0,0 +1,13 @@
+#include "document_bitmap.h"
+
+void DocumentBitmap::Insert(int document_id) {
+    const size_t page = static_cast<size_t>(document_id) >> PAGE_BITS;
+    if (page >= pages_.size()) {
+        pages_.resize(page + 1);
+    }
+    if (!pages_[page]) {
+        pages_[page] = std::make_unique<Page>();
+    }
+    const size_t offset = static_cast<size_t>(document_id) & (PAGE_SIZE - 1);
+    (*pages_[page])[offset / 64] |= uint64_t(1) << (offset % 64);
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Set of document ids in bit pages of PAGE_SIZE allocated on first use,
+// so sparse ids cost a page each and a lookup is two array reads
+class DocumentBitmap {
+public:
+    void Insert(int document_id);
+
+    bool Contains(int document_id) const;
+
+    bool IsEmpty() const {
+        return pages_.empty();
+    }
+
+private:
+    static constexpr int PAGE_BITS = 12;
+    static constexpr size_t PAGE_SIZE = size_t(1) << PAGE_BITS;
+
+    using Page = std::array<uint64_t, PAGE_SIZE / 64>;
+
+    std::vector<std::unique_ptr<Page>> pages_;
+};
+
+inline bool DocumentBitmap::Contains(int document_id) const {
+    const size_t page = static_cast<size_t>(document_id) >> PAGE_BITS;
+    if (page >= pages_.size() || !pages_[page]) {
+        return false;
+    }
+    const size_t offset = static_cast<size_t>(document_id) & (PAGE_SIZE - 1);
+    return ((*pages_[page])[offset / 64] >> (offset % 64) & 1) != 0;
+}
@@ -0,0 +1,85 @@
+#include "document_columns.h"
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+using namespace std::string_literals;
+
+DocumentColumns DocumentColumns::MakeView(ArrayView<uint64_t> page_indexes, ArrayView<Page> pages, std::shared_ptr<const void> storage) {
+    if (page_indexes.size() != pages.size()
+        || std::adjacent_find(page_indexes.begin(), page_indexes.end(), std::greater_equal<uint64_t>()) != page_indexes.end()
+        || (!page_indexes.empty() && page_indexes.back() > (size_t(INT32_MAX) >> PAGE_BITS))) {
+        throw std::invalid_argument("document columns are corrupted"s);
+    }
+    DocumentColumns columns;
+    columns.storage_ = std::move(storage);
+    if (!page_indexes.empty()) {
+        columns.pages_.resize(page_indexes.back() + 1);
+    }
+    for (size_t i = 0; i < pages.size(); ++i) {
+        columns.pages_[page_indexes[i]] = std::shared_ptr<const Page>(columns.storage_, &pages[i]);
+    }
+    return columns;
+}
+
+void DocumentColumns::Reserve(int document_id) {
+    GetPage(document_id);
+}
+
+void DocumentColumns::Add(int document_id, SegmentId segment_id, DocumentStatus status, int rating) {
+    Page& page = GetPage(document_id);
+    const size_t offset = GetOffset(document_id);
+    page.segment_ids[offset] = segment_id;
+    page.ratings[offset] = rating;
+    for (size_t i = 0; i < STATUS_COUNT; ++i) {
+        page.status_bits[i][offset / 64] &= ~(uint64_t(1) << (offset % 64));
+    }
+    page.status_bits[static_cast<size_t>(status)][offset / 64] |= uint64_t(1) << (offset % 64);
+}
+
+void DocumentColumns::Erase(int document_id) {
+    const size_t page_index = static_cast<size_t>(document_id) >> PAGE_BITS;
+    if (page_index >= pages_.size() || !pages_[page_index]) {
+        return;
+    }
+    Page& page = GetPage(document_id);
+    const size_t offset = GetOffset(document_id);
+    page.segment_ids[offset] = 0;
+    page.ratings[offset] = 0;
+    for (size_t i = 0; i < STATUS_COUNT; ++i) {
+        page.status_bits[i][offset / 64] &= ~(uint64_t(1) << (offset % 64));
+    }
+}
+
+void DocumentColumns::SetSegmentId(int document_id, SegmentId segment_id) {
+    GetPage(document_id).segment_ids[GetOffset(document_id)] = segment_id;
+}
+
+DocumentStatus DocumentColumns::GetStatus(int document_id) const {
+    const Page& page = *FindPage(document_id);
+    const size_t offset = GetOffset(document_id);
+    for (size_t i = 0; i + 1 < STATUS_COUNT; ++i) {
+        if ((page.status_bits[i][offset / 64] >> (offset % 64) & 1) != 0) {
+            return static_cast<DocumentStatus>(i);
+        }
+    }
+    return static_cast<DocumentStatus>(STATUS_COUNT - 1);
+}
+
+DocumentColumns::Page& DocumentColumns::GetPage(int document_id) {
+    const size_t page_index = static_cast<size_t>(document_id) >> PAGE_BITS;
+    if (page_index >= pages_.size()) {
+        pages_.resize(page_index + 1);
+    }
+    std::shared_ptr<const Page>& page = pages_[page_index];
+    if (!page) {
+        page = std::make_shared<Page>();
+    }
+    else if (page.use_count() > 1) {
+        page = std::make_shared<Page>(*page);
+    }
+    // Owned pages are created non-const, mapped ones are never changed
+    return const_cast<Page&>(*page);
+}
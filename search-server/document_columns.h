@@ -0,0 +1,125 @@
+#pragma once
+#include "array_view.h"
+#include "document.h"
+#include "index_segment.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Inclusive range of document ratings, a filter for FindTopDocuments that is checked
+// against the rating column without calling a predicate
+struct RatingRange {
+    int min_rating = 0;
+    int max_rating = 0;
+};
+
+// Attributes queries filter by, stored in columns indexed by document id: the segment where
+// the postings of a document are live, its rating and a bitmap per status. Ids are split into
+// pages of PAGE_SIZE allocated on first use, so a lookup is a few array reads and sparse ids
+// cost a page each. Copies share pages until one of them changes a page, and the pages of
+// a snapshot are read in place
+class DocumentColumns {
+    static constexpr int PAGE_BITS = 12;
+    static constexpr size_t PAGE_SIZE = size_t(1) << PAGE_BITS;
+    static constexpr size_t STATUS_COUNT = 4;
+
+public:
+    // Stored as is in snapshots
+    struct Page {
+        std::array<SegmentId, PAGE_SIZE> segment_ids{};  // 0 for missing documents
+        std::array<int, PAGE_SIZE> ratings{};
+        std::array<std::array<uint64_t, PAGE_SIZE / 64>, STATUS_COUNT> status_bits{};
+    };
+
+    // Page page_indexes[i] is pages[i], the arrays are not copied and storage keeps them alive.
+    // Throws invalid_argument if the indexes are not ascending
+    static DocumentColumns MakeView(ArrayView<uint64_t> page_indexes, ArrayView<Page> pages, std::shared_ptr<const void> storage);
+
+    // Calls callback(page_index, page) for every allocated page in ascending order
+    template <typename Callback>
+    void ForEachPage(Callback callback) const;
+
+    // Allocates the page of the document or copies a shared one, so that changing
+    // the document does not allocate. The columns stay the same
+    void Reserve(int document_id);
+
+    // segment_id must not be 0
+    void Add(int document_id, SegmentId segment_id, DocumentStatus status, int rating);
+
+    void Erase(int document_id);
+
+    void SetSegmentId(int document_id, SegmentId segment_id);
+
+    // 0 if there is no such document
+    SegmentId GetSegmentId(int document_id) const;
+
+    // The document exists and its postings in the segment are live
+    bool IsLive(int document_id, SegmentId segment_id) const;
+
+    bool HasStatus(int document_id, DocumentStatus status) const;
+
+    bool HasRating(int document_id, RatingRange range) const;
+
+    // The document must exist
+    DocumentStatus GetStatus(int document_id) const;
+
+    int GetRating(int document_id) const;
+
+private:
+    // A page is changed in place only if this is its single owner. Pages of a snapshot share
+    // the count of storage_, so they are always copied before a change
+    std::vector<std::shared_ptr<const Page>> pages_;
+    std::shared_ptr<const void> storage_;
+
+    const Page* FindPage(int document_id) const {
+        const size_t page = static_cast<size_t>(document_id) >> PAGE_BITS;
+        return page < pages_.size() ? pages_[page].get() : nullptr;
+    }
+
+    static size_t GetOffset(int document_id) {
+        return static_cast<size_t>(document_id) & (PAGE_SIZE - 1);
+    }
+
+    // Allocates the page or copies a shared one
+    Page& GetPage(int document_id);
+};
+
+template <typename Callback>
+void DocumentColumns::ForEachPage(Callback callback) const {
+    for (size_t page_index = 0; page_index < pages_.size(); ++page_index) {
+        if (pages_[page_index]) {
+            callback(page_index, *pages_[page_index]);
+        }
+    }
+}
+
+inline SegmentId DocumentColumns::GetSegmentId(int document_id) const {
+    const Page* page = FindPage(document_id);
+    return page ? page->segment_ids[GetOffset(document_id)] : 0;
+}
+
+inline bool DocumentColumns::IsLive(int document_id, SegmentId segment_id) const {
+    return GetSegmentId(document_id) == segment_id;
+}
+
+inline bool DocumentColumns::HasStatus(int document_id, DocumentStatus status) const {
+    const Page* page = FindPage(document_id);
+    const size_t offset = GetOffset(document_id);
+    return page && (page->status_bits[static_cast<size_t>(status)][offset / 64] >> (offset % 64) & 1) != 0;
+}
+
+inline bool DocumentColumns::HasRating(int document_id, RatingRange range) const {
+    const Page* page = FindPage(document_id);
+    if (!page) {
+        return false;
+    }
+    const int rating = page->ratings[GetOffset(document_id)];
+    return rating >= range.min_rating && rating <= range.max_rating;
+}
+
+inline int DocumentColumns::GetRating(int document_id) const {
+    return FindPage(document_id)->ratings[GetOffset(document_id)];
+}
@@ -0,0 +1,196 @@
+#include "duplicate_detector.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+using namespace std::string_literals;
+
+namespace {
+
+// Documents handled by one task of the pool
+constexpr size_t BLOCK_SIZE = 1024;
+
+uint64_t MixHash(uint64_t value) {
+    value ^= value >> 30;
+    value *= 0xBF58476D1CE4E5B9ull;
+    value ^= value >> 27;
+    value *= 0x94D049BB133111EBull;
+    return value ^ (value >> 31);
+}
+
+template <typename Function>
+void ForEachBlock(ThreadPool& thread_pool, size_t count, Function function) {
+    thread_pool.ParallelFor((count + BLOCK_SIZE - 1) / BLOCK_SIZE, [count, &function](size_t block) {
+        const size_t end = std::min(count, (block + 1) * BLOCK_SIZE);
+        for (size_t i = block * BLOCK_SIZE; i < end; ++i) {
+            function(i);
+        }
+        });
+}
+
+double ComputeJaccardSimilarity(ArrayView<TermId> lhs, ArrayView<TermId> rhs) {
+    if (lhs.empty() && rhs.empty()) {
+        return 1.0;
+    }
+    size_t common_count = 0;
+    for (const TermId *l = lhs.begin(), *r = rhs.begin(); l != lhs.end() && r != rhs.end();) {
+        if (*l < *r) {
+            ++l;
+        }
+        else if (*r < *l) {
+            ++r;
+        }
+        else {
+            ++common_count;
+            ++l;
+            ++r;
+        }
+    }
+    return static_cast<double>(common_count) / static_cast<double>(lhs.size() + rhs.size() - common_count);
+}
+
+} // namespace
+
+uint64_t ComputeTermSetFingerprint(ArrayView<TermId> terms) {
+    uint64_t fingerprint = MixHash(terms.size());
+    for (const TermId term : terms) {
+        fingerprint = MixHash(fingerprint ^ term);
+    }
+    return fingerprint;
+}
+
+std::vector<int> FindDuplicateDocuments(ThreadPool& thread_pool, const std::vector<DocumentTerms>& documents) {
+    // Sorting by fingerprint and then by index puts every group in id order
+    std::vector<std::pair<uint64_t, uint32_t>> fingerprints(documents.size());
+    ForEachBlock(thread_pool, documents.size(), [&documents, &fingerprints](size_t i) {
+        fingerprints[i] = { ComputeTermSetFingerprint(documents[i].terms), static_cast<uint32_t>(i) };
+        });
+    std::sort(fingerprints.begin(), fingerprints.end());
+
+    std::vector<int> duplicates;
+    std::vector<uint32_t> originals;
+    for (size_t begin = 0; begin < fingerprints.size();) {
+        size_t end = begin + 1;
+        while (end < fingerprints.size() && fingerprints[end].first == fingerprints[begin].first) {
+            ++end;
+        }
+        // Almost always one original per group, more only after a collision
+        originals.clear();
+        for (size_t i = begin; i < end; ++i) {
+            const DocumentTerms& document = documents[fingerprints[i].second];
+            const bool is_duplicate = std::any_of(originals.begin(), originals.end(), [&documents, &document](uint32_t original) {
+                const ArrayView<TermId> original_terms = documents[original].terms;
+                return std::equal(document.terms.begin(), document.terms.end(), original_terms.begin(), original_terms.end());
+                });
+            if (is_duplicate) {
+                duplicates.push_back(document.id);
+            }
+            else {
+                originals.push_back(fingerprints[i].second);
+            }
+        }
+        begin = end;
+    }
+    std::sort(duplicates.begin(), duplicates.end());
+    return duplicates;
+}
+
+std::vector<int> FindNearDuplicateDocuments(ThreadPool& thread_pool, const std::vector<DocumentTerms>& documents,
+    double min_similarity, const MinHashOptions& options) {
+    if (options.band_count == 0 || options.rows_per_band == 0) {
+        throw std::invalid_argument("MinHash needs at least one band and one row per band"s);
+    }
+    if (!(min_similarity > 0.0 && min_similarity <= 1.0)) {
+        throw std::invalid_argument("similarity threshold must be in (0, 1]"s);
+    }
+    const size_t document_count = documents.size();
+    const size_t signature_size = options.band_count * options.rows_per_band;
+
+    // Every hash function of the signature is the term hash mixed with its own seed
+    std::vector<uint64_t> seeds(signature_size);
+    std::mt19937_64 generator(options.seed);
+    for (uint64_t& seed : seeds) {
+        seed = generator();
+    }
+    std::vector<uint64_t> signatures(document_count * signature_size, std::numeric_limits<uint64_t>::max());
+    ForEachBlock(thread_pool, document_count, [&](size_t i) {
+        uint64_t* signature = signatures.data() + i * signature_size;
+        for (const TermId term : documents[i].terms) {
+            const uint64_t term_hash = MixHash(term);
+            for (size_t j = 0; j < signature_size; ++j) {
+                signature[j] = std::min(signature[j], MixHash(term_hash ^ seeds[j]));
+            }
+        }
+        });
+
+    // A document is a candidate with the first document of every band bucket it falls into:
+    // (document, earlier document). Pairs inside a bucket are not enumerated, so a large
+    // bucket costs as many candidates as it has documents
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> band_candidates(options.band_count);
+    thread_pool.ParallelFor(options.band_count, [&](size_t band) {
+        std::vector<std::pair<uint64_t, uint32_t>> band_keys(document_count);
+        for (size_t i = 0; i < document_count; ++i) {
+            const uint64_t* rows = signatures.data() + i * signature_size + band * options.rows_per_band;
+            uint64_t key = MixHash(band);
+            for (size_t row = 0; row < options.rows_per_band; ++row) {
+                key = MixHash(key ^ rows[row]);
+            }
+            band_keys[i] = { key, static_cast<uint32_t>(i) };
+        }
+        std::sort(band_keys.begin(), band_keys.end());
+        std::vector<std::pair<uint32_t, uint32_t>>& candidates = band_candidates[band];
+        for (size_t begin = 0; begin < document_count;) {
+            size_t end = begin + 1;
+            while (end < document_count && band_keys[end].first == band_keys[begin].first) {
+                ++end;
+            }
+            for (size_t i = begin + 1; i < end; ++i) {
+                candidates.emplace_back(band_keys[i].second, band_keys[begin].second);
+            }
+            begin = end;
+        }
+        });
+    std::vector<std::pair<uint32_t, uint32_t>> candidates;
+    for (std::vector<std::pair<uint32_t, uint32_t>>& band : band_candidates) {
+        candidates.insert(candidates.end(), band.begin(), band.end());
+        std::vector<std::pair<uint32_t, uint32_t>>().swap(band);
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+    std::vector<char> is_similar(candidates.size());
+    ForEachBlock(thread_pool, candidates.size(), [&](size_t i) {
+        const auto [document, earlier_document] = candidates[i];
+        is_similar[i] = ComputeJaccardSimilarity(documents[document].terms, documents[earlier_document].terms) >= min_similarity;
+        });
+
+    // Candidates go by the later document, so the earlier one is already kept or removed.
+    // A removed bucket head stands for the kept document it duplicates, which is compared then
+    std::vector<char> is_removed(document_count);
+    std::vector<uint32_t> kept_documents(document_count);
+    std::iota(kept_documents.begin(), kept_documents.end(), 0);
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        const auto [document, earlier_document] = candidates[i];
+        if (is_removed[document]) {
+            continue;
+        }
+        const uint32_t kept_document = kept_documents[earlier_document];
+        if (kept_document == earlier_document ? is_similar[i]
+            : ComputeJaccardSimilarity(documents[document].terms, documents[kept_document].terms) >= min_similarity) {
+            is_removed[document] = true;
+            kept_documents[document] = kept_document;
+        }
+    }
+    std::vector<int> duplicates;
+    for (size_t i = 0; i < document_count; ++i) {
+        if (is_removed[i]) {
+            duplicates.push_back(documents[i].id);
+        }
+    }
+    return duplicates;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "array_view.h"
+#include "term_dictionary.h"
+#include "thread_pool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A document as duplicate detection sees it: the set of its terms
+struct DocumentTerms {
+    int id = 0;
+    ArrayView<TermId> terms;  // sorted, unique
+};
+
+// Locality-sensitive hashing of MinHash signatures. Two documents with Jaccard similarity s
+// become candidates with probability 1 - (1 - s^rows_per_band)^band_count, so more rows make
+// the detector stricter and more bands find more pairs at the cost of more candidates
+struct MinHashOptions {
+    size_t band_count = 32;
+    size_t rows_per_band = 4;
+    uint64_t seed = 0;
+};
+
+// 64-bit hash of a sorted set of terms; equal sets have equal fingerprints
+uint64_t ComputeTermSetFingerprint(ArrayView<TermId> terms);
+
+// Documents are sorted by id. Returns ids of documents with the same terms as a document with
+// a smaller id, in ascending order. Groups are formed by fingerprints and checked term by term,
+// so a collision never removes a document
+std::vector<int> FindDuplicateDocuments(ThreadPool& thread_pool, const std::vector<DocumentTerms>& documents);
+
+// Documents are sorted by id. Returns ids of documents whose Jaccard similarity with a kept
+// document with a smaller id is at least min_similarity, in ascending order. A document is
+// compared only with the first document of each band bucket of MinHash signatures it shares
+// (or the kept document that one duplicates), and the similarity is computed exactly
+std::vector<int> FindNearDuplicateDocuments(ThreadPool& thread_pool, const std::vector<DocumentTerms>& documents,
+    double min_similarity, const MinHashOptions& options = {});
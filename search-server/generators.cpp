@@ -0,0 +1,74 @@
+#include "generators.h"
+
+#include <algorithm>
+#include <cmath>
+
+std::string GenerateWord(std::mt19937& generator, int max_length) {
+    const int length = std::uniform_int_distribution(1, max_length)(generator);
+    std::string word;
+    word.reserve(length);
+    for (int i = 0; i < length; ++i) {
+        word.push_back(std::uniform_int_distribution(int('a'), int('z'))(generator));
+    }
+    return word;
+}
+
+std::vector<std::string> GenerateDictionary(std::mt19937& generator, int word_count, int max_length) {
+    std::vector<std::string> words;
+    words.reserve(word_count);
+    for (int i = 0; i < word_count; ++i) {
+        words.push_back(GenerateWord(generator, max_length));
+    }
+    words.erase(std::unique(words.begin(), words.end()), words.end());
+    return words;
+}
+
+std::string GenerateQuery(std::mt19937& generator, const std::vector<std::string>& dictionary, int word_count, double minus_prob) {
+    std::string query;
+    for (int i = 0; i < word_count; ++i) {
+        if (!query.empty()) {
+            query.push_back(' ');
+        }
+        if (std::uniform_real_distribution<>(0, 1)(generator) < minus_prob) {
+            query.push_back('-');
+        }
+        query += dictionary[std::uniform_int_distribution<int>(0, dictionary.size() - 1)(generator)];
+    }
+    return query;
+}
+
+std::vector<std::string> GenerateQueries(std::mt19937& generator, const std::vector<std::string>& dictionary, int query_count, int max_word_count) {
+    std::vector<std::string> queries;
+    queries.reserve(query_count);
+    for (int i = 0; i < query_count; ++i) {
+        queries.push_back(GenerateQuery(generator, dictionary, max_word_count));
+    }
+    return queries;
+}
+
+std::string GenerateZipfQuery(std::mt19937& generator, const std::vector<double>& cumulative_weights,
+    const std::vector<std::string>& dictionary, int word_count, double minus_prob) {
+    std::string query;
+    for (int i = 0; i < word_count; ++i) {
+        if (!query.empty()) {
+            query.push_back(' ');
+        }
+        if (std::uniform_real_distribution<>(0, 1)(generator) < minus_prob) {
+            query.push_back('-');
+        }
+        const double point = std::uniform_real_distribution<>(0, cumulative_weights.back())(generator);
+        const size_t rank = std::upper_bound(cumulative_weights.begin(), cumulative_weights.end(), point) - cumulative_weights.begin();
+        query += dictionary[std::min(rank, dictionary.size() - 1)];
+    }
+    return query;
+}
+
+std::vector<double> ComputeZipfWeights(int word_count, double exponent) {
+    std::vector<double> weights(word_count);
+    double sum = 0;
+    for (int i = 0; i < word_count; ++i) {
+        sum += 1.0 / std::pow(i + 1, exponent);
+        weights[i] = sum;
+    }
+    return weights;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <random>
+#include <string>
+#include <vector>
+
+std::string GenerateWord(std::mt19937& generator, int max_length);
+
+std::vector<std::string> GenerateDictionary(std::mt19937& generator, int word_count, int max_length);
+
+std::string GenerateQuery(std::mt19937& generator, const std::vector<std::string>& dictionary, int word_count, double minus_prob = 0);
+
+std::vector<std::string> GenerateQueries(std::mt19937& generator, const std::vector<std::string>& dictionary, int query_count, int max_word_count);
+
+// Draws words with probability proportional to 1 / rank^exponent, where the first word
+// of the dictionary has rank 1, so a few words occur in most texts as in natural language
+std::string GenerateZipfQuery(std::mt19937& generator, const std::vector<double>& cumulative_weights,
+    const std::vector<std::string>& dictionary, int word_count, double minus_prob = 0);
+
+// Cumulative Zipf weights of word_count ranks for GenerateZipfQuery
+std::vector<double> ComputeZipfWeights(int word_count, double exponent);
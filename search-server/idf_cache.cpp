@@ -0,0 +1,12 @@
+#include "idf_cache.h"
+
+#include <algorithm>
+
+void IdfCache::Resize(size_t term_count) {
+    if (term_count <= capacity_) {
+        return;
+    }
+    // Cached values are dropped: the corpus generation changes with every update anyway
+    capacity_ = std::max(term_count, capacity_ * 2);
+    entries_ = std::make_unique<Entry[]>(capacity_);
+}
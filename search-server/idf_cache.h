@@ -0,0 +1,41 @@
+#pragma once
+#include "term_dictionary.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Inverse document frequencies per term, valid for one corpus generation.
+// Entries are filled lazily by queries; an entry written for an older generation
+// is recomputed on the next access. Get is safe to call from concurrent readers,
+// Resize must not run concurrently with Get
+class IdfCache {
+public:
+    void Resize(size_t term_count);
+
+    template <typename ComputeIdf>
+    double Get(TermId term, uint64_t generation, ComputeIdf compute_idf) const;
+
+private:
+    struct Entry {
+        std::atomic<uint64_t> generation = 0;
+        std::atomic<double> value = 0.0;
+    };
+
+    std::unique_ptr<Entry[]> entries_;
+    size_t capacity_ = 0;
+};
+
+template <typename ComputeIdf>
+double IdfCache::Get(TermId term, uint64_t generation, ComputeIdf compute_idf) const {
+    Entry& entry = entries_[term];
+    // The value is stored before the generation, so a matching generation guarantees the value
+    if (entry.generation.load(std::memory_order_acquire) == generation) {
+        return entry.value.load(std::memory_order_relaxed);
+    }
+    const double value = compute_idf();
+    entry.value.store(value, std::memory_order_relaxed);
+    entry.generation.store(generation, std::memory_order_release);
+    return value;
+}
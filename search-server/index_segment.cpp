@@ -0,0 +1,216 @@
+#include "index_segment.h"
+#include "vector_capacity.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+using namespace std::string_literals;
+
+IndexSegment::IndexSegment(SegmentId id)
+    : id_(id) {
+}
+
+SegmentId IndexSegment::GetId() const {
+    return id_;
+}
+
+void IndexSegment::AddDocument(int document_id) {
+    if (is_sealed_) {
+        throw std::logic_error("segment is sealed"s);
+    }
+    if (IsRemoved(document_id)) {
+        PurgeRemovedDocument(document_id);
+    }
+    document_ids_.push_back(document_id);
+}
+
+void IndexSegment::AddPosting(TermId term, int document_id, double term_freq) {
+    if (is_sealed_) {
+        throw std::logic_error("segment is sealed"s);
+    }
+    if (IsRemoved(document_id)) {
+        PurgeRemovedDocument(document_id);
+    }
+    building_postings_[term].Add(document_id, term_freq);
+}
+
+void IndexSegment::Reserve(size_t document_count, const std::vector<std::pair<TermId, size_t>>& posting_counts) {
+    if (is_sealed_) {
+        throw std::logic_error("segment is sealed"s);
+    }
+    GrowCapacity(document_ids_, document_ids_.size() + document_count);
+    building_postings_.reserve(building_postings_.size() + posting_counts.size());
+    for (const auto& [term, posting_count] : posting_counts) {
+        PostingList& postings = building_postings_[term];
+        postings.Reserve(postings.size() + posting_count);
+    }
+}
+
+void IndexSegment::RemoveDocument(int document_id) {
+    if (is_sealed_) {
+        throw std::logic_error("segment is sealed"s);
+    }
+    const auto it = std::lower_bound(removed_document_ids_.begin(), removed_document_ids_.end(), document_id);
+    if (it == removed_document_ids_.end() || *it != document_id) {
+        removed_document_ids_.insert(it, document_id);
+    }
+}
+
+void IndexSegment::ReserveRemovals(size_t document_count) {
+    GrowCapacity(removed_document_ids_, removed_document_ids_.size() + document_count);
+}
+
+bool IndexSegment::IsRemoved(int document_id) const {
+    return !removed_document_ids_.empty()
+        && std::binary_search(removed_document_ids_.begin(), removed_document_ids_.end(), document_id);
+}
+
+void IndexSegment::PurgeRemovedDocument(int document_id) {
+    // Rare: the terms of the document are unknown, so every posting list is checked.
+    // Lists are not erased, Reserve may have made room in them for the document
+    for (auto& [term, postings] : building_postings_) {
+        postings.Erase(document_id);
+    }
+    document_ids_.erase(std::remove(document_ids_.begin(), document_ids_.end(), document_id), document_ids_.end());
+    removed_document_ids_.erase(std::lower_bound(removed_document_ids_.begin(), removed_document_ids_.end(), document_id));
+}
+
+void IndexSegment::PurgeRemovedDocuments() {
+    if (is_sealed_) {
+        throw std::logic_error("segment is sealed"s);
+    }
+    if (removed_document_ids_.empty()) {
+        return;
+    }
+    const auto is_removed = [this](int document_id) {
+        return IsRemoved(document_id);
+    };
+    // Every list is rebuilt once, whatever the number of removed documents
+    for (auto it = building_postings_.begin(); it != building_postings_.end();) {
+        const ArrayView<int> document_ids = it->second.GetDocumentIds();
+        if (std::any_of(document_ids.begin(), document_ids.end(), is_removed)) {
+            const ArrayView<double> term_freqs = it->second.GetTermFreqs();
+            PostingList live_postings;
+            for (size_t i = 0; i < document_ids.size(); ++i) {
+                if (!is_removed(document_ids[i])) {
+                    live_postings.Add(document_ids[i], term_freqs[i]);
+                }
+            }
+            it->second = std::move(live_postings);
+        }
+        if (it->second.empty()) {
+            it = building_postings_.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    document_ids_.erase(std::remove_if(document_ids_.begin(), document_ids_.end(), is_removed), document_ids_.end());
+    removed_document_ids_.clear();
+}
+
+void IndexSegment::Seal() {
+    if (is_sealed_) {
+        return;
+    }
+    PurgeRemovedDocuments();
+    std::sort(document_ids_.begin(), document_ids_.end());
+    std::vector<std::pair<TermId, PostingList>> postings(
+        std::make_move_iterator(building_postings_.begin()), std::make_move_iterator(building_postings_.end()));
+    building_postings_.clear();
+    std::sort(postings.begin(), postings.end(), [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+    terms_.reserve(postings.size());
+    postings_.reserve(postings.size());
+    for (auto& [term, posting_list] : postings) {
+        if (!posting_list.empty()) {
+            terms_.push_back(term);
+            postings_.push_back(std::move(posting_list));
+        }
+    }
+    is_sealed_ = true;
+}
+
+const PostingList* IndexSegment::FindPostings(TermId term) const {
+    if (!is_sealed_) {
+        const auto it = building_postings_.find(term);
+        return it == building_postings_.end() || it->second.empty() ? nullptr : &it->second;
+    }
+    const auto it = std::lower_bound(terms_.begin(), terms_.end(), term);
+    if (it == terms_.end() || *it != term) {
+        return nullptr;
+    }
+    return &postings_[it - terms_.begin()];
+}
+
+const std::vector<int>& IndexSegment::GetDocumentIds() const {
+    return document_ids_;
+}
+
+const std::vector<TermId>& IndexSegment::GetTerms() const {
+    return terms_;
+}
+
+const std::vector<PostingList>& IndexSegment::GetPostings() const {
+    return postings_;
+}
+
+size_t IndexSegment::GetDocumentCount() const {
+    return document_ids_.size();
+}
+
+IndexSegment IndexSegment::Merge(SegmentId id, const std::vector<const IndexSegment*>& segments,
+    const std::vector<std::vector<int>>& live_document_ids) {
+    IndexSegment merged(id);
+    for (const std::vector<int>& document_ids : live_document_ids) {
+        merged.document_ids_.insert(merged.document_ids_.end(), document_ids.begin(), document_ids.end());
+    }
+    std::sort(merged.document_ids_.begin(), merged.document_ids_.end());
+
+    std::vector<TermId> terms;
+    for (const IndexSegment* segment : segments) {
+        terms.insert(terms.end(), segment->terms_.begin(), segment->terms_.end());
+    }
+    std::sort(terms.begin(), terms.end());
+    terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+
+    std::vector<std::pair<int, double>> term_postings;
+    for (const TermId term : terms) {
+        term_postings.clear();
+        for (size_t i = 0; i < segments.size(); ++i) {
+            const PostingList* postings = segments[i]->FindPostings(term);
+            if (!postings) {
+                continue;
+            }
+            const ArrayView<int> document_ids = postings->GetDocumentIds();
+            const ArrayView<double> term_freqs = postings->GetTermFreqs();
+            for (size_t j = 0; j < document_ids.size(); ++j) {
+                if (std::binary_search(live_document_ids[i].begin(), live_document_ids[i].end(), document_ids[j])) {
+                    term_postings.push_back({ document_ids[j], term_freqs[j] });
+                }
+            }
+        }
+        if (term_postings.empty()) {
+            continue;
+        }
+        std::sort(term_postings.begin(), term_postings.end());
+        PostingList& postings = merged.postings_.emplace_back();
+        for (const auto& [document_id, term_freq] : term_postings) {
+            postings.Add(document_id, term_freq);
+        }
+        merged.terms_.push_back(term);
+    }
+    merged.is_sealed_ = true;
+    return merged;
+}
+
+IndexSegment IndexSegment::MakeSealed(SegmentId id, std::vector<int> document_ids, std::vector<TermId> terms,
+    std::vector<PostingList> postings, std::shared_ptr<const void> storage) {
+    IndexSegment segment(id);
+    segment.document_ids_ = std::move(document_ids);
+    segment.terms_ = std::move(terms);
+    segment.postings_ = std::move(postings);
+    segment.storage_ = std::move(storage);
+    segment.is_sealed_ = true;
+    return segment;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include "posting_list.h"
+#include "term_dictionary.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using SegmentId = uint32_t;
+
+// A part of the inverted index. Documents are added to a segment while it is
+// in memory; after Seal the segment is read-only and can be shared between threads.
+// Removed documents are not erased from segments: a posting is live only if its
+// document still belongs to the segment, and merging segments drops dead postings
+class IndexSegment {
+public:
+    explicit IndexSegment(SegmentId id);
+
+    SegmentId GetId() const;
+
+    void AddDocument(int document_id);
+
+    void AddPosting(TermId term, int document_id, double term_freq);
+
+    // Makes room for document_count documents and, for every pair, for the number of postings
+    // of the term, so that AddDocument and AddPosting do not allocate. Terms must be unique.
+    // The segment finds the same postings as before
+    void Reserve(size_t document_count, const std::vector<std::pair<TermId, size_t>>& posting_counts);
+
+    // Marks a document of a segment that is not sealed yet as removed. Its postings stay until
+    // the segment is sealed or the document is added again, so removing does not touch them
+    void RemoveDocument(int document_id);
+
+    // Makes room for document_count calls of RemoveDocument that do not allocate
+    void ReserveRemovals(size_t document_count);
+
+    // Drops postings of removed documents, the segment stays in memory
+    void PurgeRemovedDocuments();
+
+    // Drops postings of removed documents and moves postings into arrays sorted by term,
+    // the segment is immutable afterwards
+    void Seal();
+
+    // Returns nullptr if the segment has no postings of the term
+    const PostingList* FindPostings(TermId term) const;
+
+    // Ids of all documents added to the segment, including removed ones
+    const std::vector<int>& GetDocumentIds() const;
+
+    // Terms of a sealed segment in increasing order and their postings
+    const std::vector<TermId>& GetTerms() const;
+
+    const std::vector<PostingList>& GetPostings() const;
+
+    size_t GetDocumentCount() const;
+
+    // Builds a sealed segment from sealed segments keeping only postings of
+    // live_document_ids[i] (sorted) from segments[i]
+    static IndexSegment Merge(SegmentId id, const std::vector<const IndexSegment*>& segments,
+        const std::vector<std::vector<int>>& live_document_ids);
+
+    // Builds a sealed segment from sorted terms and their postings. The postings may be views
+    // of memory that storage keeps alive, e.g. a mapped snapshot
+    static IndexSegment MakeSealed(SegmentId id, std::vector<int> document_ids, std::vector<TermId> terms,
+        std::vector<PostingList> postings, std::shared_ptr<const void> storage);
+
+private:
+    SegmentId id_;
+    bool is_sealed_ = false;
+    std::vector<int> document_ids_;
+
+    // Until the segment is sealed. Lists may be empty, e.g. after Reserve, such terms are not found
+    std::unordered_map<TermId, PostingList> building_postings_;
+    std::vector<int> removed_document_ids_;  // sorted
+
+    // After the segment is sealed
+    std::vector<TermId> terms_;
+    std::vector<PostingList> postings_;
+    std::shared_ptr<const void> storage_;
+
+    bool IsRemoved(int document_id) const;
+
+    // Erases the postings of a removed document before it is added again, emptied lists stay
+    void PurgeRemovedDocument(int document_id);
+};
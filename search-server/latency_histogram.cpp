@@ -0,0 +1,65 @@
+#include "latency_histogram.h"
+
+#include <algorithm>
+
+void LatencyHistogram::AddCountsTo(std::vector<uint64_t>& counts) const {
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+        counts[i] += counts_[i].load(std::memory_order_relaxed);
+    }
+}
+
+size_t LatencyHistogram::GetBucket(uint64_t value) {
+    if (value < 64) {
+        return static_cast<size_t>(value);
+    }
+    // The 6 highest bits of the value select the bucket within its power of two
+    const int shift = 63 - __builtin_clzll(value) - 5;
+    return 64 + static_cast<size_t>(shift - 1) * 32 + static_cast<size_t>((value >> shift) - 32);
+}
+
+uint64_t LatencyHistogram::GetBucketUpperBound(size_t bucket) {
+    if (bucket < 64) {
+        return bucket;
+    }
+    const int shift = static_cast<int>((bucket - 64) / 32) + 1;
+    const uint64_t high_bits = (bucket - 64) % 32 + 32;
+    // Wraps to the largest value for the last bucket
+    return ((high_bits + 1) << shift) - 1;
+}
+
+LatencyQuantiles LatencyHistogram::ComputeQuantiles(const std::vector<uint64_t>& counts) {
+    uint64_t total = 0;
+    for (const uint64_t count : counts) {
+        total += count;
+    }
+    LatencyQuantiles quantiles;
+    if (total == 0) {
+        return quantiles;
+    }
+    // The rank of a quantile is the number of values up to it, rounded up
+    const auto rank = [total](uint64_t per_mille) {
+        return std::max<uint64_t>(1, (total * per_mille + 999) / 1000);
+    };
+    const uint64_t p50_rank = rank(500);
+    const uint64_t p99_rank = rank(990);
+    const uint64_t p999_rank = rank(999);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        if (counts[i] == 0) {
+            continue;
+        }
+        const uint64_t bound = GetBucketUpperBound(i);
+        if (seen < p50_rank && seen + counts[i] >= p50_rank) {
+            quantiles.p50 = bound;
+        }
+        if (seen < p99_rank && seen + counts[i] >= p99_rank) {
+            quantiles.p99 = bound;
+        }
+        if (seen < p999_rank && seen + counts[i] >= p999_rank) {
+            quantiles.p999 = bound;
+        }
+        seen += counts[i];
+        quantiles.max = bound;
+    }
+    return quantiles;
+}
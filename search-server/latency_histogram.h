@@ -0,0 +1,39 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Percentiles of recorded durations in nanoseconds, each is the upper bound of its bucket
+struct LatencyQuantiles {
+    uint64_t p50 = 0;
+    uint64_t p99 = 0;
+    uint64_t p999 = 0;
+    uint64_t max = 0;
+};
+
+// Log-linear histogram of durations in the manner of HdrHistogram: values below 64 ns have
+// a bucket each, larger ones fall into 32 buckets per power of two, so a bucket bound is
+// within 1/32 of the values in it. Recording is a relaxed atomic increment
+class LatencyHistogram {
+public:
+    static constexpr size_t BUCKET_COUNT = 64 + 58 * 32;
+
+    void Record(uint64_t nanoseconds) {
+        counts_[GetBucket(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // counts must have BUCKET_COUNT elements
+    void AddCountsTo(std::vector<uint64_t>& counts) const;
+
+    static size_t GetBucket(uint64_t value);
+
+    // The largest value of the bucket
+    static uint64_t GetBucketUpperBound(size_t bucket);
+
+    static LatencyQuantiles ComputeQuantiles(const std::vector<uint64_t>& counts);
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> counts_{};
+};
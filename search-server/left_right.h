@@ -0,0 +1,156 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+// Left-right concurrency control over two copies of T. Readers pin the copy that
+// is published at the moment and never wait. A writer changes the other copy,
+// publishes it, waits until readers leave the old copy (a grace period tracked
+// with two epochs of read indicators) and repeats the change there, so every change
+// is applied twice and T takes twice the memory.
+// Updates must be serialized by the caller. A change that failed half way would leave
+// the copies different, so what may throw is done before either copy changes
+template <typename T>
+class LeftRight {
+public:
+    // Returns reader(const T&)
+    template <typename Reader>
+    decltype(auto) Read(Reader reader) const;
+
+    // Calls prepare(T& copy) for each copy while it is not read, then apply(T& copy, prepared)
+    // with what prepare returned for that copy. prepare may throw, then neither copy changes:
+    // it must not change what readers see, e.g. it reserves memory and builds what apply moves
+    // into the copy. apply must not throw, the program terminates if it does.
+    // Waits for readers twice, Update without prepare waits once
+    template <typename Prepare, typename Apply>
+    void Update(Prepare prepare, Apply apply);
+
+    // For changes that need no memory: calls apply(T& copy) for both copies, apply must not throw
+    template <typename Apply>
+    void Update(Apply apply);
+
+private:
+    // Counts readers in separate cache lines so that readers of different threads
+    // do not contend
+    class ReadIndicator {
+    public:
+        void Arrive();
+
+        void Depart();
+
+        bool IsEmpty() const;
+
+    private:
+        static constexpr size_t SHARD_COUNT = 16;
+
+        struct alignas(64) Shard {
+            std::atomic<int64_t> reader_count = 0;
+        };
+
+        std::array<Shard, SHARD_COUNT> shards_;
+
+        static size_t GetShardIndex();
+    };
+
+    std::array<T, 2> copies_;
+    std::atomic<size_t> read_copy_ = 0;
+    std::atomic<size_t> epoch_ = 0;
+    mutable std::array<ReadIndicator, 2> read_indicators_;
+
+    // Switches readers to the copy and waits until they leave the other one
+    void Publish(size_t copy);
+
+    void WaitForReaders(size_t epoch) const;
+};
+
+template <typename T>
+template <typename Reader>
+decltype(auto) LeftRight<T>::Read(Reader reader) const {
+    struct Pin {
+        ReadIndicator& indicator;
+
+        ~Pin() {
+            indicator.Depart();
+        }
+    };
+
+    ReadIndicator& indicator = read_indicators_[epoch_.load()];
+    indicator.Arrive();
+    const Pin pin{ indicator };
+    return reader(static_cast<const T&>(copies_[read_copy_.load()]));
+}
+
+template <typename T>
+template <typename Prepare, typename Apply>
+void LeftRight<T>::Update(Prepare prepare, Apply apply) {
+    const size_t read_copy = read_copy_.load();
+    auto other_prepared = prepare(copies_[1 - read_copy]);
+    // The copies are still equal, readers move to the prepared one so that the other can be prepared
+    Publish(1 - read_copy);
+    auto prepared = prepare(copies_[read_copy]);
+
+    const auto apply_to = [&apply](T& copy, decltype(prepared)& copy_prepared) noexcept {
+        apply(copy, copy_prepared);
+    };
+    apply_to(copies_[read_copy], prepared);
+    Publish(read_copy);
+    apply_to(copies_[1 - read_copy], other_prepared);
+}
+
+template <typename T>
+template <typename Apply>
+void LeftRight<T>::Update(Apply apply) {
+    const auto apply_to = [&apply](T& copy) noexcept {
+        apply(copy);
+    };
+    const size_t read_copy = read_copy_.load();
+    apply_to(copies_[1 - read_copy]);
+    Publish(1 - read_copy);
+    apply_to(copies_[read_copy]);
+}
+
+template <typename T>
+void LeftRight<T>::Publish(size_t copy) {
+    read_copy_.store(copy);
+    // Readers that arrived before the switch may still use the other copy
+    const size_t epoch = epoch_.load();
+    WaitForReaders(1 - epoch);
+    epoch_.store(1 - epoch);
+    WaitForReaders(epoch);
+}
+
+template <typename T>
+void LeftRight<T>::WaitForReaders(size_t epoch) const {
+    while (!read_indicators_[epoch].IsEmpty()) {
+        std::this_thread::yield();
+    }
+}
+
+template <typename T>
+void LeftRight<T>::ReadIndicator::Arrive() {
+    shards_[GetShardIndex()].reader_count.fetch_add(1);
+}
+
+template <typename T>
+void LeftRight<T>::ReadIndicator::Depart() {
+    shards_[GetShardIndex()].reader_count.fetch_sub(1);
+}
+
+template <typename T>
+bool LeftRight<T>::ReadIndicator::IsEmpty() const {
+    for (const Shard& shard : shards_) {
+        if (shard.reader_count.load() != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename T>
+size_t LeftRight<T>::ReadIndicator::GetShardIndex() {
+    return std::hash<std::thread::id>{}(std::this_thread::get_id()) % SHARD_COUNT;
+}
@@ -0,0 +1,273 @@
+#include "load_generator.h"
+#include "corpus_loader.h"
+#include "generators.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+using namespace std::string_literals;
+using namespace std::string_view_literals;
+
+namespace {
+
+struct ThreadLatencies {
+    LatencyHistogram query_service;
+    LatencyHistogram query_corrected;
+    LatencyHistogram write_service;
+    LatencyHistogram write_corrected;
+    uint64_t query_count = 0;
+    uint64_t query_error_count = 0;
+    uint64_t write_count = 0;
+    uint64_t write_error_count = 0;
+};
+
+LatencyQuantiles MergeQuantiles(const std::vector<std::unique_ptr<ThreadLatencies>>& threads, LatencyHistogram ThreadLatencies::* histogram) {
+    std::vector<uint64_t> counts(LatencyHistogram::BUCKET_COUNT, 0);
+    for (const auto& thread : threads) {
+        ((*thread).*histogram).AddCountsTo(counts);
+    }
+    return LatencyHistogram::ComputeQuantiles(counts);
+}
+
+void PrintOperationReport(std::ostream& out, std::string_view name, const OperationReport& report, double seconds) {
+    const auto print_quantiles = [&out](const LatencyQuantiles& quantiles) {
+        out << "p50 "sv << quantiles.p50 / 1e3 << " us, p99 "sv << quantiles.p99 / 1e3 << " us, p99.9 "sv
+            << quantiles.p999 / 1e3 << " us, max "sv << quantiles.max / 1e3 << " us"sv;
+    };
+    out << "  "sv << name << ": "sv << report.count << " ("sv << (seconds > 0 ? report.count / seconds : 0.0) << " per second), "sv
+        << report.error_count << " failed\n"sv;
+    out << "    service   "sv;
+    print_quantiles(report.service_latency);
+    out << "\n    corrected "sv;
+    print_quantiles(report.corrected_latency);
+    out << '\n';
+}
+
+std::vector<std::string> ReadLines(const std::string& path) {
+    std::ifstream input(path);
+    if (!input) {
+        throw std::invalid_argument("Cannot open "s + path);
+    }
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(input, line)) {
+        if (!line.empty()) {
+            lines.push_back(std::move(line));
+        }
+    }
+    return lines;
+}
+
+}  // namespace
+
+LoadReport RunLoad(SearchServer& search_server, const std::vector<std::string>& queries,
+    const std::vector<std::string>& texts, std::vector<int> removable_ids, const LoadOptions& options) {
+    using Clock = std::chrono::steady_clock;
+
+    const size_t thread_count = std::max<size_t>(options.thread_count, 1);
+    std::atomic<int> next_id = removable_ids.empty() ? 0 : *std::max_element(removable_ids.begin(), removable_ids.end()) + 1;
+    std::atomic<size_t> next_removed = 0;
+    std::atomic<uint64_t> next_write = 0;
+    // Every thread is scheduled at its share of the rate, shifted to spread the threads
+    const Clock::duration interval = options.target_rate > 0
+        ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(thread_count / options.target_rate))
+        : Clock::duration::zero();
+    const Clock::time_point start_time = Clock::now();
+    const Clock::time_point end_time = start_time + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.duration_seconds));
+
+    std::vector<std::unique_ptr<ThreadLatencies>> latencies;
+    for (size_t i = 0; i < thread_count; ++i) {
+        latencies.push_back(std::make_unique<ThreadLatencies>());
+    }
+    const auto run_thread = [&](size_t thread_index) {
+        ThreadLatencies& thread_latencies = *latencies[thread_index];
+        std::mt19937 generator(options.seed + static_cast<unsigned>(thread_index));
+        std::uniform_real_distribution<> choice(0, 1);
+        size_t query_index = thread_index;
+        Clock::time_point intended_time = start_time + interval * thread_index / thread_count;
+        while (true) {
+            if (interval > Clock::duration::zero()) {
+                if (intended_time >= end_time) {
+                    break;
+                }
+                std::this_thread::sleep_until(intended_time);
+            }
+            else {
+                intended_time = Clock::now();
+                if (intended_time >= end_time) {
+                    break;
+                }
+            }
+
+            const bool is_write = choice(generator) < options.write_fraction;
+            bool failed = false;
+            const Clock::time_point operation_start = Clock::now();
+            try {
+                if (!is_write) {
+                    search_server.FindTopDocuments(queries[query_index % queries.size()]);
+                    query_index += thread_count;
+                }
+                else if (next_write++ % 2 == 0 || texts.empty()) {
+                    const size_t removed = next_removed++;
+                    if (removed < removable_ids.size()) {
+                        search_server.RemoveDocument(removable_ids[removed]);
+                    }
+                }
+                else {
+                    const int id = next_id++;
+                    search_server.AddDocument(id, texts[static_cast<size_t>(id) % texts.size()], DocumentStatus::ACTUAL, { 1 });
+                }
+            }
+            catch (const std::exception&) {
+                failed = true;
+            }
+            const Clock::time_point operation_end = Clock::now();
+
+            const auto service_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(operation_end - operation_start).count());
+            const auto corrected_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(operation_end - intended_time).count());
+            if (is_write) {
+                thread_latencies.write_service.Record(service_ns);
+                thread_latencies.write_corrected.Record(corrected_ns);
+                ++thread_latencies.write_count;
+                thread_latencies.write_error_count += failed ? 1 : 0;
+            }
+            else {
+                thread_latencies.query_service.Record(service_ns);
+                thread_latencies.query_corrected.Record(corrected_ns);
+                ++thread_latencies.query_count;
+                thread_latencies.query_error_count += failed ? 1 : 0;
+            }
+            intended_time += interval;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < thread_count; ++i) {
+        threads.emplace_back(run_thread, i);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    LoadReport report;
+    report.seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+    for (const auto& thread_latencies : latencies) {
+        report.queries.count += thread_latencies->query_count;
+        report.queries.error_count += thread_latencies->query_error_count;
+        report.writes.count += thread_latencies->write_count;
+        report.writes.error_count += thread_latencies->write_error_count;
+    }
+    report.queries.service_latency = MergeQuantiles(latencies, &ThreadLatencies::query_service);
+    report.queries.corrected_latency = MergeQuantiles(latencies, &ThreadLatencies::query_corrected);
+    report.writes.service_latency = MergeQuantiles(latencies, &ThreadLatencies::write_service);
+    report.writes.corrected_latency = MergeQuantiles(latencies, &ThreadLatencies::write_corrected);
+    return report;
+}
+
+void PrintLoadReport(std::ostream& out, const LoadReport& report) {
+    out << "Load of "sv << report.seconds << " s: "sv
+        << (report.seconds > 0 ? (report.queries.count + report.writes.count) / report.seconds : 0.0) << " operations per second\n"sv;
+    PrintOperationReport(out, "queries"sv, report.queries, report.seconds);
+    if (report.writes.count > 0) {
+        PrintOperationReport(out, "writes"sv, report.writes, report.seconds);
+    }
+    out.flush();
+}
+
+int RunLoadCommand(const std::vector<std::string_view>& args) {
+    std::string corpus_path;
+    std::string stop_words;
+    std::string query_log_path;
+    int document_count = 20'000;
+    LoadOptions options;
+    try {
+        for (size_t i = 0; i < args.size(); ++i) {
+            if (i + 1 == args.size()) {
+                throw std::invalid_argument("No value of "s + std::string(args[i]));
+            }
+            const std::string_view option = args[i];
+            const std::string value(args[++i]);
+            if (option == "--corpus"sv) {
+                corpus_path = value;
+            }
+            else if (option == "--stop-words"sv) {
+                stop_words = value;
+            }
+            else if (option == "--queries"sv) {
+                query_log_path = value;
+            }
+            else if (option == "--documents"sv) {
+                document_count = std::stoi(value);
+            }
+            else if (option == "--threads"sv) {
+                options.thread_count = static_cast<size_t>(std::stoul(value));
+            }
+            else if (option == "--rate"sv) {
+                options.target_rate = std::stod(value);
+            }
+            else if (option == "--duration"sv) {
+                options.duration_seconds = std::stod(value);
+            }
+            else if (option == "--write-fraction"sv) {
+                options.write_fraction = std::stod(value);
+            }
+            else if (option == "--seed"sv) {
+                options.seed = static_cast<unsigned>(std::stoul(value));
+            }
+            else {
+                throw std::invalid_argument("Unknown option "s + std::string(option));
+            }
+        }
+    }
+    catch (const std::logic_error& error) {
+        std::cerr << error.what() << std::endl;
+        return 2;
+    }
+
+    // The generator settings of the main.cpp examples; added documents always get synthetic texts
+    std::mt19937 generator(options.seed);
+    const std::vector<std::string> dictionary = GenerateDictionary(generator, 1'000, 10);
+    const std::vector<std::string> texts = GenerateQueries(generator, dictionary, std::max(document_count, 1), 70);
+    try {
+        SearchServer search_server(corpus_path.empty() ? dictionary[0] : stop_words);
+        if (corpus_path.empty()) {
+            std::vector<DocumentToAdd> documents;
+            for (int id = 0; id < document_count; ++id) {
+                documents.push_back({ id, texts[id], DocumentStatus::ACTUAL, { 1 } });
+            }
+            search_server.AddDocuments(std::execution::par, documents);
+        }
+        else {
+            LoadCorpus(search_server, corpus_path);
+        }
+        std::vector<std::string> queries;
+        if (query_log_path.empty()) {
+            for (int i = 0; i < 10'000; ++i) {
+                queries.push_back(GenerateQuery(generator, dictionary, 7, 0.1));
+            }
+        }
+        else {
+            queries = ReadLines(query_log_path);
+        }
+        if (queries.empty()) {
+            throw std::invalid_argument("No queries"s);
+        }
+        std::vector<int> removable_ids(search_server.begin(), search_server.end());
+        std::shuffle(removable_ids.begin(), removable_ids.end(), generator);
+
+        std::cout << "Corpus of "sv << search_server.GetDocumentCount() << " documents, "sv << queries.size() << " queries, "sv
+            << options.thread_count << " threads"sv << std::endl;
+        PrintLoadReport(std::cout, RunLoad(search_server, queries, texts, std::move(removable_ids), options));
+    }
+    catch (const std::exception& error) {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
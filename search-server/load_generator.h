@@ -0,0 +1,53 @@
+#pragma once
+#include "search_server.h"
+#include "latency_histogram.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct LoadOptions {
+    size_t thread_count = 4;
+    // Operations per second of all threads; 0 runs a closed loop that starts
+    // the next operation of a thread as soon as the previous one returns
+    double target_rate = 0;
+    double duration_seconds = 10;
+    // Fraction of operations that change the index, half add documents and half remove them
+    double write_fraction = 0;
+    unsigned seed = 1;
+};
+
+struct OperationReport {
+    uint64_t count = 0;
+    uint64_t error_count = 0;
+    // From the start of an operation to its end
+    LatencyQuantiles service_latency;
+    // From the moment the schedule meant to start an operation to its end, so a stall also
+    // counts for the operations it delayed (coordinated omission). Equal to the service
+    // latency in a closed loop
+    LatencyQuantiles corrected_latency;
+};
+
+struct LoadReport {
+    double seconds = 0;
+    OperationReport queries;
+    OperationReport writes;
+};
+
+// Runs FindTopDocuments with the queries in turn from options.thread_count threads. Writes add
+// documents with the texts under new ids and remove documents of removable_ids in order
+LoadReport RunLoad(SearchServer& search_server, const std::vector<std::string>& queries,
+    const std::vector<std::string>& texts, std::vector<int> removable_ids, const LoadOptions& options);
+
+void PrintLoadReport(std::ostream& out, const LoadReport& report);
+
+// Loads a corpus, replays queries and prints the report, returns the exit code:
+//   --corpus FILE         documents in the format of LoadCorpus, synthetic when not given
+//   --stop-words TEXT     stop words of the corpus file
+//   --queries FILE        a query per line, synthetic when not given
+//   --documents N         size of the synthetic corpus, 20000 by default
+//   --threads N, --rate X, --duration S, --write-fraction F, --seed N   see LoadOptions
+int RunLoadCommand(const std::vector<std::string_view>& args);
@@ -4,72 +4,45 @@
 #include "test_example_functions.h"
 //#include "remove_duplicates.h"
 #include "process_queries.h"
-#include "log_duration.h"
+#include "benchmark.h"
+#include "benchmark_suite.h"
+#include "load_generator.h"
 
 #include <iostream>
 #include <execution>
-#include <random>
+#include <string_view>
 
 using namespace std;
 
-string GenerateWord(mt19937& generator, int max_length) {
-    const int length = uniform_int_distribution(1, max_length)(generator);
-    string word;
-    word.reserve(length);
-    for (int i = 0; i < length; ++i) {
-        word.push_back(uniform_int_distribution(int('a'), int('z'))(generator));
+int main(int argc, char* argv[]) {
+    if (argc > 1 && argv[1] == "--suite"sv) {
+        return RunBenchmarkSuiteCommand(vector<string_view>(argv + 2, argv + argc));
     }
-    return word;
-}
-
-vector<string> GenerateDictionary(mt19937& generator, int word_count, int max_length) {
-    vector<string> words;
-    words.reserve(word_count);
-    for (int i = 0; i < word_count; ++i) {
-        words.push_back(GenerateWord(generator, max_length));
-    }
-    words.erase(unique(words.begin(), words.end()), words.end());
-    return words;
-}
-
-string GenerateQuery(mt19937& generator, const vector<string>& dictionary, int word_count, double minus_prob = 0) {
-    string query;
-    for (int i = 0; i < word_count; ++i) {
-        if (!query.empty()) {
-            query.push_back(' ');
-        }
-        if (uniform_real_distribution<>(0, 1)(generator) < minus_prob) {
-            query.push_back('-');
-        }
-        query += dictionary[uniform_int_distribution<int>(0, dictionary.size() - 1)(generator)];
+    if (argc > 1 && argv[1] == "--load"sv) {
+        return RunLoadCommand(vector<string_view>(argv + 2, argv + argc));
     }
-    return query;
-}
-
-vector<string> GenerateQueries(mt19937& generator, const vector<string>& dictionary, int query_count, int max_word_count) {
-    vector<string> queries;
-    queries.reserve(query_count);
-    for (int i = 0; i < query_count; ++i) {
-        queries.push_back(GenerateQuery(generator, dictionary, max_word_count));
+    if (argc > 1 && argv[1] == "--test"sv) {
+        TestSearchServer();
+        cout << "All tests passed"s << endl;
+        return 0;
     }
-    return queries;
-}
-
-template <typename ExecutionPolicy>
-void Test(string_view mark, const SearchServer& search_server, const vector<string>& queries, ExecutionPolicy&& policy) {
-    LOG_DURATION(mark);
-    double total_relevance = 0;
-    for (const string_view query : queries) {
-        for (const auto& document : search_server.FindTopDocuments(policy, query)) {
-            total_relevance += document.relevance;
-        }
+    if (argc > 1 && argv[1] == "--bench"sv) {
+        BenchmarkPostingLists();
+        BenchmarkQueryPruning();
+        BenchmarkQueryCache();
+        BenchmarkSnapshot();
+        BenchmarkCorpusLoader();
+        BenchmarkTokenizer();
+        BenchmarkDuplicates();
+        BenchmarkRemoval();
+        BenchmarkDocumentFilters();
+        BenchmarkPagination();
+        BenchmarkRequestQueue();
+        BenchmarkMetrics();
+        BenchmarkMinusWords();
+        return 0;
     }
-    cout << total_relevance << endl;
-}
-
-#define TEST(policy) Test(#policy, search_server, queries, execution::policy)
 
-int main() {
     SearchServer search_server("and with"s);
 
     int id = 0;
@@ -104,19 +77,3 @@ int main() {
 
     return 0;
 }
-//
-//int main() {
-//    mt19937 generator;
-//
-//    const auto dictionary = GenerateDictionary(generator, 1000, 10);
-//    const auto documents = GenerateQueries(generator, dictionary, 10'000, 70);
-//
-//    SearchServer search_server(dictionary[0]);
-//    for (size_t i = 0; i < documents.size(); ++i) {
-//        search_server.AddDocument(i, documents[i], DocumentStatus::ACTUAL, { 1, 2, 3 });
-//    }
-//    const auto queries = GenerateQueries(generator, dictionary, 100, 70);
-//
-//    TEST(seq);
-//    TEST(par);
-//}
\ No newline at end of file
@@ -0,0 +1,214 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+using namespace std::string_view_literals;
+
+namespace {
+
+constexpr std::array<std::string_view, METRIC_PHASE_COUNT> PHASE_NAMES = {
+    "query.parse"sv, "query.plan"sv, "query.scan"sv, "query.merge"sv, "query.collect"sv, "query.top_k"sv,
+    "ingest.tokenize"sv, "ingest.index"sv, "ingest.log"sv, "ingest.sync"sv,
+};
+
+constexpr std::array<std::string_view, METRIC_COUNTER_COUNT> COUNTER_NAMES = {
+    "query.postings_scanned"sv, "query.documents_matched"sv, "ingest.documents"sv,
+};
+
+// Written by the owning thread only, read by snapshots
+struct ThreadMetrics {
+    std::array<std::atomic<uint64_t>, METRIC_PHASE_COUNT> phase_counts{};
+    std::array<std::atomic<uint64_t>, METRIC_PHASE_COUNT> phase_totals{};
+    std::array<std::atomic<uint64_t>, METRIC_PHASE_COUNT> phase_maxes{};
+    std::array<std::atomic<uint64_t>, METRIC_COUNTER_COUNT> counters{};
+
+    void AddTo(MetricsSnapshot& snapshot) const {
+        for (size_t i = 0; i < METRIC_PHASE_COUNT; ++i) {
+            PhaseStats& stats = snapshot.phases[i];
+            stats.count += phase_counts[i].load(std::memory_order_relaxed);
+            stats.total_ns += phase_totals[i].load(std::memory_order_relaxed);
+            stats.max_ns = std::max(stats.max_ns, phase_maxes[i].load(std::memory_order_relaxed));
+        }
+        for (size_t i = 0; i < METRIC_COUNTER_COUNT; ++i) {
+            snapshot.counters[i] += counters[i].load(std::memory_order_relaxed);
+        }
+    }
+};
+
+void Increase(std::atomic<uint64_t>& value, uint64_t delta) {
+    value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+class MetricsRegistry {
+public:
+    void Register(const ThreadMetrics* metrics) {
+        std::lock_guard guard(mutex_);
+        threads_.push_back(metrics);
+    }
+
+    void Unregister(const ThreadMetrics* metrics) {
+        std::lock_guard guard(mutex_);
+        metrics->AddTo(exited_);
+        threads_.erase(std::find(threads_.begin(), threads_.end(), metrics));
+    }
+
+    MetricsSnapshot GetSnapshot() const {
+        std::lock_guard guard(mutex_);
+        MetricsSnapshot snapshot = exited_;
+        for (const ThreadMetrics* metrics : threads_) {
+            metrics->AddTo(snapshot);
+        }
+        return snapshot;
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<const ThreadMetrics*> threads_;
+    MetricsSnapshot exited_;
+};
+
+MetricsRegistry& GetRegistry() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+// The registry is created before the first thread metrics, so it outlives all of them
+class ThreadMetricsHolder {
+public:
+    ThreadMetricsHolder()
+        : registry_(GetRegistry()) {
+        registry_.Register(&metrics_);
+    }
+
+    ~ThreadMetricsHolder() {
+        registry_.Unregister(&metrics_);
+    }
+
+    ThreadMetrics& Get() {
+        return metrics_;
+    }
+
+private:
+    MetricsRegistry& registry_;
+    ThreadMetrics metrics_;
+};
+
+ThreadMetrics& GetThreadMetrics() {
+    thread_local ThreadMetricsHolder holder;
+    return holder.Get();
+}
+
+// "query.parse" is split into "query" and "parse"
+std::pair<std::string_view, std::string_view> SplitName(std::string_view name) {
+    const size_t dot = name.find('.');
+    return { name.substr(0, dot), name.substr(dot + 1) };
+}
+
+// Calls print_phase(name, stats) and print_counter(name, value) for every metric of every group,
+// after print_group(group) for the group
+template <typename GroupPrinter, typename PhasePrinter, typename CounterPrinter>
+void ForEachGroup(const MetricsSnapshot& snapshot, GroupPrinter print_group, PhasePrinter print_phase, CounterPrinter print_counter) {
+    std::vector<std::string_view> groups;
+    for (const std::string_view name : PHASE_NAMES) {
+        if (std::find(groups.begin(), groups.end(), SplitName(name).first) == groups.end()) {
+            groups.push_back(SplitName(name).first);
+        }
+    }
+    for (const std::string_view group : groups) {
+        print_group(group);
+        for (size_t i = 0; i < METRIC_PHASE_COUNT; ++i) {
+            const auto [phase_group, name] = SplitName(PHASE_NAMES[i]);
+            if (phase_group == group) {
+                print_phase(name, snapshot.phases[i]);
+            }
+        }
+        for (size_t i = 0; i < METRIC_COUNTER_COUNT; ++i) {
+            const auto [counter_group, name] = SplitName(COUNTER_NAMES[i]);
+            if (counter_group == group) {
+                print_counter(name, snapshot.counters[i]);
+            }
+        }
+    }
+}
+
+}  // namespace
+
+std::string_view GetMetricName(MetricPhase phase) {
+    return PHASE_NAMES[static_cast<size_t>(phase)];
+}
+
+std::string_view GetMetricName(MetricCounter counter) {
+    return COUNTER_NAMES[static_cast<size_t>(counter)];
+}
+
+MetricsSnapshot MetricsSnapshot::Since(const MetricsSnapshot& earlier) const {
+    MetricsSnapshot result = *this;
+    for (size_t i = 0; i < METRIC_PHASE_COUNT; ++i) {
+        result.phases[i].count -= earlier.phases[i].count;
+        result.phases[i].total_ns -= earlier.phases[i].total_ns;
+    }
+    for (size_t i = 0; i < METRIC_COUNTER_COUNT; ++i) {
+        result.counters[i] -= earlier.counters[i];
+    }
+    return result;
+}
+
+void MetricsSnapshot::PrintText(std::ostream& out) const {
+    ForEachGroup(*this,
+        [&out](std::string_view group) {
+            out << group << '\n';
+        },
+        [&out](std::string_view name, const PhaseStats& stats) {
+            out << "  "sv << name << ": "sv << stats.count << " times, total "sv << stats.total_ns / 1e6 << " ms, mean "sv
+                << (stats.count > 0 ? stats.total_ns / 1e3 / stats.count : 0.0) << " us, max "sv << stats.max_ns / 1e3 << " us\n"sv;
+        },
+        [&out](std::string_view name, uint64_t value) {
+            out << "  "sv << name << ": "sv << value << '\n';
+        });
+    out.flush();
+}
+
+void MetricsSnapshot::PrintJson(std::ostream& out) const {
+    // Names are identifiers, they need no escaping
+    bool is_first_group = true;
+    bool is_first_metric = true;
+    out << '{';
+    ForEachGroup(*this,
+        [&](std::string_view group) {
+            out << (is_first_group ? ""sv : "}, "sv) << '"' << group << "\": {"sv;
+            is_first_group = false;
+            is_first_metric = true;
+        },
+        [&](std::string_view name, const PhaseStats& stats) {
+            out << (is_first_metric ? ""sv : ", "sv) << '"' << name << "\": {\"count\": "sv << stats.count
+                << ", \"total_ns\": "sv << stats.total_ns << ", \"max_ns\": "sv << stats.max_ns << '}';
+            is_first_metric = false;
+        },
+        [&](std::string_view name, uint64_t value) {
+            out << (is_first_metric ? ""sv : ", "sv) << '"' << name << "\": "sv << value;
+            is_first_metric = false;
+        });
+    out << (is_first_group ? "}"sv : "}}"sv) << std::endl;
+}
+
+void RecordMetricPhase(MetricPhase phase, uint64_t nanoseconds) {
+    ThreadMetrics& metrics = GetThreadMetrics();
+    const size_t i = static_cast<size_t>(phase);
+    Increase(metrics.phase_counts[i], 1);
+    Increase(metrics.phase_totals[i], nanoseconds);
+    if (nanoseconds > metrics.phase_maxes[i].load(std::memory_order_relaxed)) {
+        metrics.phase_maxes[i].store(nanoseconds, std::memory_order_relaxed);
+    }
+}
+
+void AddMetricCounter(MetricCounter counter, uint64_t value) {
+    Increase(GetThreadMetrics().counters[static_cast<size_t>(counter)], value);
+}
+
+MetricsSnapshot GetMetricsSnapshot() {
+    return GetRegistry().GetSnapshot();
+}
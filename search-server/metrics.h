@@ -0,0 +1,105 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <string_view>
+
+// Timed phases of queries and ingestion. Names are hierarchical: "query.parse" is
+// the parse phase of queries, see GetMetricName
+enum class MetricPhase {
+    QUERY_PARSE,
+    QUERY_PLAN,  // known words and the minus word exclusion
+    QUERY_SCAN,
+    QUERY_MERGE,  // accumulators of parallel scan tasks
+    QUERY_COLLECT,  // documents of the accumulator
+    QUERY_TOP_K,
+    INGEST_TOKENIZE,
+    INGEST_INDEX,
+    INGEST_LOG,  // appending any change to the write-ahead log
+    INGEST_SYNC,  // waiting for the log to reach the disk
+};
+
+enum class MetricCounter {
+    QUERY_POSTINGS_SCANNED,
+    QUERY_DOCUMENTS_MATCHED,
+    INGEST_DOCUMENTS,
+};
+
+constexpr size_t METRIC_PHASE_COUNT = 10;
+constexpr size_t METRIC_COUNTER_COUNT = 3;
+
+std::string_view GetMetricName(MetricPhase phase);
+
+std::string_view GetMetricName(MetricCounter counter);
+
+struct PhaseStats {
+    uint64_t count = 0;
+    uint64_t total_ns = 0;
+    uint64_t max_ns = 0;
+};
+
+// Metrics of all threads summed at one moment
+struct MetricsSnapshot {
+    std::array<PhaseStats, METRIC_PHASE_COUNT> phases{};
+    std::array<uint64_t, METRIC_COUNTER_COUNT> counters{};
+
+    // What was recorded after the earlier snapshot; maxima are kept since the start
+    MetricsSnapshot Since(const MetricsSnapshot& earlier) const;
+
+    // An indented line per phase and counter, grouped by the first part of the name
+    void PrintText(std::ostream& out = std::cout) const;
+
+    // An object per group: {"query": {"parse": {"count": 1, "total_ns": 2, "max_ns": 2}, ...}, ...}
+    void PrintJson(std::ostream& out = std::cout) const;
+};
+
+// Metrics are kept per thread and written by their thread only, so recording is a plain
+// load and store of a thread-local atomic. Metrics of exited threads are kept as well
+void RecordMetricPhase(MetricPhase phase, uint64_t nanoseconds);
+
+void AddMetricCounter(MetricCounter counter, uint64_t value);
+
+MetricsSnapshot GetMetricsSnapshot();
+
+// Records the time from construction to destruction as a phase
+class PhaseTimer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit PhaseTimer(MetricPhase phase)
+        : phase_(phase) {
+    }
+
+    ~PhaseTimer() {
+        RecordMetricPhase(phase_, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_time_).count()));
+    }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+private:
+    const MetricPhase phase_;
+    const Clock::time_point start_time_ = Clock::now();
+};
+
+#define METRICS_CONCAT_INTERNAL(X, Y) X##Y
+#define METRICS_CONCAT(X, Y) METRICS_CONCAT_INTERNAL(X, Y)
+
+// METRICS_PHASE times the rest of the scope, METRICS_PHASE_BEGIN(timer, PHASE) times the code
+// up to METRICS_PHASE_END(timer). With SEARCH_SERVER_NO_METRICS the macros expand to nothing
+// and their arguments are not evaluated
+#ifndef SEARCH_SERVER_NO_METRICS
+#define METRICS_PHASE(phase) PhaseTimer METRICS_CONCAT(metricsPhase, __LINE__)(MetricPhase::phase)
+#define METRICS_PHASE_BEGIN(timer, phase) std::optional<PhaseTimer> timer(std::in_place, MetricPhase::phase)
+#define METRICS_PHASE_END(timer) timer.reset()
+#define METRICS_COUNT(counter, value) AddMetricCounter(MetricCounter::counter, static_cast<uint64_t>(value))
+#else
+#define METRICS_PHASE(phase) static_cast<void>(0)
+#define METRICS_PHASE_BEGIN(timer, phase) static_cast<void>(0)
+#define METRICS_PHASE_END(timer) static_cast<void>(0)
+#define METRICS_COUNT(counter, value) static_cast<void>(0)
+#endif
@@ -0,0 +1,100 @@
+#include "posting_list.h"
+#include "vector_capacity.h"
+
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+using namespace std::string_literals;
+
+PostingList PostingList::MakeView(ArrayView<int> document_ids, ArrayView<double> term_freqs, double max_term_freq) {
+    PostingList postings;
+    postings.is_view_ = true;
+    postings.view_document_ids_ = document_ids;
+    postings.view_term_freqs_ = term_freqs;
+    postings.max_term_freq_ = max_term_freq;
+    return postings;
+}
+
+void PostingList::Add(int document_id, double term_freq) {
+    if (is_view_) {
+        throw std::logic_error("posting list is read-only"s);
+    }
+    // Documents are usually indexed in increasing id order, so check the tail first
+    if (document_ids_.empty() || document_ids_.back() < document_id) {
+        document_ids_.push_back(document_id);
+        term_freqs_.push_back(term_freq);
+        max_term_freq_ = std::max(max_term_freq_, term_freq);
+        return;
+    }
+    const size_t pos = LowerBound(document_id);
+    if (document_ids_[pos] == document_id) {
+        term_freqs_[pos] += term_freq;
+        max_term_freq_ = std::max(max_term_freq_, term_freqs_[pos]);
+        return;
+    }
+    document_ids_.insert(std::next(document_ids_.begin(), pos), document_id);
+    term_freqs_.insert(std::next(term_freqs_.begin(), pos), term_freq);
+    max_term_freq_ = std::max(max_term_freq_, term_freq);
+}
+
+void PostingList::Reserve(size_t size) {
+    if (is_view_) {
+        throw std::logic_error("posting list is read-only"s);
+    }
+    GrowCapacity(document_ids_, size);
+    GrowCapacity(term_freqs_, size);
+}
+
+bool PostingList::Erase(int document_id) {
+    if (is_view_) {
+        throw std::logic_error("posting list is read-only"s);
+    }
+    const size_t pos = LowerBound(document_id);
+    if (pos == document_ids_.size() || document_ids_[pos] != document_id) {
+        return false;
+    }
+    const double term_freq = term_freqs_[pos];
+    document_ids_.erase(std::next(document_ids_.begin(), pos));
+    term_freqs_.erase(std::next(term_freqs_.begin(), pos));
+    if (term_freq == max_term_freq_) {
+        max_term_freq_ = term_freqs_.empty() ? 0.0 : *std::max_element(term_freqs_.begin(), term_freqs_.end());
+    }
+    return true;
+}
+
+bool PostingList::Contains(int document_id) const {
+    const ArrayView<int> document_ids = GetDocumentIds();
+    return std::binary_search(document_ids.begin(), document_ids.end(), document_id);
+}
+
+ArrayView<int> PostingList::GetDocumentIds() const {
+    return is_view_ ? view_document_ids_ : ArrayView<int>(document_ids_);
+}
+
+ArrayView<double> PostingList::GetTermFreqs() const {
+    return is_view_ ? view_term_freqs_ : ArrayView<double>(term_freqs_);
+}
+
+double PostingList::GetMaxTermFreq() const {
+    return max_term_freq_;
+}
+
+size_t PostingList::size() const {
+    return GetDocumentIds().size();
+}
+
+bool PostingList::empty() const {
+    return size() == 0;
+}
+
+size_t PostingList::GetMemoryUsage() const {
+    // Views use no heap memory
+    return sizeof(PostingList)
+        + document_ids_.capacity() * sizeof(int)
+        + term_freqs_.capacity() * sizeof(double);
+}
+
+size_t PostingList::LowerBound(int document_id) const {
+    return std::lower_bound(document_ids_.begin(), document_ids_.end(), document_id) - document_ids_.begin();
+}
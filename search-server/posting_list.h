@@ -0,0 +1,51 @@
+#pragma once
+#include "array_view.h"
+
+#include <cstddef>
+#include <vector>
+
+// Postings of a single word stored as two parallel arrays sorted by document id.
+// Contiguous storage keeps scans in FindAllDocuments cache-friendly and costs
+// sizeof(int) + sizeof(double) bytes per posting instead of a tree node.
+class PostingList {
+public:
+    PostingList() = default;
+
+    // Read-only list over arrays stored elsewhere, e.g. in a mapped snapshot
+    static PostingList MakeView(ArrayView<int> document_ids, ArrayView<double> term_freqs, double max_term_freq);
+
+    // Adds term_freq to the posting of document_id, inserting it in id order if absent
+    void Add(int document_id, double term_freq);
+
+    // Makes room for size postings, so that adding up to size postings does not allocate
+    void Reserve(size_t size);
+
+    // Returns false if the document has no posting in the list
+    bool Erase(int document_id);
+
+    bool Contains(int document_id) const;
+
+    ArrayView<int> GetDocumentIds() const;
+
+    ArrayView<double> GetTermFreqs() const;
+
+    // Upper bound of the term frequency used for query pruning
+    double GetMaxTermFreq() const;
+
+    size_t size() const;
+
+    bool empty() const;
+
+    size_t GetMemoryUsage() const;
+
+private:
+    std::vector<int> document_ids_;
+    std::vector<double> term_freqs_;
+    double max_term_freq_ = 0.0;
+    // Used instead of the vectors by views, which cannot be changed
+    bool is_view_ = false;
+    ArrayView<int> view_document_ids_;
+    ArrayView<double> view_term_freqs_;
+
+    size_t LowerBound(int document_id) const;
+};
@@ -1,12 +1,11 @@
 #include "process_queries.h"
 
-#include <execution>
-
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries) {
     std::vector<std::vector<Document>> result(queries.size());
-    std::transform(std::execution::par, queries.begin(), queries.end(), result.begin(), [&search_server](std::string i) {return search_server.FindTopDocuments(i);});
+    // Runs on the pool of the server, so parallel queries inside do not start extra threads
+    search_server.GetThreadPool()->ParallelFor(queries.size(), [&](size_t i) {result[i] = search_server.FindTopDocuments(queries[i]);});
     return result;
 }
 
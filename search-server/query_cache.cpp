@@ -0,0 +1,62 @@
+#include "query_cache.h"
+
+#include <functional>
+
+QueryResultCache::QueryResultCache(size_t capacity)
+    : shard_capacity_((capacity + SHARD_COUNT - 1) / SHARD_COUNT) {
+}
+
+std::optional<std::vector<Document>> QueryResultCache::Find(std::string_view key, uint64_t epoch) {
+    Shard& shard = GetShard(key);
+    {
+        std::lock_guard guard(shard.mutex);
+        if (SyncEpoch(shard, epoch)) {
+            if (const auto it = shard.key_to_entry.find(key); it != shard.key_to_entry.end()) {
+                shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+                ++hits_;
+                return it->second->documents;
+            }
+        }
+    }
+    ++misses_;
+    return std::nullopt;
+}
+
+void QueryResultCache::Insert(std::string_view key, uint64_t epoch, const std::vector<Document>& documents) {
+    if (shard_capacity_ == 0) {
+        return;
+    }
+    Shard& shard = GetShard(key);
+    std::lock_guard guard(shard.mutex);
+    if (!SyncEpoch(shard, epoch)) {
+        return;
+    }
+    if (const auto it = shard.key_to_entry.find(key); it != shard.key_to_entry.end()) {
+        // Another reader has computed the same query
+        shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+        return;
+    }
+    if (shard.entries.size() == shard_capacity_) {
+        shard.key_to_entry.erase(shard.entries.back().key);
+        shard.entries.pop_back();
+    }
+    shard.entries.push_front({ std::string(key), documents });
+    shard.key_to_entry.emplace(shard.entries.front().key, shard.entries.begin());
+}
+
+QueryCacheStats QueryResultCache::GetStats() const {
+    return { hits_.load(), misses_.load() };
+}
+
+QueryResultCache::Shard& QueryResultCache::GetShard(std::string_view key) {
+    return shards_[std::hash<std::string_view>{}(key) % SHARD_COUNT];
+}
+
+bool QueryResultCache::SyncEpoch(Shard& shard, uint64_t epoch) {
+    if (epoch > shard.epoch) {
+        shard.key_to_entry.clear();
+        shard.entries.clear();
+        shard.epoch = epoch;
+    }
+    return epoch == shard.epoch;
+}
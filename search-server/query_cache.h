@@ -0,0 +1,61 @@
+#pragma once
+#include "document.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct QueryCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
+
+// Bounded LRU cache of query results split into shards with their own locks.
+// Every entry belongs to a corpus epoch: a shard drops all its entries when it sees
+// a newer epoch, and results of an older epoch are neither returned nor stored
+class QueryResultCache {
+public:
+    // capacity is the total number of results, split evenly between the shards
+    explicit QueryResultCache(size_t capacity);
+
+    std::optional<std::vector<Document>> Find(std::string_view key, uint64_t epoch);
+
+    void Insert(std::string_view key, uint64_t epoch, const std::vector<Document>& documents);
+
+    QueryCacheStats GetStats() const;
+
+private:
+    static constexpr size_t SHARD_COUNT = 16;
+
+    struct Entry {
+        std::string key;
+        std::vector<Document> documents;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        uint64_t epoch = 0;
+        // The most recently used entry is at the front
+        std::list<Entry> entries;
+        // Keys point into entries
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> key_to_entry;
+    };
+
+    const size_t shard_capacity_;
+    std::array<Shard, SHARD_COUNT> shards_;
+    std::atomic<uint64_t> hits_ = 0;
+    std::atomic<uint64_t> misses_ = 0;
+
+    Shard& GetShard(std::string_view key);
+
+    // Returns false if the shard holds results of a newer epoch
+    static bool SyncEpoch(Shard& shard, uint64_t epoch);
+};
@@ -1,32 +1,22 @@
 #include "remove_duplicates.h"
 
-void RemoveDuplicates(SearchServer& search_server)
-{
-    map<vector<string>, int> word_to_document_freqs;
-    vector<int> documents_to_delete;
+#include <iostream>
 
-    for (const int document_id : search_server)
-    {
-        vector<string> words;
-       
-        for (auto& document : search_server.GetWordFrequencies(document_id))
-        {
-            words.push_back(document.first);
-        }
+namespace {
 
-        if (word_to_document_freqs.count(words) && document_id > word_to_document_freqs[words])
-        {
-            documents_to_delete.push_back(document_id);
-        }
-        else
-        {
-            word_to_document_freqs[words] = document_id;
-        }
+void RemoveFoundDuplicates(SearchServer& search_server, const std::vector<int>& duplicates) {
+    for (const int document_id : duplicates) {
+        std::cout << "Found duplicate document id " << document_id << std::endl;
     }
+    search_server.RemoveDocuments(duplicates);
+}
 
-    for (auto document : documents_to_delete)
-    {
-        cout << "Found duplicate document id " << document << endl;
-        search_server.RemoveDocument(document);
-    }
-}
\ No newline at end of file
+} // namespace
+
+void RemoveDuplicates(SearchServer& search_server) {
+    RemoveFoundDuplicates(search_server, search_server.FindDuplicates(std::execution::par));
+}
+
+void RemoveNearDuplicates(SearchServer& search_server, double min_similarity, const MinHashOptions& options) {
+    RemoveFoundDuplicates(search_server, search_server.FindNearDuplicates(std::execution::par, min_similarity, options));
+}
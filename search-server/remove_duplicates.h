@@ -1,4 +1,9 @@
 #pragma once
-#include "test_example_functions.h"
+#include "search_server.h"
 
+// Removes documents with the same set of words as a document with a smaller id
 void RemoveDuplicates(SearchServer& search_server);
+
+// Removes documents whose sets of words have Jaccard similarity of at least min_similarity
+// with a kept document with a smaller id
+void RemoveNearDuplicates(SearchServer& search_server, double min_similarity, const MinHashOptions& options = {});
@@ -1,39 +1,68 @@
 #include "request_queue.h"
 
-RequestQueue::RequestQueue(const SearchServer& search_server)
-    : search_server_(search_server)
-    , no_results_requests_(0)
-    , current_time_(0) {
-}
+#include <algorithm>
 
-std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentStatus status) {
-    const auto result = search_server_.FindTopDocuments(raw_query, status);
-    AddRequest(result.size());
-    return result;
+RequestQueue::RequestQueue(const SearchServer& search_server, Clock::duration window, NowFunction now)
+    : search_server_(search_server)
+    , now_(now)
+    , start_time_(now_())
+    , step_duration_(std::max<Clock::duration>(Clock::duration(1), window / WINDOW_STEP_COUNT))
+    , shards_(std::make_unique<Shard[]>(SHARD_COUNT)) {
 }
 
-std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query) {
-    const auto result = search_server_.FindTopDocuments(raw_query);
-    AddRequest(result.size());
-    return result;
+int RequestQueue::GetNoResultRequests() const {
+    return static_cast<int>(GetStats().no_result_count);
 }
 
-int RequestQueue::GetNoResultRequests() const {
-    return no_results_requests_;
+RequestStats RequestQueue::GetStats() const {
+    const int64_t current_step = GetStepIndex(now_());
+    RequestStats stats;
+    std::vector<uint64_t> latency_counts(LatencyHistogram::BUCKET_COUNT, 0);
+    for (size_t i = 0; i < SHARD_COUNT; ++i) {
+        const Shard& shard = shards_[i];
+        for (const Step& step : shard.steps) {
+            const int64_t index = step.index.load(std::memory_order_acquire);
+            if (index > current_step - static_cast<int64_t>(WINDOW_STEP_COUNT) && index <= current_step) {
+                stats.request_count += step.request_count.load(std::memory_order_relaxed);
+                stats.no_result_count += step.no_result_count.load(std::memory_order_relaxed);
+                stats.document_count += step.document_count.load(std::memory_order_relaxed);
+            }
+        }
+        shard.latencies.AddCountsTo(latency_counts);
+    }
+    stats.latency = LatencyHistogram::ComputeQuantiles(latency_counts);
+    return stats;
 }
 
-void RequestQueue::AddRequest(int results_num) {
-    ++current_time_;
+void RequestQueue::AddRequest(Clock::time_point start_time, size_t result_count) {
+    const Clock::time_point end_time = now_();
+    Shard& shard = GetThreadShard();
+    shard.latencies.Record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - start_time).count()));
 
-    while (!requests_.empty() && min_in_day_ <= current_time_ - requests_.front().timestamp) {
-        if (0 == requests_.front().results) {
-            --no_results_requests_;
+    const int64_t step_index = GetStepIndex(end_time);
+    Step& step = shard.steps[static_cast<size_t>(step_index) % WINDOW_STEP_COUNT];
+    int64_t index = step.index.load(std::memory_order_acquire);
+    while (index < step_index) {
+        if (step.index.compare_exchange_weak(index, step_index, std::memory_order_acq_rel)) {
+            step.request_count.store(0, std::memory_order_relaxed);
+            step.no_result_count.store(0, std::memory_order_relaxed);
+            step.document_count.store(0, std::memory_order_relaxed);
+            break;
         }
-        requests_.pop_front();
     }
-
-    requests_.push_back({ current_time_, results_num });
-    if (0 == results_num) {
-        ++no_results_requests_;
+    step.request_count.fetch_add(1, std::memory_order_relaxed);
+    if (result_count == 0) {
+        step.no_result_count.fetch_add(1, std::memory_order_relaxed);
     }
-}
\ No newline at end of file
+    step.document_count.fetch_add(result_count, std::memory_order_relaxed);
+}
+
+int64_t RequestQueue::GetStepIndex(Clock::time_point time) const {
+    return static_cast<int64_t>((time - start_time_) / step_duration_);
+}
+
+RequestQueue::Shard& RequestQueue::GetThreadShard() const {
+    static std::atomic<size_t> next_thread_index = 0;
+    thread_local const size_t thread_index = next_thread_index.fetch_add(1, std::memory_order_relaxed);
+    return shards_[thread_index % SHARD_COUNT];
+}
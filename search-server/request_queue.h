@@ -1,38 +1,82 @@
 #pragma once
 #include "search_server.h"
+#include "latency_histogram.h"
 
-#include <deque>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
 
+struct RequestStats {
+    // Requests in the window
+    uint64_t request_count = 0;
+    uint64_t no_result_count = 0;
+    uint64_t document_count = 0;
+    // Latencies of all requests since the queue was created
+    LatencyQuantiles latency;
+};
+
+// Tracks requests to a search server over a sliding window of real time and their latencies.
+// Every thread records into its own shard of atomic counters, so concurrent requests take
+// no lock and rarely share a cache line. The window moves in steps of a WINDOW_STEP_COUNT-th
+// of it; a step is reused by the first request that sees it outdated, and a request recorded
+// into the same step by another thread of the shard at that moment may be lost
 class RequestQueue {
 public:
-    RequestQueue(const SearchServer& search_server);
-
-    template <typename DocumentPredicate>
-    std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate);
+    using Clock = std::chrono::steady_clock;
+    using NowFunction = Clock::time_point (*)();
 
-    std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentStatus status);
+    // now is called at the start and the end of every request and by GetStats,
+    // a test may pass a clock it moves itself
+    explicit RequestQueue(const SearchServer& search_server, Clock::duration window = std::chrono::hours(24),
+        NowFunction now = Clock::now);
 
-    std::vector<Document> AddFindRequest(const std::string& raw_query);
+    // Calls FindTopDocuments with the arguments
+    template <typename... Args>
+    std::vector<Document> AddFindRequest(Args&&... args);
 
+    // Requests in the window that found no documents
     int GetNoResultRequests() const;
 
+    RequestStats GetStats() const;
+
 private:
-    struct QueryResult {
-        uint64_t timestamp;
-        int results;
+    static constexpr size_t SHARD_COUNT = 16;
+    static constexpr size_t WINDOW_STEP_COUNT = 60;
+
+    struct Step {
+        std::atomic<int64_t> index = -1;  // steps since the queue was created
+        std::atomic<uint64_t> request_count = 0;
+        std::atomic<uint64_t> no_result_count = 0;
+        std::atomic<uint64_t> document_count = 0;
     };
-    std::deque<QueryResult> requests_;
+
+    struct alignas(64) Shard {
+        std::array<Step, WINDOW_STEP_COUNT> steps;
+        LatencyHistogram latencies;
+    };
+
     const SearchServer& search_server_;
-    int no_results_requests_;
-    uint64_t current_time_;
-    const static int min_in_day_ = 1440;
+    const NowFunction now_;
+    const Clock::time_point start_time_;
+    const Clock::duration step_duration_;
+    std::unique_ptr<Shard[]> shards_;
+
+    void AddRequest(Clock::time_point start_time, size_t result_count);
+
+    int64_t GetStepIndex(Clock::time_point time) const;
 
-    void AddRequest(int results_num);
+    // Threads are spread over the shards in the order of their first request
+    Shard& GetThreadShard() const;
 };
 
-template <typename DocumentPredicate>
-std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) {
-    const auto result = search_server_.FindTopDocuments(raw_query, document_predicate);
-    AddRequest(result.size());
+template <typename... Args>
+std::vector<Document> RequestQueue::AddFindRequest(Args&&... args) {
+    const Clock::time_point start_time = now_();
+    std::vector<Document> result = search_server_.FindTopDocuments(std::forward<Args>(args)...);
+    AddRequest(start_time, result.size());
     return result;
-}
\ No newline at end of file
+}
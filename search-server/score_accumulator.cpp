@@ -0,0 +1,92 @@
+#include "score_accumulator.h"
+
+#include <algorithm>
+
+ScoreAccumulator::ScoreAccumulator(int max_document_id, size_t expected_document_count)
+    : is_dense_(static_cast<size_t>(max_document_id) + 1 <= expected_document_count * DENSE_FACTOR) {
+    if (is_dense_) {
+        scores_.assign(max_document_id + 1, 0.0);
+        is_present_.assign(max_document_id + 1, 0);
+        touched_.reserve(expected_document_count);
+    }
+    else {
+        size_t slot_count = 16;
+        while (slot_count < expected_document_count * 2) {
+            slot_count *= 2;
+        }
+        slots_.resize(slot_count);
+    }
+}
+
+void ScoreAccumulator::Add(int document_id, double score) {
+    if (is_dense_) {
+        if (!is_present_[document_id]) {
+            is_present_[document_id] = 1;
+            touched_.push_back(document_id);
+            ++size_;
+        }
+        scores_[document_id] += score;
+        return;
+    }
+    if ((used_slot_count_ + 1) * 2 > slots_.size()) {
+        Rehash(slots_.size() * 2);
+    }
+    Slot& slot = FindSlot(document_id);
+    if (slot.document_id == EMPTY_SLOT) {
+        slot.document_id = document_id;
+        ++used_slot_count_;
+        ++size_;
+    }
+    slot.score += score;
+}
+
+void ScoreAccumulator::Erase(int document_id) {
+    if (is_dense_) {
+        if (document_id < static_cast<int>(is_present_.size()) && is_present_[document_id]) {
+            is_present_[document_id] = 0;
+            --size_;
+        }
+        return;
+    }
+    Slot& slot = FindSlot(document_id);
+    if (slot.document_id != EMPTY_SLOT && !slot.erased) {
+        // The slot stays occupied to keep probe sequences intact
+        slot.erased = true;
+        --size_;
+    }
+}
+
+void ScoreAccumulator::Merge(const ScoreAccumulator& other) {
+    other.ForEach([this](int document_id, double score) {
+        Add(document_id, score);
+    });
+}
+
+size_t ScoreAccumulator::size() const {
+    return size_;
+}
+
+bool ScoreAccumulator::IsDense() const {
+    return is_dense_;
+}
+
+ScoreAccumulator::Slot& ScoreAccumulator::FindSlot(int document_id) {
+    const size_t mask = slots_.size() - 1;
+    // Fibonacci hashing spreads consecutive ids over the table
+    for (size_t pos = (static_cast<uint64_t>(document_id) * 11400714819323198485ull) >> 32 & mask;; pos = (pos + 1) & mask) {
+        if (slots_[pos].document_id == EMPTY_SLOT || slots_[pos].document_id == document_id) {
+            return slots_[pos];
+        }
+    }
+}
+
+void ScoreAccumulator::Rehash(size_t slot_count) {
+    std::vector<Slot> old_slots(slot_count);
+    std::swap(slots_, old_slots);
+    used_slot_count_ = size_;
+    for (const Slot& slot : old_slots) {
+        if (slot.document_id != EMPTY_SLOT && !slot.erased) {
+            FindSlot(slot.document_id) = slot;
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Sums relevance per document without locks; every thread fills its own accumulator
+// and the results are combined with Merge.
+// Dense mode keeps scores in an array indexed by document id, which pays off when
+// the query touches a noticeable part of the id range. Otherwise scores live in
+// a compact open addressing table
+class ScoreAccumulator {
+public:
+    // expected_document_count is an upper bound estimate, e.g. the number of postings to scan
+    ScoreAccumulator(int max_document_id, size_t expected_document_count);
+
+    void Add(int document_id, double score);
+
+    // Must be called after all merges
+    void Erase(int document_id);
+
+    void Merge(const ScoreAccumulator& other);
+
+    // Calls callback(document_id, score) for every accumulated document
+    template <typename Callback>
+    void ForEach(Callback callback) const;
+
+    size_t size() const;
+
+    bool IsDense() const;
+
+private:
+    static constexpr size_t DENSE_FACTOR = 4;
+    static constexpr int EMPTY_SLOT = -1;
+
+    struct Slot {
+        int document_id = EMPTY_SLOT;
+        bool erased = false;
+        double score = 0.0;
+    };
+
+    bool is_dense_;
+    size_t size_ = 0;
+
+    // Dense mode
+    std::vector<double> scores_;
+    std::vector<uint8_t> is_present_;
+    std::vector<int> touched_;
+
+    // Sparse mode, slots_.size() is a power of two
+    std::vector<Slot> slots_;
+    size_t used_slot_count_ = 0;
+
+    Slot& FindSlot(int document_id);
+
+    void Rehash(size_t slot_count);
+};
+
+template <typename Callback>
+void ScoreAccumulator::ForEach(Callback callback) const {
+    if (is_dense_) {
+        for (const int document_id : touched_) {
+            if (is_present_[document_id]) {
+                callback(document_id, scores_[document_id]);
+            }
+        }
+        return;
+    }
+    for (const Slot& slot : slots_) {
+        if (slot.document_id != EMPTY_SLOT && !slot.erased) {
+            callback(slot.document_id, slot.score);
+        }
+    }
+}
@@ -1,9 +1,49 @@
 #include "search_server.h"
+#include "vector_capacity.h"
 
 #include <cassert>
+#include <exception>
+#include <limits>
+#include <new>
+#include <thread>
+#include <unordered_map>
 
 using namespace std::string_literals;
 
+namespace {
+
+enum class LogOperation : uint8_t {
+    ADD_DOCUMENT,
+    ADD_DOCUMENTS,
+    REMOVE_DOCUMENT,
+    REMOVE_DOCUMENTS,
+};
+
+void WriteLogDocument(LogRecordWriter& record, int document_id, std::string_view text, DocumentStatus status, const std::vector<int>& ratings) {
+    record.Put<int32_t>(document_id);
+    record.Put<uint32_t>(static_cast<uint32_t>(status));
+    record.Put<uint32_t>(static_cast<uint32_t>(ratings.size()));
+    for (const int rating : ratings) {
+        record.Put<int32_t>(rating);
+    }
+    record.PutString(text);
+}
+
+// The text points into the record
+DocumentToAdd ReadLogDocument(LogRecordReader& record) {
+    DocumentToAdd document;
+    document.id = record.Get<int32_t>();
+    document.status = static_cast<DocumentStatus>(record.Get<uint32_t>());
+    document.ratings.resize(record.Get<uint32_t>());
+    for (int& rating : document.ratings) {
+        rating = record.Get<int32_t>();
+    }
+    document.text = record.GetString();
+    return document;
+}
+
+} // namespace
+
 SearchServer::SearchServer(const std::string& stop_words_text)
     : SearchServer(SplitIntoWords(stop_words_text))  // Invoke delegating constructor
                                                      // from string container
@@ -15,166 +55,866 @@ SearchServer::SearchServer(std::string_view stop_words_text)
 {
 }
 
+SearchServer::~SearchServer() {
+    {
+        std::lock_guard guard(merge_mutex_);
+        is_stopping_ = true;
+    }
+    merge_condition_.notify_one();
+    if (merge_thread_.joinable()) {
+        merge_thread_.join();
+    }
+}
+
 void SearchServer::AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
-    if ((document_id < 0) || (documents_.count(document_id) > 0)) {
+    std::unique_lock guard(write_mutex_);
+    if ((document_id < 0) || (document_ids_.count(document_id) > 0)) {
         throw std::invalid_argument("document contains wrong id"s);
     }
-    std::vector<std::string_view> words = SplitIntoWordsNoStop(document);
+    std::vector<std::string_view> words;
+    {
+        METRICS_PHASE(INGEST_TOKENIZE);
+        SplitIntoWordsNoStop(document, words);
+    }
     const double inv_word_count = 1.0 / words.size();
-    for (std::string_view& word : words) {
-        std::string s_word{ word };
-        if (words_in_docs_.count(s_word) == 0) {
-            words_in_docs_[s_word].first = s_word;
-            std::string_view sv_word{ words_in_docs_.at(s_word).first };
-            words_in_docs_.at(s_word).second = sv_word;
+    const int rating = ComputeAverageRating(ratings);
+    const uint64_t log_sequence = LogChange([&](LogRecordWriter& record) {
+        record.Put(LogOperation::ADD_DOCUMENT);
+        WriteLogDocument(record, document_id, document, status, ratings);
+        });
+    document_ids_.insert(document_id);
+    PublishChange(guard, log_sequence, [&] {
+        METRICS_PHASE_BEGIN(index_timer, INGEST_INDEX);
+        DocumentAddition addition;
+        index_.Read([&](const IndexState& index) {
+            std::vector<TermId> word_terms;
+            word_terms.reserve(words.size());
+            for (const std::string_view word : words) {
+                word_terms.push_back(AssignTerm(index, word, addition));
+            }
+            std::sort(word_terms.begin(), word_terms.end());
+            DocumentTermStorage document_terms;
+            for (const TermId term : word_terms) {
+                if (document_terms.terms.empty() || document_terms.terms.back() != term) {
+                    document_terms.terms.push_back(term);
+                    document_terms.term_freqs.push_back(0.0);
+                    addition.posting_counts.emplace_back(term, 1);
+                }
+                document_terms.term_freqs.back() += inv_word_count;
+            }
+            addition.documents.push_back({ document_id, status, rating, MakeDocumentData(std::move(document_terms)) });
+            });
+        AddToIndex(addition, log_sequence);
+        METRICS_PHASE_END(index_timer);
+        METRICS_COUNT(INGEST_DOCUMENTS, 1);
+        });
+}
+
+void SearchServer::AddDocuments(const std::vector<DocumentToAdd>& documents) {
+    AddDocuments(std::execution::seq, documents);
+}
+
+void SearchServer::AddDocuments(const std::execution::sequenced_policy& policy, const std::vector<DocumentToAdd>& documents) {
+    AddDocuments(PrepareDocuments(policy, documents));
+}
+
+void SearchServer::AddDocuments(const std::execution::parallel_policy& policy, const std::vector<DocumentToAdd>& documents) {
+    AddDocuments(PrepareDocuments(policy, documents));
+}
+
+SearchServer::PreparedDocuments SearchServer::PrepareDocuments(const std::vector<DocumentToAdd>& documents) {
+    return PrepareDocuments(std::execution::seq, documents);
+}
+
+SearchServer::PreparedDocuments SearchServer::PrepareDocuments(const std::execution::sequenced_policy&, const std::vector<DocumentToAdd>& documents) {
+    return PrepareDocumentBatch(documents, 1);
+}
+
+SearchServer::PreparedDocuments SearchServer::PrepareDocuments(const std::execution::parallel_policy&, const std::vector<DocumentToAdd>& documents) {
+    const size_t part_count = std::min<size_t>(documents.size(), 4 * (GetThreadPool()->GetWorkerCount() + 1));
+    return PrepareDocumentBatch(documents, std::max<size_t>(part_count, 1));
+}
+
+void SearchServer::CheckBatchIds(const std::vector<const DocumentToAdd*>& batch) const {
+    for (size_t i = 0; i < batch.size(); ++i) {
+        const int document_id = batch[i]->id;
+        if (document_id < 0 || document_ids_.count(document_id) > 0 || (i > 0 && batch[i - 1]->id == document_id)) {
+            throw std::invalid_argument("document contains wrong id"s);
         }
-        word_to_document_freqs_[words_in_docs_.at(s_word).second][document_id] += inv_word_count;
-        document_word_freqs_[document_id][words_in_docs_.at(std::string(s_word)).second] += inv_word_count;
     }
-    documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status });
-    document_ids_.insert(document_id);
 }
 
-std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(std::execution::seq, raw_query, [status](int document_id, DocumentStatus statusp, int rating) { return statusp == status; });
+SearchServer::PreparedDocuments SearchServer::PrepareDocumentBatch(const std::vector<DocumentToAdd>& documents, size_t part_count) {
+    // Parts cover increasing id ranges, so their postings are appended to the index in id order
+    std::vector<const DocumentToAdd*> batch(documents.size());
+    std::transform(documents.begin(), documents.end(), batch.begin(), [](const DocumentToAdd& document) { return &document; });
+    std::sort(batch.begin(), batch.end(), [](const DocumentToAdd* lhs, const DocumentToAdd* rhs) { return lhs->id < rhs->id; });
+    {
+        std::lock_guard guard(write_mutex_);
+        CheckBatchIds(batch);
+    }
+
+    METRICS_PHASE(INGEST_TOKENIZE);
+    std::vector<BatchPart> parts(part_count);
+    const size_t part_length = (batch.size() + part_count - 1) / part_count;
+    const auto tokenize_part = [this, &batch, &parts, part_length](size_t part_index) {
+        BatchPart& part = parts[part_index];
+        const size_t begin = std::min(batch.size(), part_index * part_length);
+        const size_t end = std::min(batch.size(), begin + part_length);
+        // The error of the first failed part is reported, whatever part fails first in time
+        try {
+            std::vector<double> word_freqs;
+            std::vector<uint32_t> document_word_indexes;
+            std::vector<std::string_view> words;
+            for (size_t i = begin; i < end; ++i) {
+                SplitIntoWordsNoStop(batch[i]->text, words);
+                const double inv_word_count = 1.0 / words.size();
+                for (const std::string_view word : words) {
+                    const auto [it, inserted] = part.word_to_index.emplace(word, static_cast<uint32_t>(part.words.size()));
+                    if (inserted) {
+                        part.words.push_back(word);
+                        part.document_counts.push_back(0);
+                        word_freqs.push_back(0.0);
+                    }
+                    if (word_freqs[it->second] == 0.0) {
+                        document_word_indexes.push_back(it->second);
+                    }
+                    word_freqs[it->second] += inv_word_count;
+                }
+                auto& document_words = part.document_words.emplace_back();
+                for (const uint32_t word_index : document_word_indexes) {
+                    ++part.document_counts[word_index];
+                    document_words.push_back({ word_index, word_freqs[word_index] });
+                    word_freqs[word_index] = 0.0;
+                }
+                document_word_indexes.clear();
+            }
+        }
+        catch (...) {
+            part.error = std::current_exception();
+        }
+    };
+    if (part_count > 1) {
+        GetThreadPool()->ParallelFor(part_count, tokenize_part);
+    }
+    else {
+        tokenize_part(0);
+    }
+    for (const BatchPart& part : parts) {
+        if (part.error) {
+            std::rethrow_exception(part.error);
+        }
+    }
+
+    std::vector<int> ratings(batch.size());
+    std::transform(batch.begin(), batch.end(), ratings.begin(), [this](const DocumentToAdd* document) {
+        return ComputeAverageRating(document->ratings);
+        });
+
+    PreparedDocuments prepared;
+    prepared.batch_ = std::move(batch);
+    prepared.parts_ = std::move(parts);
+    prepared.part_length_ = part_length;
+    prepared.ratings_ = std::move(ratings);
+    return prepared;
+}
+
+void SearchServer::AddDocuments(PreparedDocuments documents) {
+    const std::vector<const DocumentToAdd*>& batch = documents.batch_;
+    const std::vector<BatchPart>& parts = documents.parts_;
+    const size_t part_length = documents.part_length_;
+    const std::vector<int>& ratings = documents.ratings_;
+
+    // Tokenization runs without the lock, so the ids are checked again before the index changes.
+    // The batch is never split between segments
+    std::unique_lock guard(write_mutex_);
+    CheckBatchIds(batch);
+    const uint64_t log_sequence = LogChange([&](LogRecordWriter& record) {
+        record.Put(LogOperation::ADD_DOCUMENTS);
+        record.Put<uint32_t>(static_cast<uint32_t>(batch.size()));
+        for (const DocumentToAdd* document : batch) {
+            WriteLogDocument(record, document->id, document->text, document->status, document->ratings);
+        }
+        });
+    for (const DocumentToAdd* document : batch) {
+        document_ids_.insert(document->id);
+    }
+    PublishChange(guard, log_sequence, [&] {
+        METRICS_PHASE_BEGIN(index_timer, INGEST_INDEX);
+        DocumentAddition addition;
+        addition.documents.reserve(batch.size());
+        index_.Read([&](const IndexState& index) {
+            std::vector<TermId> part_terms;
+            std::vector<std::pair<TermId, double>> term_freqs;
+            for (size_t part_index = 0; part_index < parts.size(); ++part_index) {
+                const BatchPart& part = parts[part_index];
+                part_terms.resize(part.words.size());
+                for (size_t i = 0; i < part.words.size(); ++i) {
+                    part_terms[i] = AssignTerm(index, part.words[i], addition);
+                    addition.posting_counts.emplace_back(part_terms[i], part.document_counts[i]);
+                }
+
+                const size_t begin = part_index * part_length;
+                for (size_t i = 0; i < part.document_words.size(); ++i) {
+                    const DocumentToAdd& document = *batch[begin + i];
+                    term_freqs.clear();
+                    for (const auto& [word_index, term_freq] : part.document_words[i]) {
+                        term_freqs.emplace_back(part_terms[word_index], term_freq);
+                    }
+                    std::sort(term_freqs.begin(), term_freqs.end());
+                    DocumentTermStorage document_terms;
+                    document_terms.terms.reserve(term_freqs.size());
+                    document_terms.term_freqs.reserve(term_freqs.size());
+                    for (const auto& [term, term_freq] : term_freqs) {
+                        document_terms.terms.push_back(term);
+                        document_terms.term_freqs.push_back(term_freq);
+                    }
+                    addition.documents.push_back({ document.id, document.status, ratings[begin + i], MakeDocumentData(std::move(document_terms)) });
+                }
+            }
+            });
+        // A word may be in several parts
+        if (parts.size() > 1) {
+            auto& posting_counts = addition.posting_counts;
+            std::sort(posting_counts.begin(), posting_counts.end());
+            size_t unique_count = 0;
+            for (const auto& [term, posting_count] : posting_counts) {
+                if (unique_count > 0 && posting_counts[unique_count - 1].first == term) {
+                    posting_counts[unique_count - 1].second += posting_count;
+                }
+                else {
+                    posting_counts[unique_count++] = { term, posting_count };
+                }
+            }
+            posting_counts.resize(unique_count);
+        }
+        AddToIndex(addition, log_sequence);
+        METRICS_PHASE_END(index_timer);
+        METRICS_COUNT(INGEST_DOCUMENTS, batch.size());
+        });
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status, size_t top_k) const {
+    return FindTopDocuments(std::execution::seq, raw_query, status, top_k);
 }
 
 std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query) const {
     return FindTopDocuments(std::execution::seq, raw_query, DocumentStatus::ACTUAL);
 }
 
+DocumentPage SearchServer::FindTopDocumentsPage(std::string_view raw_query, size_t page_size, const std::optional<SearchCursor>& after) const {
+    return FindTopDocumentsPage(raw_query, DocumentStatus::ACTUAL, page_size, after);
+}
+
 int SearchServer::GetDocumentCount() const {
-    return documents_.size();
+    return index_.Read([](const IndexState& index) {
+        return static_cast<int>(index.documents.size());
+        });
 }
 
-std::set<int>::const_iterator SearchServer::begin() const {
-    return document_ids_.begin();
+void SearchServer::SetQueryStrategy(QueryStrategy strategy) {
+    query_strategy_.store(strategy, std::memory_order_relaxed);
 }
 
-std::set<int>::const_iterator SearchServer::end() const {
-    return document_ids_.end();
+PruningStats SearchServer::GetPruningStats() const {
+    return { pruning_postings_total_.load(), pruning_postings_scored_.load() };
+}
+
+void SearchServer::SetSegmentSize(size_t document_count) {
+    if (document_count == 0) {
+        throw std::invalid_argument("segment size must be positive"s);
+    }
+    std::lock_guard guard(write_mutex_);
+    bool is_segment_full = false;
+    index_.Update([document_count, &is_segment_full](IndexState& index) {
+        index.segment_size = document_count;
+        is_segment_full = index.building_segment && index.building_segment->GetDocumentCount() >= index.segment_size;
+        });
+    if (is_segment_full) {
+        SealBuildingSegment();
+    }
+}
+
+void SearchServer::SetCompactionThreshold(double removed_fraction) {
+    if (!(removed_fraction > 0.0 && removed_fraction <= 1.0)) {
+        throw std::invalid_argument("compaction threshold must be in (0, 1]"s);
+    }
+    std::lock_guard guard(write_mutex_);
+    bool has_segment_to_compact = false;
+    index_.Update([removed_fraction, &has_segment_to_compact](IndexState& index) {
+        index.compaction_threshold = removed_fraction;
+        has_segment_to_compact = HasSegmentToCompact(index);
+        });
+    if (has_segment_to_compact) {
+        RequestMerge();
+    }
 }
 
-const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-    static std::map<std::string_view, double> words_freqs_empty;
+void SearchServer::Compact() {
+    {
+        std::lock_guard guard(write_mutex_);
+        // Purging rebuilds posting lists, so every copy gets a purged copy of its segment
+        index_.Update(
+            [](IndexState& index) {
+                std::unique_ptr<IndexSegment> segment;
+                if (index.building_segment) {
+                    segment = std::make_unique<IndexSegment>(*index.building_segment);
+                    segment->PurgeRemovedDocuments();
+                }
+                return segment;
+            },
+            [](IndexState& index, std::unique_ptr<IndexSegment>& segment) {
+                if (segment) {
+                    index.building_segment = std::move(segment);
+                }
+            });
+    }
+    CompactSegments(0.0);
+}
 
-    if (!documents_.count(document_id))
+void SearchServer::MergeSegments() {
     {
-        return words_freqs_empty;
+        std::lock_guard guard(write_mutex_);
+        SealBuildingSegment();
     }
+    MergeSmallestSegments(0, std::numeric_limits<size_t>::max());
+}
 
-    return document_word_freqs_.at(document_id);
+size_t SearchServer::GetSegmentCount() const {
+    return index_.Read([](const IndexState& index) {
+        return index.sealed_segments.size() + (index.building_segment ? 1 : 0);
+        });
 }
 
-void SearchServer::RemoveDocument(int document_id) {
-    RemoveDocument(std::execution::seq, document_id);
+void SearchServer::SaveSnapshot(const std::string& path) const {
+    SnapshotWriter writer(path);
+    writer.WriteStrings(SnapshotSection::STOP_WORD_OFFSETS, SnapshotSection::STOP_WORD_CHARS,
+        std::vector<std::string_view>(stop_words_.begin(), stop_words_.end()));
+    index_.Read([&](const IndexState& index) {
+        std::vector<std::string_view> terms(index.dictionary.size());
+        for (TermId term = 0; term < terms.size(); ++term) {
+            terms[term] = index.dictionary.GetTerm(term);
+        }
+        writer.WriteStrings(SnapshotSection::TERM_OFFSETS, SnapshotSection::TERM_CHARS, terms);
+        writer.WriteSection(SnapshotSection::TERM_SLOTS, TermDictionary::BuildSlots(terms));
+        writer.WriteSection(SnapshotSection::DOCUMENT_FREQS, index.document_freqs);
+
+        std::vector<SnapshotDocument> documents;
+        std::vector<TermId> document_term_ids;
+        std::vector<double> document_term_freqs;
+        documents.reserve(index.documents.size());
+        for (const auto& [document_id, document_data] : index.documents) {
+            documents.push_back({ document_id, 0, document_term_ids.size(), document_data.terms.size() });
+            document_term_ids.insert(document_term_ids.end(), document_data.terms.begin(), document_data.terms.end());
+            document_term_freqs.insert(document_term_freqs.end(), document_data.term_freqs.begin(), document_data.term_freqs.end());
+        }
+        writer.WriteSection(SnapshotSection::DOCUMENTS, documents);
+        writer.WriteSection(SnapshotSection::DOCUMENT_TERM_IDS, document_term_ids);
+        writer.WriteSection(SnapshotSection::DOCUMENT_TERM_FREQS, document_term_freqs);
+
+        std::vector<uint64_t> column_page_indexes;
+        std::vector<DocumentColumns::Page> column_pages;
+        index.columns.ForEachPage([&](size_t page_index, const DocumentColumns::Page& page) {
+            column_page_indexes.push_back(page_index);
+            column_pages.push_back(page);
+            });
+        writer.WriteSection(SnapshotSection::COLUMN_PAGE_INDEXES, column_page_indexes);
+        writer.WriteSection(SnapshotSection::COLUMN_PAGES, column_pages);
+
+        std::vector<SnapshotSegment> segments;
+        std::vector<int> segment_document_ids;
+        std::vector<SnapshotSegmentTerm> segment_terms;
+        std::vector<int> posting_document_ids;
+        std::vector<double> posting_term_freqs;
+        const auto add_segment = [&](const IndexSegment& segment) {
+            const std::vector<int>& document_ids = segment.GetDocumentIds();
+            const size_t live_count = std::count_if(document_ids.begin(), document_ids.end(), [&](int document_id) {
+                return index.columns.IsLive(document_id, segment.GetId());
+                });
+            segments.push_back({ segment.GetId(), 0, segment_document_ids.size(), document_ids.size(),
+                segment_terms.size(), segment.GetTerms().size(), document_ids.size() - live_count });
+            segment_document_ids.insert(segment_document_ids.end(), document_ids.begin(), document_ids.end());
+            for (size_t i = 0; i < segment.GetTerms().size(); ++i) {
+                const PostingList& postings = segment.GetPostings()[i];
+                segment_terms.push_back({ segment.GetTerms()[i], 0, posting_document_ids.size(), postings.size(), postings.GetMaxTermFreq() });
+                posting_document_ids.insert(posting_document_ids.end(), postings.GetDocumentIds().begin(), postings.GetDocumentIds().end());
+                posting_term_freqs.insert(posting_term_freqs.end(), postings.GetTermFreqs().begin(), postings.GetTermFreqs().end());
+            }
+        };
+        for (const auto& segment : index.sealed_segments) {
+            add_segment(*segment);
+        }
+        // The in-memory segment is stored sealed
+        if (index.building_segment) {
+            IndexSegment building_segment = *index.building_segment;
+            building_segment.Seal();
+            add_segment(building_segment);
+        }
+        writer.WriteSection(SnapshotSection::SEGMENTS, segments);
+        writer.WriteSection(SnapshotSection::SEGMENT_DOCUMENT_IDS, segment_document_ids);
+        writer.WriteSection(SnapshotSection::SEGMENT_TERMS, segment_terms);
+        writer.WriteSection(SnapshotSection::POSTING_DOCUMENT_IDS, posting_document_ids);
+        writer.WriteSection(SnapshotSection::POSTING_TERM_FREQS, posting_term_freqs);
+        writer.Finish(index.next_segment_id, index.segment_size, index.log_sequence);
+        });
 }
 
-void SearchServer::RemoveDocument(const std::execution::sequenced_policy&, int document_id) {
-    const auto id_found = find(std::execution::seq, document_ids_.begin(), document_ids_.end(), document_id);
-    if (id_found == document_ids_.end()) {
-        return;
+std::unique_ptr<SearchServer> SearchServer::LoadSnapshot(const std::string& path) {
+    const auto snapshot = std::make_shared<const SnapshotFile>(path);
+    auto search_server = std::make_unique<SearchServer>(
+        snapshot->GetStrings(SnapshotSection::STOP_WORD_OFFSETS, SnapshotSection::STOP_WORD_CHARS));
+    search_server->LoadIndex(snapshot);
+    return search_server;
+}
+
+void SearchServer::LoadIndex(const std::shared_ptr<const SnapshotFile>& snapshot) {
+    const auto check = [](bool condition) {
+        if (!condition) {
+            throw std::invalid_argument("snapshot is corrupted"s);
+        }
+    };
+    const SnapshotHeader& header = snapshot->GetHeader();
+
+    // The dictionary, the forward index and the columns are read in place, both copies
+    // of the index serve the same mapped sections
+    const auto make_dictionary = [&snapshot] {
+        return TermDictionary::MakeView(snapshot->GetSection<uint64_t>(SnapshotSection::TERM_OFFSETS),
+            snapshot->GetSection<char>(SnapshotSection::TERM_CHARS),
+            snapshot->GetSection<TermDictionary::Slot>(SnapshotSection::TERM_SLOTS), snapshot);
+    };
+    TermDictionary dictionary = make_dictionary();
+    const size_t term_count = dictionary.size();
+    const auto document_freqs = snapshot->GetSection<uint32_t>(SnapshotSection::DOCUMENT_FREQS);
+    check(document_freqs.size() == term_count);
+
+    // Segments keep the snapshot mapped while their postings are in use
+    const auto segment_records = snapshot->GetSection<SnapshotSegment>(SnapshotSection::SEGMENTS);
+    const auto segment_document_ids = snapshot->GetSection<int>(SnapshotSection::SEGMENT_DOCUMENT_IDS);
+    const auto segment_terms = snapshot->GetSection<SnapshotSegmentTerm>(SnapshotSection::SEGMENT_TERMS);
+    const auto posting_document_ids = snapshot->GetSection<int>(SnapshotSection::POSTING_DOCUMENT_IDS);
+    const auto posting_term_freqs = snapshot->GetSection<double>(SnapshotSection::POSTING_TERM_FREQS);
+    check(posting_document_ids.size() == posting_term_freqs.size());
+    std::vector<std::shared_ptr<const IndexSegment>> segments;
+    std::set<SegmentId> segment_ids;
+    std::map<SegmentId, size_t> removed_document_counts;
+    for (const SnapshotSegment& record : segment_records) {
+        check(record.id > 0 && record.id < header.next_segment_id && segment_ids.insert(record.id).second);
+        check(record.document_begin <= segment_document_ids.size() && record.document_count <= segment_document_ids.size() - record.document_begin);
+        check(record.term_begin <= segment_terms.size() && record.term_count <= segment_terms.size() - record.term_begin);
+        check(record.removed_document_count <= record.document_count);
+        std::vector<TermId> segment_term_ids;
+        std::vector<PostingList> postings;
+        segment_term_ids.reserve(record.term_count);
+        postings.reserve(record.term_count);
+        for (uint64_t i = record.term_begin; i < record.term_begin + record.term_count; ++i) {
+            const SnapshotSegmentTerm& term = segment_terms[i];
+            check(term.term < term_count && (segment_term_ids.empty() || segment_term_ids.back() < term.term));
+            check(term.posting_begin <= posting_document_ids.size() && term.posting_count <= posting_document_ids.size() - term.posting_begin);
+            segment_term_ids.push_back(term.term);
+            postings.push_back(PostingList::MakeView({ posting_document_ids.data() + term.posting_begin, term.posting_count },
+                { posting_term_freqs.data() + term.posting_begin, term.posting_count }, term.max_term_freq));
+        }
+        segments.push_back(std::make_shared<const IndexSegment>(IndexSegment::MakeSealed(record.id,
+            std::vector<int>(segment_document_ids.begin() + record.document_begin, segment_document_ids.begin() + record.document_begin + record.document_count),
+            std::move(segment_term_ids), std::move(postings), snapshot)));
+        if (record.removed_document_count > 0) {
+            removed_document_counts[record.id] = static_cast<size_t>(record.removed_document_count);
+        }
     }
 
-    for (auto& [word, freqs] : document_word_freqs_.at(document_id)) {
-        word_to_document_freqs_.at(std::string(word)).erase(document_id);
+    const DocumentColumns columns = DocumentColumns::MakeView(snapshot->GetSection<uint64_t>(SnapshotSection::COLUMN_PAGE_INDEXES),
+        snapshot->GetSection<DocumentColumns::Page>(SnapshotSection::COLUMN_PAGES), snapshot);
+    const auto document_records = snapshot->GetSection<SnapshotDocument>(SnapshotSection::DOCUMENTS);
+    const auto document_term_ids = snapshot->GetSection<TermId>(SnapshotSection::DOCUMENT_TERM_IDS);
+    const auto document_term_freqs = snapshot->GetSection<double>(SnapshotSection::DOCUMENT_TERM_FREQS);
+    check(document_term_ids.size() == document_term_freqs.size());
+    // Removing a document decrements document_freqs of its terms, so they must be words of the dictionary
+    check(std::all_of(document_term_ids.begin(), document_term_ids.end(), [term_count](TermId term) {
+        return term < term_count;
+        }));
+    std::map<int, DocumentData> documents;
+    for (const SnapshotDocument& record : document_records) {
+        check(record.id >= 0 && (documents.empty() || documents.rbegin()->first < record.id));
+        check(segment_ids.count(columns.GetSegmentId(record.id)) > 0);
+        check(record.term_begin <= document_term_ids.size() && record.term_count <= document_term_ids.size() - record.term_begin);
+        documents.emplace_hint(documents.end(), record.id, DocumentData{
+            { document_term_ids.data() + record.term_begin, record.term_count },
+            { document_term_freqs.data() + record.term_begin, record.term_count }, snapshot });
     }
 
-    document_word_freqs_.erase(document_id);
-    documents_.erase(document_id);
-    document_ids_.erase(id_found);
+    std::lock_guard guard(write_mutex_);
+    log_sequence_ = snapshot->GetLogSequence();
+    published_sequence_ = log_sequence_;
+    // The copy prepared first copies what was checked, the other one takes it
+    bool is_copied = false;
+    index_.Update(
+        [&](IndexState& index) {
+            IndexState loaded;
+            if (is_copied) {
+                loaded.dictionary = std::move(dictionary);
+                loaded.documents = std::move(documents);
+            }
+            else {
+                loaded.dictionary = make_dictionary();
+                loaded.documents = documents;
+                is_copied = true;
+            }
+            loaded.document_freqs.assign(document_freqs.begin(), document_freqs.end());
+            loaded.sealed_segments = segments;
+            loaded.removed_document_counts = removed_document_counts;
+            loaded.next_segment_id = static_cast<SegmentId>(header.next_segment_id);
+            loaded.segment_size = static_cast<size_t>(header.segment_size);
+            loaded.compaction_threshold = index.compaction_threshold;
+            loaded.columns = columns;
+            loaded.idf_cache.Resize(loaded.dictionary.size());
+            loaded.corpus_generation = index.corpus_generation + 1;
+            loaded.log_sequence = log_sequence_;
+            return loaded;
+        },
+        [](IndexState& index, IndexState& loaded) {
+            index = std::move(loaded);
+        });
+    RestoreDocumentIds();
 }
 
-void SearchServer::RemoveDocument(const std::execution::parallel_policy&, int document_id) {
+void SearchServer::OpenLog(const std::string& path) {
+    auto log = std::make_unique<WriteAheadLog>(path);
+    log->Replay([this](uint64_t sequence, std::string_view payload) {
+        // Changes up to the checkpoint are in the snapshot already
+        if (sequence <= log_sequence_) {
+            return;
+        }
+        if (sequence != log_sequence_ + 1) {
+            throw std::invalid_argument("log does not continue the snapshot"s);
+        }
+        ApplyLogRecord(payload);
+        });
+    std::lock_guard guard(write_mutex_);
+    log_ = std::move(log);
+}
 
-    auto id_found = find(std::execution::par, document_ids_.begin(), document_ids_.end(), document_id);
-    if (id_found == document_ids_.end()) {
-        return;
+void SearchServer::Checkpoint(const std::string& snapshot_path) {
+    std::unique_lock guard(write_mutex_);
+    // Changes that are logged but not published yet would be lost with the log
+    published_condition_.wait(guard, [this] {
+        return published_sequence_ == log_sequence_;
+        });
+    SaveSnapshot(snapshot_path);
+    if (log_) {
+        log_->Truncate();
     }
+}
 
-    const auto& word_freqs = document_word_freqs_.at(document_id);
-    std::vector<std::string_view> words(word_freqs.size(), "");
-    transform(std::execution::par,
-        word_freqs.begin(), word_freqs.end(),
-        words.begin(),
-        [](const auto& item)
-        { return std::string_view(item.first); }
-    );
+void SearchServer::ApplyLogRecord(std::string_view payload) {
+    LogRecordReader record(payload);
+    switch (record.Get<LogOperation>()) {
+    case LogOperation::ADD_DOCUMENT: {
+        const DocumentToAdd document = ReadLogDocument(record);
+        AddDocument(document.id, document.text, document.status, document.ratings);
+        break;
+    }
+    case LogOperation::ADD_DOCUMENTS: {
+        std::vector<DocumentToAdd> documents(record.Get<uint32_t>());
+        for (DocumentToAdd& document : documents) {
+            document = ReadLogDocument(record);
+        }
+        AddDocuments(std::execution::seq, documents);
+        break;
+    }
+    case LogOperation::REMOVE_DOCUMENT:
+        RemoveDocument(record.Get<int32_t>());
+        break;
+    case LogOperation::REMOVE_DOCUMENTS: {
+        std::vector<int> document_ids(record.Get<uint32_t>());
+        for (int& document_id : document_ids) {
+            document_id = record.Get<int32_t>();
+        }
+        RemoveDocuments(document_ids);
+        break;
+    }
+    default:
+        throw std::invalid_argument("unknown log record"s);
+    }
+}
 
-    for_each(std::execution::par, words.begin(), words.end(),
-        [this, document_id](std::string_view word) {
-            word_to_document_freqs_.at(std::string(word)).erase(document_id);
+void SearchServer::RestoreDocumentIds() {
+    document_ids_.clear();
+    index_.Read([this](const IndexState& index) {
+        for (const auto& [document_id, document_data] : index.documents) {
+            document_ids_.insert(document_id);
         }
-    );
+        });
+}
 
-    document_word_freqs_.erase(document_id);
-    documents_.erase(document_id);
+void SearchServer::SetWorkerCount(size_t worker_count) {
+    std::atomic_store(&thread_pool_, std::make_shared<ThreadPool>(worker_count));
+}
+
+std::shared_ptr<ThreadPool> SearchServer::GetThreadPool() const {
+    return std::atomic_load(&thread_pool_);
+}
+
+void SearchServer::SetQueryCacheCapacity(size_t capacity) {
+    std::atomic_store(&query_cache_, capacity > 0 ? std::make_shared<QueryResultCache>(capacity) : nullptr);
+}
+
+QueryCacheStats SearchServer::GetQueryCacheStats() const {
+    const std::shared_ptr<QueryResultCache> query_cache = GetQueryCache();
+    return query_cache ? query_cache->GetStats() : QueryCacheStats{};
+}
+
+std::shared_ptr<QueryResultCache> SearchServer::GetQueryCache() const {
+    return std::atomic_load(&query_cache_);
+}
+
+std::set<int>::const_iterator SearchServer::begin() const {
+    return document_ids_.begin();
+}
+
+std::set<int>::const_iterator SearchServer::end() const {
+    return document_ids_.end();
+}
+
+std::shared_ptr<const std::map<std::string_view, double>> SearchServer::GetWordFrequencies(int document_id) const {
+    static const auto words_freqs_empty = std::make_shared<const std::map<std::string_view, double>>();
+
+    // Words point into the dictionary, which keeps every word as long as the server lives
+    return index_.Read([document_id](const IndexState& index) {
+        const auto document = index.documents.find(document_id);
+        if (document == index.documents.end())
+        {
+            return words_freqs_empty;
+        }
+        const DocumentData& document_data = document->second;
+        auto word_freqs = std::make_shared<std::map<std::string_view, double>>();
+        for (size_t i = 0; i < document_data.terms.size(); ++i) {
+            word_freqs->emplace(index.dictionary.GetTerm(document_data.terms[i]), document_data.term_freqs[i]);
+        }
+        return std::shared_ptr<const std::map<std::string_view, double>>(std::move(word_freqs));
+        });
+}
+
+void SearchServer::RemoveDocument(int document_id) {
+    std::unique_lock guard(write_mutex_);
+    const auto id_found = document_ids_.find(document_id);
+    if (id_found == document_ids_.end()) {
+        return;
+    }
+
+    const uint64_t log_sequence = LogChange([document_id](LogRecordWriter& record) {
+        record.Put(LogOperation::REMOVE_DOCUMENT);
+        record.Put<int32_t>(document_id);
+        });
     document_ids_.erase(id_found);
+    PublishChange(guard, log_sequence, [&] {
+        RemoveFromIndex({ document_id }, log_sequence);
+        });
 }
 
-std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::string_view raw_query, int document_id) const {
-    return MatchDocument(std::execution::seq, raw_query, document_id);
+void SearchServer::RemoveDocument(const std::execution::sequenced_policy&, int document_id) {
+    RemoveDocument(document_id);
+}
+
+void SearchServer::RemoveDocument(const std::execution::parallel_policy&, int document_id) {
+    RemoveDocument(document_id);
 }
 
+void SearchServer::RemoveDocuments(const std::vector<int>& document_ids) {
+    std::unique_lock guard(write_mutex_);
+    std::vector<int> removed_ids;
+    removed_ids.reserve(document_ids.size());
+    for (const int document_id : document_ids) {
+        if (document_ids_.count(document_id) > 0) {
+            removed_ids.push_back(document_id);
+        }
+    }
+    std::sort(removed_ids.begin(), removed_ids.end());
+    removed_ids.erase(std::unique(removed_ids.begin(), removed_ids.end()), removed_ids.end());
+    if (removed_ids.empty()) {
+        return;
+    }
 
-std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::execution::sequenced_policy&, std::string_view raw_query, int document_id) const {
-if (document_ids_.count(document_id) == 0) {
-        return { {}, {} };
+    const uint64_t log_sequence = LogChange([&removed_ids](LogRecordWriter& record) {
+        record.Put(LogOperation::REMOVE_DOCUMENTS);
+        record.Put<uint32_t>(static_cast<uint32_t>(removed_ids.size()));
+        for (const int document_id : removed_ids) {
+            record.Put<int32_t>(document_id);
+        }
+        });
+    for (const int document_id : removed_ids) {
+        document_ids_.erase(document_id);
     }
-    const QuerySet query = ParseQuerySet(raw_query);
+    PublishChange(guard, log_sequence, [&] {
+        RemoveFromIndex(removed_ids, log_sequence);
+        });
+}
 
-    const auto word_checker =
-        [this, document_id](std::string_view word) {
-        const auto it = word_to_document_freqs_.find(word);
-        return it != word_to_document_freqs_.end() && it->second.count(document_id);
-    };
+void SearchServer::RemoveFromIndex(const std::vector<int>& document_ids, uint64_t log_sequence) {
+    bool has_segment_to_compact = false;
+    index_.Update(
+        [&document_ids](IndexState& index) {
+            // Removed documents of sealed segments are counted, the building segment keeps their ids
+            std::map<SegmentId, size_t> removed_document_counts = index.removed_document_counts;
+            size_t building_removal_count = 0;
+            for (const int document_id : document_ids) {
+                const SegmentId segment_id = index.columns.GetSegmentId(document_id);
+                if (index.building_segment && segment_id == index.building_segment->GetId()) {
+                    ++building_removal_count;
+                }
+                else {
+                    ++removed_document_counts[segment_id];
+                }
+                index.columns.Reserve(document_id);
+            }
+            if (building_removal_count > 0) {
+                index.building_segment->ReserveRemovals(building_removal_count);
+            }
+            return removed_document_counts;
+        },
+        [&](IndexState& index, std::map<SegmentId, size_t>& removed_document_counts) {
+            for (const int document_id : document_ids) {
+                EraseDocument(index, document_id);
+            }
+            index.removed_document_counts.swap(removed_document_counts);
+            ++index.corpus_generation;
+            index.log_sequence = log_sequence;
+            has_segment_to_compact = HasSegmentToCompact(index);
+        });
+    if (has_segment_to_compact) {
+        RequestMerge();
+    }
+}
 
-    if (any_of(std::execution::seq,
-        query.minus_words.begin(), query.minus_words.end(),
-        word_checker)) {
-        return { {}, documents_.at(document_id).status };
+void SearchServer::EraseDocument(IndexState& index, int document_id) {
+    const auto document = index.documents.find(document_id);
+    for (const TermId term : document->second.terms) {
+        --index.document_freqs[term];
+    }
+    // The postings are dead without the document and stay until their segment is sealed or rebuilt
+    const SegmentId segment_id = index.columns.GetSegmentId(document_id);
+    if (index.building_segment && segment_id == index.building_segment->GetId()) {
+        index.building_segment->RemoveDocument(document_id);
     }
+    index.documents.erase(document);
+    index.columns.Erase(document_id);
+}
+
+std::vector<int> SearchServer::FindDuplicates() const {
+    return FindDuplicates(std::execution::seq);
+}
 
-    std::vector<std::string_view> matched_words(query.plus_words.size());
-    auto words_end = copy_if(std::execution::seq,
-        query.plus_words.begin(), query.plus_words.end(),
-        matched_words.begin(),
-        word_checker
-    );
-    sort(matched_words.begin(), words_end);
-    words_end = unique(matched_words.begin(), words_end);
-    matched_words.erase(words_end, matched_words.end());
+std::vector<int> SearchServer::FindDuplicates(const std::execution::sequenced_policy&) const {
+    ThreadPool calling_thread(0);
+    return index_.Read([&calling_thread](const IndexState& index) {
+        return FindDuplicateDocuments(calling_thread, GetDocumentTerms(index));
+        });
+}
 
-    return make_tuple(matched_words, documents_.at(document_id).status);
+std::vector<int> SearchServer::FindDuplicates(const std::execution::parallel_policy&) const {
+    const std::shared_ptr<ThreadPool> thread_pool = GetThreadPool();
+    return index_.Read([&thread_pool](const IndexState& index) {
+        return FindDuplicateDocuments(*thread_pool, GetDocumentTerms(index));
+        });
 }
 
+std::vector<int> SearchServer::FindNearDuplicates(double min_similarity, const MinHashOptions& options) const {
+    return FindNearDuplicates(std::execution::seq, min_similarity, options);
+}
 
-std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::execution::parallel_policy&, std::string_view raw_query, int document_id) const {
+std::vector<int> SearchServer::FindNearDuplicates(const std::execution::sequenced_policy&, double min_similarity, const MinHashOptions& options) const {
+    ThreadPool calling_thread(0);
+    return index_.Read([&](const IndexState& index) {
+        return FindNearDuplicateDocuments(calling_thread, GetDocumentTerms(index), min_similarity, options);
+        });
+}
+
+std::vector<int> SearchServer::FindNearDuplicates(const std::execution::parallel_policy&, double min_similarity, const MinHashOptions& options) const {
+    const std::shared_ptr<ThreadPool> thread_pool = GetThreadPool();
+    return index_.Read([&](const IndexState& index) {
+        return FindNearDuplicateDocuments(*thread_pool, GetDocumentTerms(index), min_similarity, options);
+        });
+}
 
-    if (document_word_freqs_.count(document_id) == 0) {
-        throw std::out_of_range("");
+std::vector<DocumentTerms> SearchServer::GetDocumentTerms(const IndexState& index) {
+    std::vector<DocumentTerms> documents;
+    documents.reserve(index.documents.size());
+    for (const auto& [document_id, document_data] : index.documents) {
+        documents.push_back({ document_id, document_data.terms });
     }
-    const auto query = ParseQueryVector(raw_query);
-    const auto& word_freqs = document_word_freqs_.at(document_id);
+    return documents;
+}
 
-    std::vector<std::string_view> matched_words(query.plus_words.size());
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::string_view raw_query, int document_id) const {
+    return MatchDocument(std::execution::seq, raw_query, document_id);
+}
 
-    if (any_of(std::execution::par, query.minus_words.begin(), query.minus_words.end(), [&word_freqs, document_id](const std::string_view word) {return word_freqs.count(word) > 0;}))
-    {
-        return { {}, documents_.at(document_id).status };
-    }
 
-    auto words_end = copy_if(
-        std::execution::par,
-        query.plus_words.begin(), query.plus_words.end(),
-        matched_words.begin(), [&word_freqs](const std::string_view word) {return word_freqs.count(word) > 0;}
-    );
-    sort(std::execution::par, matched_words.begin(), words_end);
-    words_end = unique(std::execution::par, matched_words.begin(), words_end);
-    matched_words.erase(words_end, matched_words.end());
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::execution::sequenced_policy&, std::string_view raw_query, int document_id) const {
+    return index_.Read([&](const IndexState& index) -> std::tuple<std::vector<std::string_view>, DocumentStatus> {
+        if (index.documents.count(document_id) == 0) {
+            return { std::vector<std::string_view>{}, DocumentStatus{} };
+        }
+        const QuerySet query = ParseQuerySet(raw_query);
+        const DocumentData& document_data = index.documents.at(document_id);
 
-    return { matched_words, documents_.at(document_id).status };
+        const auto word_checker =
+            [&index, &terms = document_data.terms](std::string_view word) {
+            const std::optional<TermId> term = FindTerm(index, word);
+            return term && std::binary_search(terms.begin(), terms.end(), *term);
+        };
+
+        if (any_of(std::execution::seq,
+            query.minus_words.begin(), query.minus_words.end(),
+            word_checker)) {
+            return { std::vector<std::string_view>{}, index.columns.GetStatus(document_id) };
+        }
 
+        std::vector<std::string_view> matched_words(query.plus_words.size());
+        auto words_end = copy_if(std::execution::seq,
+            query.plus_words.begin(), query.plus_words.end(),
+            matched_words.begin(),
+            word_checker
+        );
+        sort(matched_words.begin(), words_end);
+        words_end = unique(matched_words.begin(), words_end);
+        matched_words.erase(words_end, matched_words.end());
+
+        return make_tuple(matched_words, index.columns.GetStatus(document_id));
+        });
+}
+
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::execution::parallel_policy&, std::string_view raw_query, int document_id) const {
+    return index_.Read([&](const IndexState& index) -> std::tuple<std::vector<std::string_view>, DocumentStatus> {
+        if (index.documents.count(document_id) == 0) {
+            throw std::out_of_range("");
+        }
+        const auto query = ParseQueryVector(raw_query);
+        const DocumentData& document_data = index.documents.at(document_id);
+        const auto word_checker =
+            [&index, &terms = document_data.terms](std::string_view word) {
+            const std::optional<TermId> term = FindTerm(index, word);
+            return term && std::binary_search(terms.begin(), terms.end(), *term);
+        };
+
+        std::vector<std::string_view> matched_words(query.plus_words.size());
+
+        if (any_of(std::execution::par, query.minus_words.begin(), query.minus_words.end(), word_checker))
+        {
+            return { std::vector<std::string_view>{}, index.columns.GetStatus(document_id) };
+        }
+
+        auto words_end = copy_if(
+            std::execution::par,
+            query.plus_words.begin(), query.plus_words.end(),
+            matched_words.begin(), word_checker
+        );
+        sort(std::execution::par, matched_words.begin(), words_end);
+        words_end = unique(std::execution::par, matched_words.begin(), words_end);
+        matched_words.erase(words_end, matched_words.end());
+
+        return { matched_words, index.columns.GetStatus(document_id) };
+        });
 }
 bool SearchServer::IsStopWord(std::string_view word) const {
     return stop_words_.count(word) > 0;
@@ -187,17 +927,16 @@ bool SearchServer::IsValidWord(std::string_view word) {
         });
 }
 
-std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(std::string_view text) const {
-    std::vector<std::string_view> words;
-    for (const std::string_view word : SplitIntoWords(text)) {
-        if (!IsValidWord(word)) {
+void SearchServer::SplitIntoWordsNoStop(std::string_view text, std::vector<std::string_view>& words) const {
+    words.clear();
+    ForEachWord(text, [this, &words](std::string_view word, bool is_valid) {
+        if (!is_valid) {
             throw std::invalid_argument("Word "s + std::string(word) + " is invalid"s);
         }
         if (!IsStopWord(word)) {
             words.push_back(word);
         }
-    }
-    return words;
+        });
 }
 
 int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
@@ -206,7 +945,7 @@ int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
     return rating_sum / static_cast<int>(ratings.size());
 }
 
-SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) const {
+SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text, bool is_valid) const {
     if (text.empty()) {
         throw std::invalid_argument("Query word is empty"s);
     }
@@ -215,16 +954,17 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) cons
         is_minus = true;
         text = text.substr(1);
     }
-    if (text.empty() || text[0] == '-' || !IsValidWord(text)) {
+    if (text.empty() || text[0] == '-' || !is_valid) {
         throw std::invalid_argument("Query word "s + std::string(text) + " is invalid"s);
     }
     return { text, is_minus, IsStopWord(text) };
 }
 
 SearchServer::QuerySet SearchServer::ParseQuerySet(const std::string_view& text) const {
+    METRICS_PHASE(QUERY_PARSE);
     QuerySet result;
-    for (const std::string_view word : SplitIntoWords(text)) {
-        const auto query_word = ParseQueryWord(word);
+    ForEachWord(text, [this, &result](std::string_view word, bool is_valid) {
+        const auto query_word = ParseQueryWord(word, is_valid);
         if (!query_word.is_stop) {
             if (query_word.is_minus) {
                 result.minus_words.insert(query_word.data);
@@ -233,14 +973,28 @@ SearchServer::QuerySet SearchServer::ParseQuerySet(const std::string_view& text)
                 result.plus_words.insert(query_word.data);
             }
         }
-    }
+        });
     return result;
 }
 
+std::string SearchServer::MakeQueryCacheKey(const QuerySet& query, DocumentStatus status, size_t top_k) {
+    // Words hold no spaces and plus words never start with '-'
+    std::string key;
+    for (const std::string_view word : query.plus_words) {
+        key.append(word).push_back(' ');
+    }
+    for (const std::string_view word : query.minus_words) {
+        key.append("-"s).append(word).push_back(' ');
+    }
+    key.append(std::to_string(static_cast<int>(status))).push_back(' ');
+    key.append(std::to_string(top_k));
+    return key;
+}
+
 SearchServer::QueryVector SearchServer::ParseQueryVector(const std::string_view text) const {
     QueryVector result;
-    for (const std::string_view word : SplitIntoWords(text)) {
-        const auto query_word = ParseQueryWord(word);
+    ForEachWord(text, [this, &result](std::string_view word, bool is_valid) {
+        const auto query_word = ParseQueryWord(word, is_valid);
         if (!query_word.is_stop) {
             if (query_word.is_minus) {
                 result.minus_words.push_back(query_word.data);
@@ -249,10 +1003,369 @@ SearchServer::QueryVector SearchServer::ParseQueryVector(const std::string_view
                 result.plus_words.push_back(query_word.data);
             }
         }
-    }
+        });
     return result;
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(std::string_view word) const {
-    return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
-}
\ No newline at end of file
+
+std::optional<TermId> SearchServer::FindTerm(const IndexState& index, std::string_view word) {
+    const std::optional<TermId> term = index.dictionary.Find(word);
+    // Terms of removed documents stay in the dictionary without live documents
+    if (!term || index.document_freqs[*term] == 0) {
+        return std::nullopt;
+    }
+    return term;
+}
+
+std::vector<TermId> SearchServer::FindTerms(const IndexState& index, const std::set<std::string_view>& words) {
+    std::vector<TermId> terms;
+    terms.reserve(words.size());
+    for (const std::string_view word : words) {
+        if (const std::optional<TermId> term = FindTerm(index, word)) {
+            terms.push_back(*term);
+        }
+    }
+    return terms;
+}
+
+SearchServer::QueryPlan SearchServer::PlanQuery(const IndexState& index, const QuerySet& query) {
+    METRICS_PHASE(QUERY_PLAN);
+    QueryPlan plan;
+    plan.plus_terms = FindTerms(index, query.plus_words);
+    if (plan.plus_terms.empty()) {
+        return plan;
+    }
+    plan.posting_count = CountPostings(index, plan.plus_terms);
+    plan.is_parallel = plan.posting_count >= MIN_PARALLEL_POSTING_COUNT;
+    const std::vector<TermId> minus_terms = FindTerms(index, query.minus_words);
+    for (const IndexSegment* segment : GetSegments(index)) {
+        for (const TermId term : minus_terms) {
+            const PostingList* postings = segment->FindPostings(term);
+            if (!postings) {
+                continue;
+            }
+            for (const int document_id : postings->GetDocumentIds()) {
+                if (index.columns.IsLive(document_id, segment->GetId())) {
+                    plan.excluded_documents.Insert(document_id);
+                }
+            }
+        }
+    }
+    return plan;
+}
+
+std::vector<SearchServer::TermPostings> SearchServer::FindTermPostings(const IndexState& index, const std::vector<TermId>& terms) {
+    const std::vector<const IndexSegment*> segments = GetSegments(index);
+    std::vector<TermPostings> term_postings;
+    for (const TermId term : terms) {
+        const double inverse_document_freq = ComputeTermInverseDocumentFreq(index, term);
+        for (const IndexSegment* segment : segments) {
+            if (const PostingList* postings = segment->FindPostings(term)) {
+                term_postings.push_back({ segment, postings, inverse_document_freq });
+            }
+        }
+    }
+    return term_postings;
+}
+
+size_t SearchServer::CountPostings(const IndexState& index, const std::vector<TermId>& terms) {
+    size_t posting_count = 0;
+    for (const IndexSegment* segment : GetSegments(index)) {
+        for (const TermId term : terms) {
+            if (const PostingList* postings = segment->FindPostings(term)) {
+                posting_count += postings->size();
+            }
+        }
+    }
+    return posting_count;
+}
+
+ScoreAccumulator SearchServer::MakeScoreAccumulator(const IndexState& index, size_t expected_document_count) {
+    const int max_document_id = index.documents.empty() ? -1 : index.documents.rbegin()->first;
+    return ScoreAccumulator(max_document_id, expected_document_count);
+}
+
+double SearchServer::ComputeTermInverseDocumentFreq(const IndexState& index, TermId term) {
+    return index.idf_cache.Get(term, index.corpus_generation, [&index, term] {
+        return log(index.documents.size() * 1.0 / index.document_freqs[term]);
+        });
+}
+
+TermId SearchServer::AssignTerm(const IndexState& index, std::string_view word, DocumentAddition& addition) {
+    if (const std::optional<TermId> term = index.dictionary.Find(word)) {
+        return *term;
+    }
+    const auto [it, inserted] = addition.new_word_terms.emplace(word, static_cast<TermId>(index.dictionary.size() + addition.new_words.size()));
+    if (inserted) {
+        addition.new_words.push_back(word);
+        addition.new_word_chars += word.size();
+    }
+    return it->second;
+}
+
+void SearchServer::AddToIndex(DocumentAddition& addition, uint64_t log_sequence) {
+    // What a copy needs and cannot reserve in place
+    struct PreparedCopy {
+        std::unique_ptr<IndexSegment> building_segment;  // if the copy has none
+        std::map<int, DocumentData> documents;
+    };
+
+    const size_t new_word_count = addition.new_words.size();
+    bool is_segment_full = false;
+    index_.Update(
+        [&addition, new_word_count](IndexState& index) {
+            PreparedCopy prepared;
+            IndexSegment* segment = index.building_segment.get();
+            if (!segment) {
+                prepared.building_segment = std::make_unique<IndexSegment>(index.next_segment_id);
+                segment = prepared.building_segment.get();
+            }
+            segment->Reserve(addition.documents.size(), addition.posting_counts);
+            index.dictionary.Reserve(new_word_count, addition.new_word_chars);
+            GrowCapacity(index.document_freqs, index.dictionary.size() + new_word_count);
+            index.idf_cache.Resize(index.dictionary.size() + new_word_count);
+            for (const AddedDocument& document : addition.documents) {
+                index.columns.Reserve(document.id);
+                prepared.documents.emplace_hint(prepared.documents.end(), document.id, document.data);
+            }
+            return prepared;
+        },
+        [&](IndexState& index, PreparedCopy& prepared) {
+            for (const std::string_view word : addition.new_words) {
+                index.dictionary.Intern(word);
+            }
+            index.document_freqs.resize(index.dictionary.size());
+            if (!index.building_segment) {
+                index.building_segment = std::move(prepared.building_segment);
+                ++index.next_segment_id;
+            }
+            IndexSegment& segment = *index.building_segment;
+            for (const AddedDocument& document : addition.documents) {
+                const DocumentData& document_data = document.data;
+                segment.AddDocument(document.id);
+                for (size_t i = 0; i < document_data.terms.size(); ++i) {
+                    segment.AddPosting(document_data.terms[i], document.id, document_data.term_freqs[i]);
+                    ++index.document_freqs[document_data.terms[i]];
+                }
+                index.columns.Add(document.id, segment.GetId(), document.status, document.rating);
+            }
+            // Moves the nodes, the map does not allocate
+            index.documents.merge(prepared.documents);
+            ++index.corpus_generation;
+            index.log_sequence = log_sequence;
+            is_segment_full = segment.GetDocumentCount() >= index.segment_size;
+        });
+    if (is_segment_full) {
+        // The documents are in the index already. A segment that could not be sealed stays
+        // in memory, the next change that adds documents seals it
+        try {
+            SealBuildingSegment();
+        }
+        catch (const std::bad_alloc&) {
+        }
+    }
+}
+
+SearchServer::DocumentData SearchServer::MakeDocumentData(DocumentTermStorage document_terms) {
+    const auto storage = std::make_shared<const DocumentTermStorage>(std::move(document_terms));
+    return { storage->terms, storage->term_freqs, storage };
+}
+
+void SearchServer::SealBuildingSegment() {
+    // Sealing moves postings into arrays, so a copy of the segment is sealed and both copies
+    // of the index share it
+    std::shared_ptr<IndexSegment> sealed = index_.Read([](const IndexState& index) {
+        return index.building_segment ? std::make_shared<IndexSegment>(*index.building_segment) : nullptr;
+        });
+    if (!sealed) {
+        return;
+    }
+    sealed->Seal();
+
+    size_t sealed_segment_count = 0;
+    index_.Update(
+        [&sealed](IndexState& index) {
+            std::vector<std::shared_ptr<const IndexSegment>> sealed_segments = index.sealed_segments;
+            sealed_segments.push_back(sealed);
+            return sealed_segments;
+        },
+        [&sealed_segment_count](IndexState& index, std::vector<std::shared_ptr<const IndexSegment>>& sealed_segments) {
+            index.sealed_segments.swap(sealed_segments);
+            index.building_segment.reset();
+            sealed_segment_count = index.sealed_segments.size();
+        });
+    if (sealed_segment_count > MAX_SEGMENT_COUNT) {
+        RequestMerge();
+    }
+}
+
+void SearchServer::RequestMerge() {
+    std::lock_guard guard(merge_mutex_);
+    is_merge_requested_ = true;
+    if (!merge_thread_.joinable()) {
+        merge_thread_ = std::thread([this] { RunMerges(); });
+    }
+    merge_condition_.notify_one();
+}
+
+void SearchServer::RunMerges() {
+    std::unique_lock lock(merge_mutex_);
+    while (true) {
+        merge_condition_.wait(lock, [this] { return is_merge_requested_ || is_stopping_; });
+        if (is_stopping_) {
+            return;
+        }
+        is_merge_requested_ = false;
+        lock.unlock();
+        while (MergeSmallestSegments(MAX_SEGMENT_COUNT, MERGE_FACTOR)) {
+        }
+        CompactSegments(index_.Read([](const IndexState& index) { return index.compaction_threshold; }));
+        lock.lock();
+    }
+}
+
+bool SearchServer::MergeSmallestSegments(size_t max_segment_count, size_t merge_factor) {
+    std::lock_guard run_guard(merge_run_mutex_);
+    SegmentRebuild merge;
+    // Sealed segments are immutable, so they are merged outside of the read
+    const bool has_inputs = index_.Read([&](const IndexState& index) {
+        if (index.sealed_segments.size() <= max_segment_count) {
+            return false;
+        }
+        merge.inputs = index.sealed_segments;
+        std::stable_sort(merge.inputs.begin(), merge.inputs.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs->GetDocumentCount() < rhs->GetDocumentCount();
+            });
+        merge.inputs.resize(std::min(merge.inputs.size(), merge_factor));
+        for (const auto& segment : merge.inputs) {
+            merge.live_document_ids.push_back(GetLiveDocumentIds(index, *segment));
+        }
+        return true;
+        });
+    if (!has_inputs) {
+        return false;
+    }
+    RebuildSegments({ std::move(merge) });
+    return true;
+}
+
+bool SearchServer::CompactSegments(double removed_fraction) {
+    std::lock_guard run_guard(merge_run_mutex_);
+    // Every segment is rebuilt on its own, the number of segments stays the same
+    std::vector<SegmentRebuild> compactions;
+    index_.Read([&](const IndexState& index) {
+        for (const auto& segment : index.sealed_segments) {
+            if (IsSegmentToCompact(index, *segment, removed_fraction)) {
+                compactions.push_back({ { segment }, { GetLiveDocumentIds(index, *segment) } });
+            }
+        }
+        });
+    if (compactions.empty()) {
+        return false;
+    }
+    RebuildSegments(compactions);
+    return true;
+}
+
+bool SearchServer::IsSegmentToCompact(const IndexState& index, const IndexSegment& segment, double removed_fraction) {
+    const auto removed_count = index.removed_document_counts.find(segment.GetId());
+    return removed_count != index.removed_document_counts.end() && removed_count->second > 0
+        && static_cast<double>(removed_count->second) >= removed_fraction * static_cast<double>(segment.GetDocumentCount());
+}
+
+bool SearchServer::HasSegmentToCompact(const IndexState& index) {
+    return std::any_of(index.sealed_segments.begin(), index.sealed_segments.end(), [&index](const auto& segment) {
+        return IsSegmentToCompact(index, *segment, index.compaction_threshold);
+        });
+}
+
+void SearchServer::RebuildSegments(const std::vector<SegmentRebuild>& rebuilds) {
+    SegmentId first_id = 0;
+    {
+        std::lock_guard guard(write_mutex_);
+        index_.Update([&first_id, count = rebuilds.size()](IndexState& index) {
+            first_id = index.next_segment_id;
+            index.next_segment_id += static_cast<SegmentId>(count);
+            });
+    }
+    std::vector<std::shared_ptr<const IndexSegment>> outputs(rebuilds.size());
+    GetThreadPool()->ParallelFor(rebuilds.size(), [&](size_t i) {
+        std::vector<const IndexSegment*> segments(rebuilds[i].inputs.size());
+        std::transform(rebuilds[i].inputs.begin(), rebuilds[i].inputs.end(), segments.begin(), [](const auto& segment) { return segment.get(); });
+        outputs[i] = std::make_shared<const IndexSegment>(IndexSegment::Merge(first_id + static_cast<SegmentId>(i), segments, rebuilds[i].live_document_ids));
+        });
+
+    // Documents removed during the rebuild keep their postings in the new segment as dead ones
+    struct PreparedCopy {
+        std::vector<std::shared_ptr<const IndexSegment>> sealed_segments;
+        std::map<SegmentId, size_t> removed_document_counts;
+    };
+
+    std::lock_guard guard(write_mutex_);
+    index_.Update(
+        [&](IndexState& index) {
+            PreparedCopy prepared{ index.sealed_segments, index.removed_document_counts };
+            auto& sealed_segments = prepared.sealed_segments;
+            for (size_t i = 0; i < rebuilds.size(); ++i) {
+                const SegmentRebuild& rebuild = rebuilds[i];
+                size_t removed_count = 0;
+                for (size_t j = 0; j < rebuild.inputs.size(); ++j) {
+                    for (const int document_id : rebuild.live_document_ids[j]) {
+                        if (index.columns.IsLive(document_id, rebuild.inputs[j]->GetId())) {
+                            index.columns.Reserve(document_id);
+                        }
+                        else {
+                            ++removed_count;
+                        }
+                    }
+                    prepared.removed_document_counts.erase(rebuild.inputs[j]->GetId());
+                }
+                sealed_segments.erase(std::remove_if(sealed_segments.begin(), sealed_segments.end(), [&rebuild](const auto& segment) {
+                    return std::find(rebuild.inputs.begin(), rebuild.inputs.end(), segment) != rebuild.inputs.end();
+                    }), sealed_segments.end());
+                if (outputs[i]->GetDocumentCount() > 0) {
+                    sealed_segments.push_back(outputs[i]);
+                    if (removed_count > 0) {
+                        prepared.removed_document_counts[outputs[i]->GetId()] = removed_count;
+                    }
+                }
+            }
+            return prepared;
+        },
+        [&](IndexState& index, PreparedCopy& prepared) {
+            for (size_t i = 0; i < rebuilds.size(); ++i) {
+                const SegmentRebuild& rebuild = rebuilds[i];
+                for (size_t j = 0; j < rebuild.inputs.size(); ++j) {
+                    for (const int document_id : rebuild.live_document_ids[j]) {
+                        if (index.columns.IsLive(document_id, rebuild.inputs[j]->GetId())) {
+                            index.columns.SetSegmentId(document_id, outputs[i]->GetId());
+                        }
+                    }
+                }
+            }
+            index.sealed_segments.swap(prepared.sealed_segments);
+            index.removed_document_counts.swap(prepared.removed_document_counts);
+        });
+}
+
+std::vector<int> SearchServer::GetLiveDocumentIds(const IndexState& index, const IndexSegment& segment) {
+    std::vector<int> document_ids;
+    for (const int document_id : segment.GetDocumentIds()) {
+        if (index.columns.IsLive(document_id, segment.GetId())) {
+            document_ids.push_back(document_id);
+        }
+    }
+    return document_ids;
+}
+
+std::vector<const IndexSegment*> SearchServer::GetSegments(const IndexState& index) {
+    std::vector<const IndexSegment*> segments;
+    segments.reserve(index.sealed_segments.size() + 1);
+    for (const auto& segment : index.sealed_segments) {
+        segments.push_back(segment.get());
+    }
+    if (index.building_segment) {
+        segments.push_back(index.building_segment.get());
+    }
+    return segments;
+}
@@ -2,7 +2,21 @@
 #include "document.h"
 #include "read_input_functions.h"
 #include "string_processing.h"
-#include "concurrent_map.h"
+#include "posting_list.h"
+#include "score_accumulator.h"
+#include "term_dictionary.h"
+#include "idf_cache.h"
+#include "index_segment.h"
+#include "left_right.h"
+#include "thread_pool.h"
+#include "top_documents.h"
+#include "query_cache.h"
+#include "snapshot.h"
+#include "write_ahead_log.h"
+#include "duplicate_detector.h"
+#include "document_columns.h"
+#include "document_bitmap.h"
+#include "metrics.h"
 
 #include <map>
 #include <numeric>
@@ -14,12 +28,79 @@
 #include <cmath>
 #include <future>
 #include <tuple>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <optional>
+#include <exception>
+#include <unordered_map>
+
+using namespace std::string_literals;
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
-constexpr double STANDARD = 1e-6;
 
+struct DocumentToAdd {
+    int id = 0;
+    std::string_view text;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+};
+
+// EXHAUSTIVE scores every posting of every plus word.
+// MAX_SCORE skips documents that cannot get into the top using per-word
+// upper bounds of relevance; it returns the same documents. Picking the next
+// candidate costs O(plus words), so queries with more than four plus words
+// are exhaustive under either strategy
+enum class QueryStrategy {
+    EXHAUSTIVE,
+    MAX_SCORE,
+};
+
+struct PruningStats {
+    uint64_t postings_total = 0;  // postings of plus words in MAX_SCORE queries
+    uint64_t postings_scored = 0;
+};
+
+// A page of FindTopDocumentsPage and the cursor to request the next one with
+struct DocumentPage {
+    std::vector<Document> documents;
+    // Empty when the page is not full, so there are no more documents
+    std::optional<SearchCursor> next;
+};
+
+// The index is split into segments. New documents go to an in-memory segment which is
+// sealed when it holds SetSegmentSize documents; a background thread merges the smallest
+// sealed segments when there are too many of them and drops postings of removed documents.
+// FindTopDocuments, MatchDocument, GetWordFrequencies and GetDocumentCount read a consistent
+// snapshot of the index and never wait for changes, see LeftRight: the index is kept twice,
+// which doubles its memory, and every change is applied to both copies. Changes are serialized.
+// begin() and end() must not be used concurrently with changes
 class SearchServer {
+    // Words of a part of a batch and their frequencies, keyed by word indexes local to the part
+    struct BatchPart {
+        std::unordered_map<std::string_view, uint32_t> word_to_index;
+        std::vector<std::string_view> words;
+        std::vector<uint32_t> document_counts;  // documents of the part per word
+        // Word indexes and term frequencies of every document of the part
+        std::vector<std::vector<std::pair<uint32_t, double>>> document_words;
+        std::exception_ptr error;
+    };
+
 public:
+    // A batch tokenized by PrepareDocuments, it refers to the documents it was prepared from
+    class PreparedDocuments {
+    private:
+        friend class SearchServer;
+
+        std::vector<const DocumentToAdd*> batch_;  // sorted by id
+        std::vector<BatchPart> parts_;
+        size_t part_length_ = 0;
+        std::vector<int> ratings_;
+    };
+
     template <typename StringContainer>
     explicit SearchServer(const StringContainer& stop_words);
 
@@ -27,37 +108,154 @@ public:
 
     explicit SearchServer(std::string_view stop_words_text);
 
+    // Waits for the running merge
+    ~SearchServer();
+
     void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
 
+    // Adds all documents or none of them: throws invalid_argument without changing the index
+    // if any id or word of the batch is invalid
+    void AddDocuments(const std::vector<DocumentToAdd>& documents);
+
+    void AddDocuments(const std::execution::sequenced_policy&, const std::vector<DocumentToAdd>& documents);
+
+    // Tokenizes parts of the batch in parallel and merges their postings into the index
+    void AddDocuments(const std::execution::parallel_policy&, const std::vector<DocumentToAdd>& documents);
+
+    // Tokenizes a batch for AddDocuments(PreparedDocuments) without blocking queries and changes,
+    // so the next batch can be tokenized while the previous one is added. Throws invalid_argument
+    // if any id or word is invalid. The documents must outlive the result
+    PreparedDocuments PrepareDocuments(const std::vector<DocumentToAdd>& documents);
+
+    PreparedDocuments PrepareDocuments(const std::execution::sequenced_policy&, const std::vector<DocumentToAdd>& documents);
+
+    PreparedDocuments PrepareDocuments(const std::execution::parallel_policy&, const std::vector<DocumentToAdd>& documents);
+
+    // Adds all prepared documents or none of them: throws invalid_argument without changing
+    // the index if a document with one of the ids was added after the batch was prepared
+    void AddDocuments(PreparedDocuments documents);
+
+    // top_k limits the number of returned documents. The filter is a predicate of the id, status
+    // and rating, or a RatingRange checked in the rating column. Queries with a predicate never
+    // use the query cache, queries with a status do when it is enabled
     template <typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate, size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
 
     template <typename ExecutionPolicy, typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(const ExecutionPolicy exec_policy, std::string_view raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy exec_policy, std::string_view raw_query, DocumentPredicate document_predicate, size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
 
-    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status, size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
 
     template <typename ExecutionPolicy>
-    std::vector<Document> FindTopDocuments(const ExecutionPolicy exec_policy, std::string_view raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(const ExecutionPolicy exec_policy, std::string_view raw_query, DocumentStatus status, size_t top_k = MAX_RESULT_DOCUMENT_COUNT) const;
 
     std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
 
     template <typename ExecutionPolicy>
     std::vector<Document> FindTopDocuments(const ExecutionPolicy exec_policy, std::string_view raw_query) const;
 
+    // Returns page_size documents that follow the cursor in the order of FindTopDocuments,
+    // the first page without it. Every page is a bounded top of the documents after the cursor,
+    // so a deep page costs as much as the first one. Pages never use the query cache.
+    // The cursor keeps the relevance of its document, which may be removed since. A change of
+    // the corpus moves relevance with the idf, so the next page may skip or repeat documents
+    template <typename DocumentFilter>
+    DocumentPage FindTopDocumentsPage(std::string_view raw_query, DocumentFilter filter, size_t page_size,
+        const std::optional<SearchCursor>& after = std::nullopt) const;
+
+    DocumentPage FindTopDocumentsPage(std::string_view raw_query, size_t page_size,
+        const std::optional<SearchCursor>& after = std::nullopt) const;
+
     int GetDocumentCount() const;
 
+    // MAX_SCORE applies to sequential queries, parallel ones are always exhaustive.
+    // May be called while queries run
+    void SetQueryStrategy(QueryStrategy strategy);
+
+    PruningStats GetPruningStats() const;
+
+    // Number of documents after which the in-memory segment is sealed
+    void SetSegmentSize(size_t document_count);
+
+    // Seals the in-memory segment and merges all segments into one
+    void MergeSegments();
+
+    // Removed documents keep their postings in sealed segments until the segments are rebuilt.
+    // The background merge rebuilds a segment once this fraction of its documents is removed
+    void SetCompactionThreshold(double removed_fraction);
+
+    // Drops postings of all removed documents, segments with them are rebuilt in parallel.
+    // Queries go on, changes wait only while the rebuilt segments are installed
+    void Compact();
+
+    size_t GetSegmentCount() const;
+
+    // Writes stop words, the dictionary, documents, the forward index and the segments
+    // to a binary file, see snapshot.h. Queries go on, changes wait until it is written
+    void SaveSnapshot(const std::string& path) const;
+
+    // Creates a server from a snapshot without tokenizing documents. Postings are read
+    // in place from the mapped file, so processes on a host share their pages
+    static std::unique_ptr<SearchServer> LoadSnapshot(const std::string& path);
+
+    // Replays the changes of the log made after the snapshot the server was loaded from
+    // (all of them for a new server), then writes every change to the log before applying it.
+    // A change is visible to queries only after its record is on disk; a batch of
+    // documents takes one disk sync, and changes of concurrent writers share one.
+    // Must not run concurrently with changes
+    void OpenLog(const std::string& path);
+
+    // Saves a snapshot and empties the log, recovery then replays only later changes
+    void Checkpoint(const std::string& snapshot_path);
+
+    // Replaces the pool that runs parallel queries and batches; queries that already
+    // run finish on the old pool. The default is one worker less than the hardware
+    // threads, the calling thread takes part in the work
+    void SetWorkerCount(size_t worker_count);
+
+    std::shared_ptr<ThreadPool> GetThreadPool() const;
+
+    // Enables the cache of results of queries filtered by status, it keeps up to capacity
+    // results and forgets them when documents are added or removed. 0 disables the cache,
+    // which is the default. Every call starts with an empty cache and zero stats
+    void SetQueryCacheCapacity(size_t capacity);
+
+    QueryCacheStats GetQueryCacheStats() const;
+
     std::set<int>::const_iterator begin() const;
 
     std::set<int>::const_iterator end() const;
 
-    const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+    // Built from the forward index on every call, the map stays valid after the document is removed;
+    // an empty map for an unknown id
+    std::shared_ptr<const std::map<std::string_view, double>> GetWordFrequencies(int document_id) const;
 
     void RemoveDocument(int document_id);
 
     void RemoveDocument(const std::execution::sequenced_policy&, int document_id);
 
-    void RemoveDocument(const std::execution::parallel_policy& pol, int document_id);
+    // The same as without a policy: the words of one document are too few to share the work
+    void RemoveDocument(const std::execution::parallel_policy&, int document_id);
+
+    // Removes the documents in one change, ids that are not in the index are skipped.
+    // Removing is O(number of words of the document), postings are dropped by compaction
+    void RemoveDocuments(const std::vector<int>& document_ids);
+
+    // Returns ids of documents with the same set of words as a document with a smaller id,
+    // in ascending order. Queries go on, changes wait until the documents are read
+    std::vector<int> FindDuplicates() const;
+
+    std::vector<int> FindDuplicates(const std::execution::sequenced_policy&) const;
+
+    std::vector<int> FindDuplicates(const std::execution::parallel_policy&) const;
+
+    // Returns ids of documents whose sets of words have Jaccard similarity of at least
+    // min_similarity with a kept document with a smaller id, see FindNearDuplicateDocuments
+    std::vector<int> FindNearDuplicates(double min_similarity, const MinHashOptions& options = {}) const;
+
+    std::vector<int> FindNearDuplicates(const std::execution::sequenced_policy&, double min_similarity, const MinHashOptions& options = {}) const;
+
+    std::vector<int> FindNearDuplicates(const std::execution::parallel_policy&, double min_similarity, const MinHashOptions& options = {}) const;
 
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
 
@@ -66,32 +264,200 @@ public:
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::execution::parallel_policy&, std::string_view raw_query, int document_id) const;
 
 private:
+    // The forward index: words of a document sorted by term and their frequencies. The arrays
+    // are not copied between the copies of the index, storage keeps them alive: DocumentTermStorage
+    // or a mapped snapshot. Segment, status and rating are in DocumentColumns
     struct DocumentData {
-        int rating;
-        DocumentStatus status;
+        ArrayView<TermId> terms;
+        ArrayView<double> term_freqs;
+        std::shared_ptr<const void> storage;
+    };
+
+    struct DocumentTermStorage {
+        std::vector<TermId> terms;
+        std::vector<double> term_freqs;
     };
-    std::map<std::string, std::pair<std::string, std::string_view>> words_in_docs_;
+
+    struct AddedDocument {
+        int id = 0;
+        DocumentStatus status = DocumentStatus::ACTUAL;
+        int rating = 0;
+        DocumentData data;
+    };
+
+    // Documents of a change and what the index needs for them, built before the index changes
+    struct DocumentAddition {
+        std::vector<AddedDocument> documents;  // in id order
+        // Words that are not in the dictionary, they get the next ids in this order
+        std::vector<std::string_view> new_words;
+        std::unordered_map<std::string_view, TermId> new_word_terms;
+        size_t new_word_chars = 0;
+        // Postings of the documents per term, terms are unique
+        std::vector<std::pair<TermId, size_t>> posting_counts;
+    };
+    static constexpr size_t DEFAULT_SEGMENT_SIZE = 4096;
+    // The background merge starts when there are more sealed segments
+    static constexpr size_t MAX_SEGMENT_COUNT = 8;
+    static constexpr size_t MERGE_FACTOR = 4;
+    static constexpr double DEFAULT_COMPACTION_THRESHOLD = 0.5;
+
+    // Everything queries read. Both copies of LeftRight change in the same way,
+    // sealed segments and the forward index are shared between them
+    struct IndexState {
+        TermDictionary dictionary;
+        std::vector<uint32_t> document_freqs;  // live documents per TermId
+        std::vector<std::shared_ptr<const IndexSegment>> sealed_segments;
+        std::unique_ptr<IndexSegment> building_segment;
+        SegmentId next_segment_id = 1;
+        size_t segment_size = DEFAULT_SEGMENT_SIZE;
+        double compaction_threshold = DEFAULT_COMPACTION_THRESHOLD;
+        // Removed documents whose postings are still in a sealed segment, by segment
+        std::map<SegmentId, size_t> removed_document_counts;
+        std::map<int, DocumentData> documents;
+        // The segment where postings of a document are live, its status and rating
+        DocumentColumns columns;
+        // Incremented by every change of the corpus, invalidates idf_cache
+        uint64_t corpus_generation = 1;
+        // The last change applied, see OpenLog
+        uint64_t log_sequence = 0;
+        mutable IdfCache idf_cache;
+    };
+
     const std::set<std::string, std::less<>> stop_words_;
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, std::map<std::string_view, double>> document_word_freqs_;
-    std::map<int, DocumentData> documents_;
+    LeftRight<IndexState> index_;
+    // Ids for begin() and end(), changed by writers only
     std::set<int> document_ids_;
+    // Set while queries run, relaxed: a query uses either strategy and both return the same documents
+    std::atomic<QueryStrategy> query_strategy_ = QueryStrategy::EXHAUSTIVE;
+    mutable std::atomic<uint64_t> pruning_postings_total_ = 0;
+    mutable std::atomic<uint64_t> pruning_postings_scored_ = 0;
+
+    // Replaced atomically by SetWorkerCount
+    std::shared_ptr<ThreadPool> thread_pool_ = std::make_shared<ThreadPool>(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    // Replaced atomically by SetQueryCacheCapacity, nullptr when disabled
+    std::shared_ptr<QueryResultCache> query_cache_;
+
+    // Serializes changes of the index, including installing merged segments
+    std::mutex write_mutex_;
+    // Serializes merges, segments are built without holding write_mutex_
+    std::mutex merge_run_mutex_;
+    std::mutex merge_mutex_;
+    std::condition_variable merge_condition_;
+    bool is_merge_requested_ = false;
+    bool is_stopping_ = false;
+    std::thread merge_thread_;
+
+    // Changes are written here before they are applied, nullptr until OpenLog
+    std::unique_ptr<WriteAheadLog> log_;
+    // The sequence number of the last change, changed by writers only
+    uint64_t log_sequence_ = 0;
+    // The sequence number of the last change that is in the index or failed, see PublishChange.
+    // Guarded by write_mutex_
+    uint64_t published_sequence_ = 0;
+    std::condition_variable published_condition_;
 
     bool IsStopWord(std::string_view word) const;
 
     static bool IsValidWord(std::string_view word);
 
-    std::vector<std::string_view> SplitIntoWordsNoStop(std::string_view text) const;
+    // Replaces the contents of words, so one buffer serves many documents
+    void SplitIntoWordsNoStop(std::string_view text, std::vector<std::string_view>& words) const;
 
     int ComputeAverageRating(const std::vector<int>& ratings);
 
+    // A single part is tokenized in the calling thread, several parts on the thread pool
+    PreparedDocuments PrepareDocumentBatch(const std::vector<DocumentToAdd>& documents, size_t part_count);
+
+    // Throws invalid_argument if an id is negative, repeated or already added
+    void CheckBatchIds(const std::vector<const DocumentToAdd*>& batch) const;
+
+    // Returns the id of the word, a word that is not in the dictionary gets the next free id
+    static TermId AssignTerm(const IndexState& index, std::string_view word, DocumentAddition& addition);
+
+    // Adds the documents in one change and seals the in-memory segment if it gets full.
+    // The ids must be new
+    void AddToIndex(DocumentAddition& addition, uint64_t log_sequence);
+
+    static DocumentData MakeDocumentData(DocumentTermStorage document_terms);
+
+    // Numbers the change and appends it to the log if there is one, returns the sequence number.
+    // Called by writers before they change the index
+    template <typename WriteRecord>
+    uint64_t LogChange(WriteRecord write_record);
+
+    // Waits until the change is on disk and calls apply() to change the index. write_mutex_ is
+    // released during the sync, so writers that log meanwhile share it, and taken back before
+    // apply() waits for the earlier changes: the index takes changes in log order.
+    // Writers reserve their ids in document_ids_ when they log a change. If the log cannot be
+    // written or apply() throws, the change is never published and the ids are restored
+    template <typename Apply>
+    void PublishChange(std::unique_lock<std::mutex>& guard, uint64_t log_sequence, Apply apply);
+
+    // Rebuilds document_ids_ from the published index
+    void RestoreDocumentIds();
+
+    void ApplyLogRecord(std::string_view payload);
+
+    // Replaces the empty index with the one of the snapshot
+    void LoadIndex(const std::shared_ptr<const SnapshotFile>& snapshot);
+
+    // Moves the in-memory segment to sealed_segments if there is one, the caller holds write_mutex_
+    void SealBuildingSegment();
+
+    // Removes the documents in one change, the ids must be in the index, unique and sorted
+    void RemoveFromIndex(const std::vector<int>& document_ids, uint64_t log_sequence);
+
+    // Does not allocate and does not count the removed document of a sealed segment
+    static void EraseDocument(IndexState& index, int document_id);
+
+    // Terms of all documents in id order, they point into the index
+    static std::vector<DocumentTerms> GetDocumentTerms(const IndexState& index);
+
+    void RequestMerge();
+
+    void RunMerges();
+
+    // Merges up to merge_factor smallest sealed segments if there are more than
+    // max_segment_count of them. Returns false if there was nothing to merge
+    bool MergeSmallestSegments(size_t max_segment_count, size_t merge_factor);
+
+    // Rebuilds every sealed segment where removed documents are at least removed_fraction
+    // of all (and more than none). Returns false if there was nothing to rebuild
+    bool CompactSegments(double removed_fraction);
+
+    static bool IsSegmentToCompact(const IndexState& index, const IndexSegment& segment, double removed_fraction);
+
+    static bool HasSegmentToCompact(const IndexState& index);
+
+    // Sealed segments and the live documents of each of them, sorted by id
+    struct SegmentRebuild {
+        std::vector<std::shared_ptr<const IndexSegment>> inputs;
+        std::vector<std::vector<int>> live_document_ids;
+    };
+
+    // Builds a segment from each group of inputs in parallel and replaces the inputs with
+    // them in one change. Documents removed meanwhile stay dead in the new segments
+    void RebuildSegments(const std::vector<SegmentRebuild>& rebuilds);
+
+    static std::vector<int> GetLiveDocumentIds(const IndexState& index, const IndexSegment& segment);
+
+    // Sealed segments and the in-memory one
+    static std::vector<const IndexSegment*> GetSegments(const IndexState& index);
+
+    // The filter is a DocumentStatus, a RatingRange or a predicate of the id, status and rating.
+    // Statuses and ratings are checked in the columns, only other predicates get the attributes.
+    // Documents that were removed or whose postings in the segment are stale never match
+    template <typename DocumentFilter>
+    static bool IsMatchingDocument(const IndexState& index, int document_id, const IndexSegment& segment, const DocumentFilter& filter);
+
     struct QueryWord {
         std::string_view data;
         bool is_minus;
         bool is_stop;
     };
 
-    QueryWord ParseQueryWord(std::string_view text) const;
+    // is_valid tells if the word has no control characters, the tokenizer checks it
+    QueryWord ParseQueryWord(std::string_view text, bool is_valid) const;
 
     struct QuerySet {
         std::set<std::string_view> plus_words;
@@ -106,14 +472,65 @@ private:
 
     QueryVector ParseQueryVector(const std::string_view text) const;
 
-    // Existence required
-    double ComputeWordInverseDocumentFreq(std::string_view word) const;
+    std::shared_ptr<QueryResultCache> GetQueryCache() const;
+
+    // Equal for queries with the same sets of plus and minus words
+    static std::string MakeQueryCacheKey(const QuerySet& query, DocumentStatus status, size_t top_k);
+
+    static std::optional<TermId> FindTerm(const IndexState& index, std::string_view word);
+
+    // Skips words without postings
+    static std::vector<TermId> FindTerms(const IndexState& index, const std::set<std::string_view>& words);
+
+    static size_t CountPostings(const IndexState& index, const std::vector<TermId>& terms);
+
+    static ScoreAccumulator MakeScoreAccumulator(const IndexState& index, size_t expected_document_count);
+
+    static double ComputeTermInverseDocumentFreq(const IndexState& index, TermId term);
+
+    // With a cursor only the documents after it are selected
+    template <typename ExecutionPolicy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocumentsInIndex(const IndexState& index, const ExecutionPolicy exec_policy, const QuerySet& query, DocumentPredicate document_predicate, size_t top_k,
+        const std::optional<SearchCursor>& after = std::nullopt) const;
 
     template <typename ExecutionPolicy, typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const ExecutionPolicy exec_policy, const QuerySet& query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindAllDocuments(const IndexState& index, const ExecutionPolicy exec_policy, const QuerySet& query, DocumentPredicate document_predicate) const;
 
-    template<typename WordCheckerPlus, typename WordCheckerMinus>
-    void ForEachPar(const QuerySet& query, WordCheckerPlus plus_checker, WordCheckerMinus  minus_checker) const;
+    // Above it MAX_SCORE is slower than EXHAUSTIVE on random queries, with short and long documents alike
+    static constexpr size_t MAX_SCORE_MAX_WORD_COUNT = 4;
+
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocumentsMaxScore(const IndexState& index, const QuerySet& query, DocumentPredicate document_predicate, size_t top_k,
+        const std::optional<SearchCursor>& after) const;
+
+    // Postings of a word in one segment
+    struct TermPostings {
+        const IndexSegment* segment;
+        const PostingList* postings;
+        double inverse_document_freq;
+    };
+
+    // How FindAllDocuments runs a query: words without postings are dropped before any work,
+    // documents with minus words are excluded before scoring instead of erased after it,
+    // and the parallel policy splits the scan only when there are enough postings
+    struct QueryPlan {
+        std::vector<TermId> plus_terms;  // in word order, the order relevance is summed in
+        size_t posting_count = 0;  // of the plus terms
+        DocumentBitmap excluded_documents;  // live documents with minus words
+        bool is_parallel = false;
+    };
+    static constexpr size_t MIN_PARALLEL_POSTING_COUNT = 8192;
+
+    // Minus words are resolved only if the query has plus words with postings
+    static QueryPlan PlanQuery(const IndexState& index, const QuerySet& query);
+
+    // Postings of the terms in scoring order: by term, then by segment
+    static std::vector<TermPostings> FindTermPostings(const IndexState& index, const std::vector<TermId>& terms);
+
+    // Splits the postings into tasks of equal length for thread_pool_, a long posting list
+    // may be scored by several tasks. Every task fills its own accumulator
+    template <typename PostingScorer>
+    ScoreAccumulator AccumulateScoresPar(const IndexState& index, const std::vector<TermPostings>& term_postings, PostingScorer posting_scorer) const;
 };
 
 template <typename StringContainer>
@@ -125,27 +542,88 @@ SearchServer::SearchServer(const StringContainer& stop_words)
     }
 }
 
+template <typename WriteRecord>
+uint64_t SearchServer::LogChange(WriteRecord write_record) {
+    // A change that is not appended takes no sequence number, PublishChange waits for every one
+    const uint64_t log_sequence = log_sequence_ + 1;
+    if (log_) {
+        METRICS_PHASE(INGEST_LOG);
+        LogRecordWriter record;
+        write_record(record);
+        log_->Append(log_sequence, record.GetData());
+    }
+    log_sequence_ = log_sequence;
+    return log_sequence;
+}
+
+template <typename Apply>
+void SearchServer::PublishChange(std::unique_lock<std::mutex>& guard, uint64_t log_sequence, Apply apply) {
+    std::exception_ptr sync_error;
+    if (log_) {
+        WriteAheadLog& log = *log_;
+        guard.unlock();
+        try {
+            METRICS_PHASE(INGEST_SYNC);
+            log.Sync(log_sequence);
+        }
+        catch (...) {
+            sync_error = std::current_exception();
+        }
+        guard.lock();
+    }
+    published_condition_.wait(guard, [this, log_sequence] {
+        return published_sequence_ + 1 == log_sequence;
+        });
+
+    // The next change gets its turn however this one ends
+    struct TurnPass {
+        SearchServer& server;
+        uint64_t log_sequence;
+
+        ~TurnPass() {
+            server.published_sequence_ = log_sequence;
+            server.published_condition_.notify_all();
+        }
+    };
+
+    const TurnPass turn_pass{ *this, log_sequence };
+    try {
+        if (sync_error) {
+            std::rethrow_exception(sync_error);
+        }
+        apply();
+    }
+    catch (...) {
+        RestoreDocumentIds();
+        throw;
+    }
+}
+
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const {
-    return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate, size_t top_k) const {
+    return FindTopDocuments(std::execution::seq, raw_query, document_predicate, top_k);
 }
 
 template <typename ExecutionPolicy, typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy exec_policy, std::string_view raw_query, DocumentPredicate document_predicate) const {
+std::vector<Document> SearchServer::FindTopDocuments(const ExecutionPolicy exec_policy, std::string_view raw_query, DocumentPredicate document_predicate, size_t top_k) const {
     QuerySet query = ParseQuerySet(raw_query);
-    std::vector<Document> matched_documents = FindAllDocuments(exec_policy, query, document_predicate);
-    sort(exec_policy, matched_documents.begin(), matched_documents.end(), [](const Document& lhs, const Document& rhs) {
-        if (std::abs(lhs.relevance - rhs.relevance) < STANDARD) {
-            return lhs.rating > rhs.rating;
-        }
-        else {
-            return lhs.relevance > rhs.relevance;
-        }
+    return index_.Read([&](const IndexState& index) {
+        return FindTopDocumentsInIndex(index, exec_policy, query, document_predicate, top_k);
         });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+}
+
+template <typename DocumentFilter>
+DocumentPage SearchServer::FindTopDocumentsPage(std::string_view raw_query, DocumentFilter filter, size_t page_size,
+    const std::optional<SearchCursor>& after) const {
+    const QuerySet query = ParseQuerySet(raw_query);
+    DocumentPage page;
+    page.documents = index_.Read([&](const IndexState& index) {
+        return FindTopDocumentsInIndex(index, std::execution::seq, query, filter, page_size, after);
+        });
+    if (page_size > 0 && page.documents.size() == page_size) {
+        page.next = SearchCursor(page.documents.back());
     }
-    return matched_documents;
+    return page;
 }
 
 template <typename ExecutionPolicy>
@@ -154,85 +632,273 @@ std::vector<Document> SearchServer::FindTopDocuments(const  ExecutionPolicy exec
 }
 
 template <typename ExecutionPolicy>
-std::vector<Document> SearchServer::FindTopDocuments(const  ExecutionPolicy exec_policy, std::string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(exec_policy, raw_query, [status](int document_id, DocumentStatus statusp, int rating) { return statusp == status; });
+std::vector<Document> SearchServer::FindTopDocuments(const  ExecutionPolicy exec_policy, std::string_view raw_query, DocumentStatus status, size_t top_k) const {
+    const QuerySet query = ParseQuerySet(raw_query);
+    const std::shared_ptr<QueryResultCache> query_cache = GetQueryCache();
+    if (!query_cache) {
+        return index_.Read([&](const IndexState& index) {
+            return FindTopDocumentsInIndex(index, exec_policy, query, status, top_k);
+            });
+    }
+    const std::string key = MakeQueryCacheKey(query, status, top_k);
+    // The epoch is taken from the pinned copy, so a result is stored for the corpus it was computed on
+    return index_.Read([&](const IndexState& index) {
+        if (std::optional<std::vector<Document>> documents = query_cache->Find(key, index.corpus_generation)) {
+            return std::move(*documents);
+        }
+        std::vector<Document> documents = FindTopDocumentsInIndex(index, exec_policy, query, status, top_k);
+        query_cache->Insert(key, index.corpus_generation, documents);
+        return documents;
+        });
 }
 
-template<typename WordCheckerPlus, typename WordCheckerMinus>
-void SearchServer::ForEachPar(const QuerySet& query, WordCheckerPlus plus_checker, WordCheckerMinus minus_checker) const {
-
-    const auto myForeach = [](auto& words, auto& checker) {
-        static constexpr int PART_COUNT = 4;
-        const auto part_length = std::size(words) / PART_COUNT;
-        auto part_begin = words.begin();
-        auto part_end = std::next(part_begin, part_length);
-
-        std::vector<std::future<void>> futures;
-        for (int i = 0;
-            i < PART_COUNT;
-            ++i,
-            part_begin = part_end,
-            part_end = (i == PART_COUNT - 1
-                ? words.end()
-                : std::next(part_begin, part_length))
-            )
-        {
-            futures.push_back(std::async([checker, part_begin, part_end] {
-                std::for_each(part_begin, part_end, checker);
-                }));
+template <typename ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocumentsInIndex(const IndexState& index, const ExecutionPolicy exec_policy, const QuerySet& query, DocumentPredicate document_predicate, size_t top_k,
+    const std::optional<SearchCursor>& after) const {
+    if constexpr (std::is_same_v<ExecutionPolicy, std::execution::sequenced_policy>) {
+        if (query_strategy_.load(std::memory_order_relaxed) == QueryStrategy::MAX_SCORE
+            && query.plus_words.size() <= MAX_SCORE_MAX_WORD_COUNT) {
+            return FindTopDocumentsMaxScore(index, query, document_predicate, top_k, after);
         }
-        return futures;
-    };
+    }
+    const std::vector<Document> matched_documents = FindAllDocuments(index, exec_policy, query, document_predicate);
+    METRICS_PHASE(QUERY_TOP_K);
+    if constexpr (std::is_same_v<ExecutionPolicy, std::execution::parallel_policy>) {
+        return SelectTopDocuments(matched_documents, top_k, after, GetThreadPool().get());
+    }
+    else {
+        return SelectTopDocuments(matched_documents, top_k, after);
+    }
+}
+
+template <typename PostingScorer>
+ScoreAccumulator SearchServer::AccumulateScoresPar(const IndexState& index, const std::vector<TermPostings>& term_postings, PostingScorer posting_scorer) const {
+    static constexpr size_t MIN_TASK_POSTING_COUNT = 4096;
+    static constexpr size_t TASKS_PER_THREAD = 4;
 
-    std::vector<std::future<void>> plusFutures = myForeach(query.plus_words, plus_checker);
-    std::vector<std::future<void>> minusFutures = myForeach(query.minus_words, minus_checker);
+    std::vector<size_t> posting_offsets(term_postings.size() + 1, 0);
+    for (size_t i = 0; i < term_postings.size(); ++i) {
+        posting_offsets[i + 1] = posting_offsets[i] + term_postings[i].postings->size();
+    }
+    const size_t posting_count = posting_offsets.back();
+    const std::shared_ptr<ThreadPool> thread_pool = GetThreadPool();
+    const size_t task_count = std::clamp<size_t>(posting_count / MIN_TASK_POSTING_COUNT, 1, (thread_pool->GetWorkerCount() + 1) * TASKS_PER_THREAD);
+    const size_t task_length = (posting_count + task_count - 1) / task_count;
+
+    std::vector<std::optional<ScoreAccumulator>> accumulators(task_count);
+    METRICS_PHASE_BEGIN(scan_timer, QUERY_SCAN);
+    thread_pool->ParallelFor(task_count, [&](size_t task) {
+        const size_t begin = std::min(posting_count, task * task_length);
+        const size_t end = std::min(posting_count, begin + task_length);
+        ScoreAccumulator accumulator = MakeScoreAccumulator(index, end - begin);
+        size_t i = std::upper_bound(posting_offsets.begin(), posting_offsets.end(), begin) - posting_offsets.begin() - 1;
+        for (; i < term_postings.size() && posting_offsets[i] < end; ++i) {
+            posting_scorer(term_postings[i], std::max(begin, posting_offsets[i]) - posting_offsets[i],
+                std::min(end, posting_offsets[i + 1]) - posting_offsets[i], accumulator);
+        }
+        accumulators[task] = std::move(accumulator);
+        });
 
-    std::for_each(plusFutures.begin(), plusFutures.end(), [](auto& fut) {	fut.wait(); });
-    std::for_each(minusFutures.begin(), minusFutures.end(), [](auto& fut) {	fut.wait(); });
+    METRICS_PHASE_END(scan_timer);
+
+    // Merged in task order, so the result does not depend on scheduling
+    METRICS_PHASE(QUERY_MERGE);
+    ScoreAccumulator result = std::move(*accumulators.front());
+    std::for_each(std::next(accumulators.begin()), accumulators.end(), [&result](const auto& accumulator) { result.Merge(*accumulator); });
+    return result;
 }
 
 
 template <typename ExecutionPolicy, typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const ExecutionPolicy exec_policy, const QuerySet& query, DocumentPredicate document_predicate) const {
-    ConcurrentMap<int, double> document_to_relevance(60);
-
-    const auto plus_word_checker =
-        [this, &document_predicate, &document_to_relevance](std::string_view word) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            return;
-        }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        for (const auto& [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            const auto& document_data = documents_.at(document_id);
-            if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                document_to_relevance[document_id].ref_to_value += static_cast<double>(term_freq * inverse_document_freq);
+std::vector<Document> SearchServer::FindAllDocuments(const IndexState& index, const ExecutionPolicy, const QuerySet& query, DocumentPredicate document_predicate) const {
+    const QueryPlan plan = PlanQuery(index, query);
+    if (plan.plus_terms.empty()) {
+        return {};
+    }
+    // Segments are the inner loop: a document is live in one segment only, so its
+    // relevance is summed in the same order as with a single index
+    const std::vector<TermPostings> term_postings = FindTermPostings(index, plan.plus_terms);
+
+    const auto add_posting_scores =
+        [&index, &document_predicate, &excluded_documents = plan.excluded_documents](const TermPostings& term_postings, size_t begin, size_t end, ScoreAccumulator& document_to_relevance) {
+        const ArrayView<int> document_ids = term_postings.postings->GetDocumentIds();
+        const ArrayView<double> term_freqs = term_postings.postings->GetTermFreqs();
+        for (size_t i = begin; i < end; ++i) {
+            const int document_id = document_ids[i];
+            if (!excluded_documents.Contains(document_id) && IsMatchingDocument(index, document_id, *term_postings.segment, document_predicate)) {
+                document_to_relevance.Add(document_id, term_freqs[i] * term_postings.inverse_document_freq);
             }
         }
+        METRICS_COUNT(QUERY_POSTINGS_SCANNED, end - begin);
     };
 
-    const auto minus_word_checker =
-        [this, &document_predicate, &document_to_relevance](std::string_view word) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            return;
+    ScoreAccumulator document_to_relevance = [&] {
+        if constexpr (!std::is_same_v<ExecutionPolicy, std::execution::sequenced_policy>) {
+            if (plan.is_parallel) {
+                return AccumulateScoresPar(index, term_postings, add_posting_scores);
+            }
         }
-        for (const auto& [document_id, _] : word_to_document_freqs_.at(word)) {
-            document_to_relevance.Erase(document_id);
+        METRICS_PHASE(QUERY_SCAN);
+        ScoreAccumulator accumulator = MakeScoreAccumulator(index, plan.posting_count);
+        for (const TermPostings& postings : term_postings) {
+            add_posting_scores(postings, 0, postings.postings->size(), accumulator);
         }
+        return accumulator;
+    }();
+
+    METRICS_PHASE(QUERY_COLLECT);
+    std::vector<Document> matched_documents;
+    matched_documents.reserve(document_to_relevance.size());
+    document_to_relevance.ForEach([&index, &matched_documents](int document_id, double relevance) {
+        matched_documents.push_back({ document_id, relevance, index.columns.GetRating(document_id) });
+    });
+    METRICS_COUNT(QUERY_DOCUMENTS_MATCHED, matched_documents.size());
+    return matched_documents;
+}
+
+// Document-at-a-time MaxScore. Words are sorted by the upper bound of their contribution;
+// the longest prefix whose bounds sum below the current top threshold is "non-essential":
+// such words alone cannot lift a document into the top, so only documents from
+// the remaining words are candidates, and non-essential postings are probed by binary search.
+// Segments are processed one by one with their own bounds and a common top
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocumentsMaxScore(const IndexState& index, const QuerySet& query, DocumentPredicate document_predicate, size_t top_k,
+    const std::optional<SearchCursor>& after) const {
+    struct TermCursor {
+        ArrayView<int> document_ids;
+        ArrayView<double> term_freqs;
+        size_t pos;
+        double inverse_document_freq;
+        double upper_bound;
+        size_t query_index;  // relevance is summed in query order, as in FindAllDocuments
     };
 
-    if constexpr (std::is_same_v<ExecutionPolicy, std::execution::sequenced_policy>) {
-        std::for_each(exec_policy, query.plus_words.begin(), query.plus_words.end(), plus_word_checker);
-        std::for_each(exec_policy, query.minus_words.begin(), query.minus_words.end(), minus_word_checker);
+    if (top_k == 0) {
+        return {};
     }
-    else {
-        ForEachPar(query, plus_word_checker, minus_word_checker);
+    const QueryPlan plan = PlanQuery(index, query);
+    const std::vector<TermId>& plus_terms = plan.plus_terms;
+    std::vector<double> inverse_document_freqs(plus_terms.size());
+    for (size_t i = 0; i < plus_terms.size(); ++i) {
+        inverse_document_freqs[i] = ComputeTermInverseDocumentFreq(index, plus_terms[i]);
     }
 
-    std::map<int, double> m_doc_to_relevance = document_to_relevance.BuildOrdinaryMap();
+    TopDocuments top(top_k, after);
+    // A document with relevance below the threshold is never more relevant than the worst
+    // one in a full top; the extra STANDARD covers rounding in the bound sums
+    double threshold = 0.0;
+    std::vector<double> contributions(plus_terms.size());
+    uint64_t postings_scored = 0;
+
+    // Scoring and top selection are one pass, timed as the scan
+    METRICS_PHASE(QUERY_SCAN);
+    std::vector<TermCursor> cursors;
+    std::vector<double> prefix_bounds;
+    for (const IndexSegment* segment : GetSegments(index)) {
+        cursors.clear();
+        for (size_t i = 0; i < plus_terms.size(); ++i) {
+            if (const PostingList* postings = segment->FindPostings(plus_terms[i])) {
+                cursors.push_back({ postings->GetDocumentIds(), postings->GetTermFreqs(), 0,
+                    inverse_document_freqs[i], postings->GetMaxTermFreq() * inverse_document_freqs[i], i });
+            }
+        }
+        std::sort(cursors.begin(), cursors.end(), [](const TermCursor& lhs, const TermCursor& rhs) {
+            return lhs.upper_bound < rhs.upper_bound;
+            });
+        prefix_bounds.resize(cursors.size());
+        double bound_sum = 0.0;
+        for (size_t i = 0; i < cursors.size(); ++i) {
+            bound_sum += cursors[i].upper_bound;
+            prefix_bounds[i] = bound_sum;
+        }
+        size_t first_essential = 0;
+        while (top.IsFull() && first_essential < cursors.size() && prefix_bounds[first_essential] < threshold) {
+            ++first_essential;
+        }
 
-    std::vector<Document> matched_documents;
-    for (const auto& [document_id, relevance] : m_doc_to_relevance) {
-        matched_documents.push_back({ document_id, relevance, documents_.at(document_id).rating });
+        while (true) {
+            int document_id = -1;
+            for (size_t i = first_essential; i < cursors.size(); ++i) {
+                const TermCursor& cursor = cursors[i];
+                if (cursor.pos < cursor.document_ids.size() && (document_id < 0 || cursor.document_ids[cursor.pos] < document_id)) {
+                    document_id = cursor.document_ids[cursor.pos];
+                }
+            }
+            if (document_id < 0) {
+                break;
+            }
+
+            std::fill(contributions.begin(), contributions.end(), 0.0);
+            double score_bound = first_essential > 0 ? prefix_bounds[first_essential - 1] : 0.0;
+            for (size_t i = first_essential; i < cursors.size(); ++i) {
+                TermCursor& cursor = cursors[i];
+                if (cursor.pos < cursor.document_ids.size() && cursor.document_ids[cursor.pos] == document_id) {
+                    const double contribution = cursor.term_freqs[cursor.pos] * cursor.inverse_document_freq;
+                    contributions[cursor.query_index] = contribution;
+                    score_bound += contribution;
+                    ++cursor.pos;
+                    ++postings_scored;
+                }
+            }
+
+            if (plan.excluded_documents.Contains(document_id) || !IsMatchingDocument(index, document_id, *segment, document_predicate)) {
+                continue;
+            }
+
+            bool is_pruned = false;
+            for (size_t i = first_essential; i-- > 0;) {
+                if (top.IsFull() && score_bound < threshold) {
+                    is_pruned = true;
+                    break;
+                }
+                TermCursor& cursor = cursors[i];
+                score_bound -= cursor.upper_bound;
+                const ArrayView<int> document_ids = cursor.document_ids;
+                cursor.pos = std::lower_bound(document_ids.begin() + cursor.pos, document_ids.end(), document_id) - document_ids.begin();
+                if (cursor.pos < document_ids.size() && document_ids[cursor.pos] == document_id) {
+                    const double contribution = cursor.term_freqs[cursor.pos] * cursor.inverse_document_freq;
+                    contributions[cursor.query_index] = contribution;
+                    score_bound += contribution;
+                    ++postings_scored;
+                }
+            }
+            if (is_pruned || (top.IsFull() && score_bound < threshold)) {
+                continue;
+            }
+
+            double relevance = 0.0;
+            for (const double contribution : contributions) {
+                relevance += contribution;
+            }
+            top.Push({ document_id, relevance, index.columns.GetRating(document_id) });
+            if (top.IsFull()) {
+                threshold = top.GetWorst().relevance - 2 * STANDARD;
+                while (first_essential < cursors.size() && prefix_bounds[first_essential] < threshold) {
+                    ++first_essential;
+                }
+            }
+        }
+    }
+
+    pruning_postings_total_ += plan.posting_count;
+    pruning_postings_scored_ += postings_scored;
+    METRICS_COUNT(QUERY_POSTINGS_SCANNED, postings_scored);
+    return std::move(top).Extract();
+}
+
+template <typename DocumentFilter>
+bool SearchServer::IsMatchingDocument(const IndexState& index, int document_id, const IndexSegment& segment, const DocumentFilter& filter) {
+    const DocumentColumns& columns = index.columns;
+    if (!columns.IsLive(document_id, segment.GetId())) {
+        return false;
+    }
+    if constexpr (std::is_same_v<DocumentFilter, DocumentStatus>) {
+        return columns.HasStatus(document_id, filter);
+    }
+    else if constexpr (std::is_same_v<DocumentFilter, RatingRange>) {
+        return columns.HasRating(document_id, filter);
+    }
+    else {
+        return filter(document_id, columns.GetStatus(document_id), columns.GetRating(document_id));
     }
-    return matched_documents;
 }
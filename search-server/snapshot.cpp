@@ -0,0 +1,201 @@
+#include "snapshot.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+
+#if defined(_WIN32)
+#define SNAPSHOT_NO_MMAP
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std::string_literals;
+
+namespace {
+
+#ifndef SNAPSHOT_NO_MMAP
+// A rename is durable only once the directory that holds the file is synced
+void SyncDirectory(const std::string& file_path) {
+    std::string directory = std::filesystem::path(file_path).parent_path().string();
+    if (directory.empty()) {
+        directory = "."s;
+    }
+    const int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    const bool is_synced = fd >= 0 && fsync(fd) == 0;
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (!is_synced) {
+        throw std::runtime_error("cannot sync directory "s + directory);
+    }
+}
+#endif
+
+} // namespace
+
+SnapshotWriter::SnapshotWriter(const std::string& path)
+    : path_(path)
+    , temporary_path_(path + ".tmp"s)
+    , out_(temporary_path_, std::ios::binary | std::ios::trunc) {
+    if (!out_) {
+        throw std::runtime_error("cannot create snapshot "s + temporary_path_);
+    }
+    // The header is written last, when section ranges are known
+    out_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+}
+
+void SnapshotWriter::WriteStrings(SnapshotSection offsets_section, SnapshotSection chars_section, const std::vector<std::string_view>& strings) {
+    std::vector<uint64_t> offsets;
+    offsets.reserve(strings.size() + 1);
+    std::string chars;
+    for (const std::string_view text : strings) {
+        offsets.push_back(chars.size());
+        chars.append(text);
+    }
+    offsets.push_back(chars.size());
+    WriteSection(offsets_section, offsets);
+    WriteBytes(chars_section, chars.data(), chars.size());
+}
+
+void SnapshotWriter::Finish(uint64_t next_segment_id, uint64_t segment_size, uint64_t log_sequence) {
+    std::copy(std::begin(SNAPSHOT_MAGIC), std::end(SNAPSHOT_MAGIC), header_.magic);
+    header_.version = SNAPSHOT_VERSION;
+    header_.byte_order = SNAPSHOT_BYTE_ORDER;
+    header_.next_segment_id = next_segment_id;
+    header_.segment_size = segment_size;
+    header_.log_sequence = log_sequence;
+    out_.seekp(0);
+    out_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+    out_.close();
+    if (!out_) {
+        throw std::runtime_error("cannot write snapshot "s + temporary_path_);
+    }
+#ifndef SNAPSHOT_NO_MMAP
+    // The snapshot must be on disk before the log it replaces is truncated
+    const int fd = open(temporary_path_.c_str(), O_RDONLY);
+    const bool is_synced = fd >= 0 && fsync(fd) == 0;
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (!is_synced) {
+        throw std::runtime_error("cannot sync snapshot "s + temporary_path_);
+    }
+#endif
+    if (std::rename(temporary_path_.c_str(), path_.c_str()) != 0) {
+        throw std::runtime_error("cannot replace snapshot "s + path_);
+    }
+#ifndef SNAPSHOT_NO_MMAP
+    SyncDirectory(path_);
+#endif
+}
+
+void SnapshotWriter::WriteBytes(SnapshotSection section, const char* data, size_t size) {
+    static const char padding[SNAPSHOT_ALIGNMENT] = {};
+    const uint64_t offset = static_cast<uint64_t>(out_.tellp());
+    const uint64_t aligned_offset = (offset + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+    out_.write(padding, aligned_offset - offset);
+    out_.write(data, size);
+    header_.sections[static_cast<size_t>(section)] = { aligned_offset, size };
+}
+
+SnapshotFile::SnapshotFile(const std::string& path) {
+#ifdef SNAPSHOT_NO_MMAP
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("cannot open snapshot "s + path);
+    }
+    buffer_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+#else
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("cannot open snapshot "s + path);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        throw std::runtime_error("cannot read snapshot "s + path);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+    if (size_ > 0) {
+        // A shared read-only mapping lets processes on the host share the page cache
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("cannot map snapshot "s + path);
+        }
+        data_ = static_cast<const char*>(data);
+    }
+    close(fd);
+#endif
+    try {
+        Validate();
+    }
+    catch (...) {
+#ifndef SNAPSHOT_NO_MMAP
+        if (data_) {
+            munmap(const_cast<char*>(data_), size_);
+        }
+#endif
+        throw;
+    }
+}
+
+SnapshotFile::~SnapshotFile() {
+#ifndef SNAPSHOT_NO_MMAP
+    if (data_) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+#endif
+}
+
+const SnapshotHeader& SnapshotFile::GetHeader() const {
+    return *reinterpret_cast<const SnapshotHeader*>(data_);
+}
+
+uint64_t SnapshotFile::GetLogSequence() const {
+    return GetHeader().log_sequence;
+}
+
+std::vector<std::string_view> SnapshotFile::GetStrings(SnapshotSection offsets_section, SnapshotSection chars_section) const {
+    const ArrayView<uint64_t> offsets = GetSection<uint64_t>(offsets_section);
+    const ArrayView<char> chars = GetSection<char>(chars_section);
+    if (offsets.empty() || offsets[0] != 0 || offsets.back() != chars.size()
+        || !std::is_sorted(offsets.begin(), offsets.end())) {
+        throw std::invalid_argument("snapshot strings are corrupted"s);
+    }
+    std::vector<std::string_view> strings;
+    strings.reserve(offsets.size() - 1);
+    for (size_t i = 0; i + 1 < offsets.size(); ++i) {
+        strings.emplace_back(chars.data() + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+    return strings;
+}
+
+void SnapshotFile::Validate() const {
+    if (size_ < sizeof(SnapshotHeader)) {
+        throw std::invalid_argument("file is too short for a snapshot"s);
+    }
+    const SnapshotHeader& header = GetHeader();
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+        throw std::invalid_argument("file is not a snapshot"s);
+    }
+    if (header.version != SNAPSHOT_VERSION) {
+        throw std::invalid_argument("unsupported snapshot version "s + std::to_string(header.version));
+    }
+    if (header.byte_order != SNAPSHOT_BYTE_ORDER) {
+        throw std::invalid_argument("snapshot was written with another byte order"s);
+    }
+    for (const SnapshotRange& range : header.sections) {
+        if (range.offset % SNAPSHOT_ALIGNMENT != 0 || range.offset > size_ || range.size > size_ - range.offset) {
+            throw std::invalid_argument("snapshot section is out of the file"s);
+        }
+    }
+}
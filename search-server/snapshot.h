@@ -0,0 +1,155 @@
+#pragma once
+#include "array_view.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Layout of a SearchServer snapshot: a header followed by sections of fixed-size
+// records. Sections start at multiples of SNAPSHOT_ALIGNMENT, so a mapped snapshot
+// can be read in place. Numbers use the byte order of the machine that wrote
+// the snapshot, which is recorded in the header
+constexpr char SNAPSHOT_MAGIC[8] = { 'S', 'R', 'C', 'H', 'S', 'N', 'A', 'P' };
+constexpr uint32_t SNAPSHOT_VERSION = 1;
+constexpr uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+constexpr size_t SNAPSHOT_ALIGNMENT = 64;
+
+enum class SnapshotSection : uint32_t {
+    STOP_WORD_OFFSETS,     // uint64_t, one more than the number of words
+    STOP_WORD_CHARS,       // char
+    TERM_OFFSETS,          // uint64_t, words of the dictionary in TermId order
+    TERM_CHARS,            // char
+    TERM_SLOTS,            // TermDictionary::Slot, the hash table of the words
+    DOCUMENT_FREQS,        // uint32_t, by TermId
+    DOCUMENTS,             // SnapshotDocument, by id
+    DOCUMENT_TERM_IDS,     // uint32_t, the forward index
+    DOCUMENT_TERM_FREQS,   // double
+    COLUMN_PAGE_INDEXES,   // uint64_t, ascending
+    COLUMN_PAGES,          // DocumentColumns::Page
+    SEGMENTS,              // SnapshotSegment
+    SEGMENT_DOCUMENT_IDS,  // int32_t
+    SEGMENT_TERMS,         // SnapshotSegmentTerm
+    POSTING_DOCUMENT_IDS,  // int32_t
+    POSTING_TERM_FREQS,    // double
+    COUNT,
+};
+
+struct SnapshotRange {
+    uint64_t offset = 0;
+    uint64_t size = 0;  // bytes
+};
+
+struct SnapshotHeader {
+    char magic[8] = {};
+    uint32_t version = 0;
+    uint32_t byte_order = 0;
+    uint64_t next_segment_id = 0;
+    uint64_t segment_size = 0;
+    SnapshotRange sections[static_cast<size_t>(SnapshotSection::COUNT)];
+    // The last change of the write-ahead log included in the snapshot
+    uint64_t log_sequence = 0;
+};
+
+// Status, rating and segment of a document are in the column pages
+struct SnapshotDocument {
+    int32_t id;
+    uint32_t padding;
+    uint64_t term_begin;  // in DOCUMENT_TERM_IDS and DOCUMENT_TERM_FREQS, sorted by term
+    uint64_t term_count;
+};
+
+struct SnapshotSegment {
+    uint32_t id;
+    uint32_t padding;
+    uint64_t document_begin;  // in SEGMENT_DOCUMENT_IDS
+    uint64_t document_count;
+    uint64_t term_begin;  // in SEGMENT_TERMS
+    uint64_t term_count;
+    uint64_t removed_document_count;  // documents whose postings are not live
+};
+
+struct SnapshotSegmentTerm {
+    uint32_t term;
+    uint32_t padding;
+    uint64_t posting_begin;  // in POSTING_DOCUMENT_IDS and POSTING_TERM_FREQS
+    uint64_t posting_count;
+    double max_term_freq;
+};
+
+// Writes sections one by one to a temporary file which replaces the snapshot
+// in Finish, so a failed save leaves the previous snapshot intact
+class SnapshotWriter {
+public:
+    // Throws runtime_error if the file cannot be created
+    explicit SnapshotWriter(const std::string& path);
+
+    template <typename T>
+    void WriteSection(SnapshotSection section, const std::vector<T>& records);
+
+    void WriteStrings(SnapshotSection offsets_section, SnapshotSection chars_section, const std::vector<std::string_view>& strings);
+
+    // Writes the header and renames the file, throws runtime_error on I/O errors
+    void Finish(uint64_t next_segment_id, uint64_t segment_size, uint64_t log_sequence);
+
+private:
+    std::string path_;
+    std::string temporary_path_;
+    std::ofstream out_;
+    SnapshotHeader header_;
+
+    void WriteBytes(SnapshotSection section, const char* data, size_t size);
+};
+
+// A snapshot mapped read-only into memory. Pages are loaded on first access and
+// shared by all processes that map the same file. The header and section bounds
+// are checked when the file is opened
+class SnapshotFile {
+public:
+    // Throws runtime_error if the file cannot be read and invalid_argument
+    // if it is not a snapshot of a supported version
+    explicit SnapshotFile(const std::string& path);
+
+    ~SnapshotFile();
+
+    SnapshotFile(const SnapshotFile&) = delete;
+    SnapshotFile& operator=(const SnapshotFile&) = delete;
+
+    const SnapshotHeader& GetHeader() const;
+
+    uint64_t GetLogSequence() const;
+
+    // Throws invalid_argument if the section size is not a multiple of the record size
+    template <typename T>
+    ArrayView<T> GetSection(SnapshotSection section) const;
+
+    // The strings point into the mapped file
+    std::vector<std::string_view> GetStrings(SnapshotSection offsets_section, SnapshotSection chars_section) const;
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    std::vector<char> buffer_;  // holds the file where mmap is not available
+
+    void Validate() const;
+};
+
+template <typename T>
+void SnapshotWriter::WriteSection(SnapshotSection section, const std::vector<T>& records) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    WriteBytes(section, reinterpret_cast<const char*>(records.data()), records.size() * sizeof(T));
+}
+
+template <typename T>
+ArrayView<T> SnapshotFile::GetSection(SnapshotSection section) const {
+    static_assert(std::is_trivially_copyable_v<T>);
+    const SnapshotRange& range = GetHeader().sections[static_cast<size_t>(section)];
+    if (range.size % sizeof(T) != 0) {
+        throw std::invalid_argument("snapshot section has a wrong size");
+    }
+    return { reinterpret_cast<const T*>(data_ + range.offset), static_cast<size_t>(range.size / sizeof(T)) };
+}
@@ -1,17 +1,148 @@
 #include "string_processing.h"
 
+#include <atomic>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TOKENIZER_X86
+#include <immintrin.h>
+#endif
+
+using namespace std::string_literals;
+
+namespace {
+
+TokenizerBlock ScanBlockScalar(const char* data) {
+    TokenizerBlock block{ 0, 0 };
+    for (int i = 0; i < 64; ++i) {
+        const auto c = static_cast<unsigned char>(data[i]);
+        block.spaces |= uint64_t(c == ' ') << i;
+        block.controls |= uint64_t(c < ' ') << i;
+    }
+    return block;
+}
+
+#ifdef TOKENIZER_X86
+__attribute__((target("sse2")))
+TokenizerBlock ScanBlockSse2(const char* data) {
+    const __m128i space = _mm_set1_epi8(' ');
+    // Bytes 0 to 31 are the only ones that stay below 32 after the sign bit is flipped
+    // and compared as signed bytes
+    const __m128i sign = _mm_set1_epi8(static_cast<char>(0x80));
+    const __m128i control_bound = _mm_set1_epi8(static_cast<char>(0x80 + ' '));
+    TokenizerBlock block{ 0, 0 };
+    for (int i = 0; i < 64; i += 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        const auto spaces = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, space)));
+        const auto controls = static_cast<uint32_t>(_mm_movemask_epi8(
+            _mm_cmplt_epi8(_mm_xor_si128(chunk, sign), control_bound)));
+        block.spaces |= uint64_t(spaces) << i;
+        block.controls |= uint64_t(controls) << i;
+    }
+    return block;
+}
+
+__attribute__((target("avx2")))
+TokenizerBlock ScanBlockAvx2(const char* data) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i sign = _mm256_set1_epi8(static_cast<char>(0x80));
+    const __m256i control_bound = _mm256_set1_epi8(static_cast<char>(0x80 + ' '));
+    TokenizerBlock block{ 0, 0 };
+    for (int i = 0; i < 64; i += 32) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        const auto spaces = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, space)));
+        const auto controls = static_cast<uint32_t>(_mm256_movemask_epi8(
+            _mm256_cmpgt_epi8(control_bound, _mm256_xor_si256(chunk, sign))));
+        block.spaces |= uint64_t(spaces) << i;
+        block.controls |= uint64_t(controls) << i;
+    }
+    return block;
+}
+#endif
+
+using ScanBlock = TokenizerBlock (*)(const char*);
+
+ScanBlock GetScanBlock(TokenizerKernel kernel) {
+    switch (kernel) {
+#ifdef TOKENIZER_X86
+    case TokenizerKernel::SSE2:
+        return ScanBlockSse2;
+    case TokenizerKernel::AVX2:
+        return ScanBlockAvx2;
+#endif
+    default:
+        return ScanBlockScalar;
+    }
+}
+
+TokenizerKernel DetectTokenizerKernel() {
+    for (const TokenizerKernel kernel : { TokenizerKernel::AVX2, TokenizerKernel::SSE2 }) {
+        if (IsTokenizerKernelSupported(kernel)) {
+            return kernel;
+        }
+    }
+    return TokenizerKernel::SCALAR;
+}
+
+struct TokenizerDispatch {
+    std::atomic<TokenizerKernel> kernel;
+    std::atomic<ScanBlock> scan_block;
+};
+
+// Initialized on first use, so tokenizing works in constructors of static objects too
+TokenizerDispatch& GetTokenizerDispatch() {
+    static TokenizerDispatch dispatch{ DetectTokenizerKernel(), GetScanBlock(DetectTokenizerKernel()) };
+    return dispatch;
+}
+
+} // namespace
+
 std::vector<std::string_view> SplitIntoWords(std::string_view text) {
     std::vector<std::string_view> result;
-    const int64_t pos_end = text.npos;
-    while (true) {
-        int64_t space = text.find(' ');
-        result.push_back(space == pos_end ? text.substr(0) : text.substr(0, static_cast<size_t>(space)));
-        if (space == pos_end) {
-            break;
-        }
-        else {
-            text.remove_prefix(static_cast<size_t>(space) + 1);
+    SplitIntoWords(text, result);
+    return result;
+}
+
+size_t SplitIntoWords(std::string_view text, std::vector<std::string_view>& words) {
+    words.clear();
+    size_t first_invalid = std::string_view::npos;
+    ForEachWord(text, [&words, &first_invalid](std::string_view word, bool is_valid) {
+        if (!is_valid && first_invalid == std::string_view::npos) {
+            first_invalid = words.size();
         }
+        words.push_back(word);
+    });
+    return first_invalid == std::string_view::npos ? words.size() : first_invalid;
+}
+
+TokenizerBlock ScanTokenizerBlock(const char* data) {
+    return GetTokenizerDispatch().scan_block.load(std::memory_order_relaxed)(data);
+}
+
+TokenizerKernel GetTokenizerKernel() {
+    return GetTokenizerDispatch().kernel.load();
+}
+
+bool IsTokenizerKernelSupported(TokenizerKernel kernel) {
+    switch (kernel) {
+    case TokenizerKernel::SCALAR:
+        return true;
+#ifdef TOKENIZER_X86
+    case TokenizerKernel::SSE2:
+        return __builtin_cpu_supports("sse2");
+    case TokenizerKernel::AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
     }
-    return result;
-}
\ No newline at end of file
+}
+
+void SetTokenizerKernel(TokenizerKernel kernel) {
+    if (!IsTokenizerKernelSupported(kernel)) {
+        throw std::invalid_argument("tokenizer kernel is not supported by the CPU"s);
+    }
+    TokenizerDispatch& dispatch = GetTokenizerDispatch();
+    dispatch.scan_block = GetScanBlock(kernel);
+    dispatch.kernel = kernel;
+}
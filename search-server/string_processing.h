@@ -1,12 +1,51 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
 #include <string>
+#include <string_view>
 #include <set>
 #include <vector>
 #include <iostream>
 
 std::vector<std::string_view> SplitIntoWords(std::string_view text);
 
+// Implementations of the block scan used by ForEachWord
+enum class TokenizerKernel {
+    SCALAR,
+    SSE2,
+    AVX2,
+};
+
+// The fastest kernel the CPU supports, chosen at startup unless SetTokenizerKernel was called
+TokenizerKernel GetTokenizerKernel();
+
+bool IsTokenizerKernelSupported(TokenizerKernel kernel);
+
+// For benchmarks and tests. Throws invalid_argument if the CPU does not support the kernel
+void SetTokenizerKernel(TokenizerKernel kernel);
+
+// Marks spaces and control characters (bytes 0 to 31) of the first 64 bytes of data:
+// bit i of spaces / controls is set if data[i] is one
+struct TokenizerBlock {
+    uint64_t spaces;
+    uint64_t controls;
+};
+
+TokenizerBlock ScanTokenizerBlock(const char* data);
+
+// Calls visitor(word, is_valid) for every word of text in order. Words are the same as
+// SplitIntoWords returns, including empty words between adjacent spaces; is_valid is
+// false if the word has a control character. Separators and control characters are found
+// in one pass over the text, 64 bytes at a time
+template <typename Visitor>
+void ForEachWord(std::string_view text, Visitor visitor);
+
+// Replaces the contents of words with the words of text, so a buffer can be reused.
+// Returns the index of the first word with a control character or words.size() if there is none
+size_t SplitIntoWords(std::string_view text, std::vector<std::string_view>& words);
+
 template <typename StringContainer>
 std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
     std::set<std::string, std::less<>> non_empty_strings;
@@ -18,3 +57,41 @@ std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContain
     }
     return non_empty_strings;
 }
+
+template <typename Visitor>
+void ForEachWord(std::string_view text, Visitor visitor) {
+    static constexpr size_t BLOCK_SIZE = 64;
+
+    const char* const data = text.data();
+    size_t word_begin = 0;
+    // Position after the last control character seen so far
+    size_t valid_from = 0;
+    for (size_t block_begin = 0; block_begin < text.size(); block_begin += BLOCK_SIZE) {
+        TokenizerBlock block;
+        if (text.size() - block_begin >= BLOCK_SIZE) {
+            block = ScanTokenizerBlock(data + block_begin);
+        }
+        else {
+            // The tail is padded with a byte that is neither a space nor a control character
+            char tail[BLOCK_SIZE];
+            std::fill(std::begin(tail), std::end(tail), 'x');
+            std::copy(data + block_begin, data + text.size(), tail);
+            block = ScanTokenizerBlock(tail);
+        }
+        while (block.spaces != 0) {
+            const int bit = __builtin_ctzll(block.spaces);
+            const uint64_t below = (uint64_t(1) << bit) - 1;
+            if (const uint64_t controls = block.controls & below; controls != 0) {
+                valid_from = block_begin + (63 - __builtin_clzll(controls)) + 1;
+            }
+            const size_t word_end = block_begin + bit;
+            visitor(text.substr(word_begin, word_end - word_begin), valid_from <= word_begin);
+            word_begin = word_end + 1;
+            block.spaces &= block.spaces - 1;
+        }
+        if (block.controls != 0) {
+            valid_from = block_begin + (63 - __builtin_clzll(block.controls)) + 1;
+        }
+    }
+    visitor(text.substr(word_begin), valid_from <= word_begin);
+}
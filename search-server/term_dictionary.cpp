@@ -0,0 +1,179 @@
+#include "term_dictionary.h"
+#include "vector_capacity.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+using namespace std::string_literals;
+
+std::string_view StringArena::Store(std::string_view text) {
+    // The empty word of a document with a leading or repeated space needs no block
+    if (text.empty()) {
+        return {};
+    }
+    Reserve(text.size());
+    char* data = blocks_.back().get() + block_used_;
+    std::copy(text.begin(), text.end(), data);
+    block_used_ += text.size();
+    return { data, text.size() };
+}
+
+void StringArena::Reserve(size_t size) {
+    if (block_capacity_ - block_used_ >= size) {
+        return;
+    }
+    const size_t block_capacity = std::max(BLOCK_SIZE, size);
+    blocks_.push_back(std::make_unique<char[]>(block_capacity));
+    block_capacity_ = block_capacity;
+    block_used_ = 0;
+    allocated_bytes_ += block_capacity;
+}
+
+size_t StringArena::GetMemoryUsage() const {
+    return allocated_bytes_ + blocks_.capacity() * sizeof(std::unique_ptr<char[]>);
+}
+
+TermDictionary TermDictionary::MakeView(ArrayView<uint64_t> offsets, ArrayView<char> chars, ArrayView<Slot> slots,
+    std::shared_ptr<const void> storage) {
+    const size_t term_count = offsets.empty() ? 0 : offsets.size() - 1;
+    // Lookups stop at an empty slot, so at most half of the slots are used
+    bool is_valid = !offsets.empty() && offsets[0] == 0 && offsets.back() == chars.size()
+        && std::is_sorted(offsets.begin(), offsets.end())
+        && (slots.size() & (slots.size() - 1)) == 0 && term_count * 2 <= slots.size();
+    size_t used_slot_count = 0;
+    for (const Slot& slot : slots) {
+        if (slot.term != EMPTY_SLOT) {
+            is_valid = is_valid && slot.term < term_count;
+            ++used_slot_count;
+        }
+    }
+    if (!is_valid || used_slot_count != term_count) {
+        throw std::invalid_argument("dictionary is corrupted"s);
+    }
+    TermDictionary dictionary;
+    dictionary.view_offsets_ = offsets;
+    dictionary.view_chars_ = chars;
+    dictionary.view_slots_ = slots;
+    dictionary.view_size_ = term_count;
+    dictionary.storage_ = std::move(storage);
+    return dictionary;
+}
+
+std::vector<TermDictionary::Slot> TermDictionary::BuildSlots(const std::vector<std::string_view>& terms) {
+    size_t slot_count = 16;
+    while (slot_count < terms.size() * 2) {
+        slot_count *= 2;
+    }
+    std::vector<Slot> slots(slot_count);
+    for (TermId term = 0; term < terms.size(); ++term) {
+        InsertSlot(slots, Hash(terms[term]), term);
+    }
+    return slots;
+}
+
+TermId TermDictionary::Intern(std::string_view word) {
+    const uint32_t hash = Hash(word);
+    if (view_size_ > 0) {
+        const Slot& slot = view_slots_[FindSlot(view_slots_, word, hash, [this](TermId term) {
+            return GetTerm(term);
+            })];
+        if (slot.term != EMPTY_SLOT) {
+            return slot.term;
+        }
+    }
+    // Keep the load factor at most 1/2
+    if ((terms_.size() + 1) * 2 > slots_.size()) {
+        Rehash(std::max<size_t>(16, slots_.size() * 2));
+    }
+    Slot& slot = slots_[FindSlot(slots_, word, hash, [this](TermId term) {
+        return terms_[term - view_size_];
+        })];
+    if (slot.term == EMPTY_SLOT) {
+        slot.hash = hash;
+        slot.term = static_cast<TermId>(view_size_ + terms_.size());
+        terms_.push_back(arena_.Store(word));
+    }
+    return slot.term;
+}
+
+void TermDictionary::Reserve(size_t word_count, size_t char_count) {
+    if (word_count == 0) {
+        return;
+    }
+    arena_.Reserve(char_count);
+    GrowCapacity(terms_, terms_.size() + word_count);
+    size_t slot_count = std::max<size_t>(16, slots_.size());
+    while ((terms_.size() + word_count) * 2 > slot_count) {
+        slot_count *= 2;
+    }
+    if (slot_count != slots_.size()) {
+        Rehash(slot_count);
+    }
+}
+
+std::optional<TermId> TermDictionary::Find(std::string_view word) const {
+    const uint32_t hash = Hash(word);
+    if (view_size_ > 0) {
+        const Slot& slot = view_slots_[FindSlot(view_slots_, word, hash, [this](TermId term) {
+            return GetTerm(term);
+            })];
+        if (slot.term != EMPTY_SLOT) {
+            return slot.term;
+        }
+    }
+    if (slots_.empty()) {
+        return std::nullopt;
+    }
+    const Slot& slot = slots_[FindSlot(slots_, word, hash, [this](TermId term) {
+        return terms_[term - view_size_];
+        })];
+    if (slot.term == EMPTY_SLOT) {
+        return std::nullopt;
+    }
+    return slot.term;
+}
+
+std::string_view TermDictionary::GetTerm(TermId term) const {
+    if (term < view_size_) {
+        return { view_chars_.data() + view_offsets_[term], static_cast<size_t>(view_offsets_[term + 1] - view_offsets_[term]) };
+    }
+    return terms_.at(term - view_size_);
+}
+
+size_t TermDictionary::size() const {
+    return view_size_ + terms_.size();
+}
+
+size_t TermDictionary::GetMemoryUsage() const {
+    return arena_.GetMemoryUsage()
+        + terms_.capacity() * sizeof(std::string_view)
+        + slots_.capacity() * sizeof(Slot);
+}
+
+uint32_t TermDictionary::Hash(std::string_view word) {
+    // 32-bit FNV-1a
+    uint32_t hash = 2166136261u;
+    for (const char c : word) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+    }
+    return hash;
+}
+
+void TermDictionary::InsertSlot(std::vector<Slot>& slots, uint32_t hash, TermId term) {
+    const size_t mask = slots.size() - 1;
+    size_t pos = hash & mask;
+    while (slots[pos].term != EMPTY_SLOT) {
+        pos = (pos + 1) & mask;
+    }
+    slots[pos] = { hash, term };
+}
+
+void TermDictionary::Rehash(size_t slot_count) {
+    // The table is replaced only when the new one is complete
+    std::vector<Slot> slots(slot_count);
+    for (size_t i = 0; i < terms_.size(); ++i) {
+        InsertSlot(slots, Hash(terms_[i]), static_cast<TermId>(view_size_ + i));
+    }
+    slots_.swap(slots);
+}
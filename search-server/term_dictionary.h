@@ -0,0 +1,108 @@
+#pragma once
+#include "array_view.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+using TermId = uint32_t;
+
+// Append-only storage for strings. Stored strings never move,
+// so string_views returned by Store stay valid for the arena lifetime
+class StringArena {
+public:
+    std::string_view Store(std::string_view text);
+
+    // Makes room for size chars, so that storing strings of that total length does not allocate
+    void Reserve(size_t size);
+
+    size_t GetMemoryUsage() const;
+
+private:
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    size_t block_used_ = 0;
+    size_t block_capacity_ = 0;
+    size_t allocated_bytes_ = 0;
+};
+
+// Maps each distinct word to a dense id. Every word is stored once in the arena,
+// lookups go through an open addressing hash table with linear probing.
+// The words of a snapshot are served from the mapped file: they keep their ids
+// and their table, and only words added later go to the arena
+class TermDictionary {
+public:
+    static constexpr TermId EMPTY_SLOT = UINT32_MAX;
+
+    // A cell of the hash table, stored as is in snapshots
+    struct Slot {
+        uint32_t hash = 0;
+        TermId term = EMPTY_SLOT;
+    };
+
+    TermDictionary() = default;
+
+    // Words [0, offsets.size() - 1) are chars[offsets[i], offsets[i + 1]), slots is their table
+    // from BuildSlots. The arrays are not copied and storage keeps them alive.
+    // Throws invalid_argument if the arrays do not describe a dictionary
+    static TermDictionary MakeView(ArrayView<uint64_t> offsets, ArrayView<char> chars, ArrayView<Slot> slots,
+        std::shared_ptr<const void> storage);
+
+    // The hash table of the words, terms[i] gets id i
+    static std::vector<Slot> BuildSlots(const std::vector<std::string_view>& terms);
+
+    // Returns the id of the word, adding it to the dictionary if needed
+    TermId Intern(std::string_view word);
+
+    // Makes room for word_count new words of char_count chars in total, so that Intern adds them
+    // without allocating. The words stay the same
+    void Reserve(size_t word_count, size_t char_count);
+
+    std::optional<TermId> Find(std::string_view word) const;
+
+    std::string_view GetTerm(TermId term) const;
+
+    size_t size() const;
+
+    // Mapped words are not counted, their pages belong to the page cache
+    size_t GetMemoryUsage() const;
+
+private:
+    // Words of a snapshot
+    ArrayView<uint64_t> view_offsets_;
+    ArrayView<char> view_chars_;
+    ArrayView<Slot> view_slots_;
+    size_t view_size_ = 0;
+    std::shared_ptr<const void> storage_;
+
+    // Words added later, their ids start at view_size_
+    StringArena arena_;
+    std::vector<std::string_view> terms_;
+    std::vector<Slot> slots_;
+
+    // Does not depend on the standard library, since tables are stored in snapshots
+    static uint32_t Hash(std::string_view word);
+
+    // Returns the slot of the word or the empty slot where it belongs; slots.size() is a power of two
+    template <typename GetWord>
+    static size_t FindSlot(ArrayView<Slot> slots, std::string_view word, uint32_t hash, GetWord get_word);
+
+    static void InsertSlot(std::vector<Slot>& slots, uint32_t hash, TermId term);
+
+    void Rehash(size_t slot_count);
+};
+
+template <typename GetWord>
+size_t TermDictionary::FindSlot(ArrayView<Slot> slots, std::string_view word, uint32_t hash, GetWord get_word) {
+    const size_t mask = slots.size() - 1;
+    for (size_t pos = hash & mask;; pos = (pos + 1) & mask) {
+        const Slot& slot = slots[pos];
+        if (slot.term == EMPTY_SLOT || (slot.hash == hash && get_word(slot.term) == word)) {
+            return pos;
+        }
+    }
+}
@@ -1,7 +1,104 @@
 #include "test_example_functions.h"
+#include "corpus_loader.h"
+#include "left_right.h"
+#include "string_processing.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <new>
+#include <random>
+#include <thread>
 
 using namespace std::string_literals;
 
+namespace {
+
+using TokenizedWords = std::vector<std::pair<std::string_view, bool>>;
+
+TokenizedWords Tokenize(std::string_view text) {
+    TokenizedWords words;
+    ForEachWord(text, [&words](std::string_view word, bool is_valid) {
+        words.emplace_back(word, is_valid);
+        });
+    return words;
+}
+
+// SplitIntoWords and SearchServer::IsValidWord as they were before the block scan
+TokenizedWords TokenizeAsBaseline(std::string_view text) {
+    TokenizedWords words;
+    const int64_t pos_end = text.npos;
+    while (true) {
+        int64_t space = text.find(' ');
+        const std::string_view word = space == pos_end ? text.substr(0) : text.substr(0, static_cast<size_t>(space));
+        words.emplace_back(word, std::none_of(word.begin(), word.end(), [](char c) {
+            return c >= '\0' && c < ' ';
+            }));
+        if (space == pos_end) {
+            break;
+        }
+        else {
+            text.remove_prefix(static_cast<size_t>(space) + 1);
+        }
+    }
+    return words;
+}
+
+bool IsSameRelevance(double lhs, double rhs) {
+    return std::abs(lhs - rhs) < 1e-9;
+}
+
+std::vector<int> GetIds(const std::vector<Document>& documents) {
+    std::vector<int> ids;
+    for (const Document& document : documents) {
+        ids.push_back(document.id);
+    }
+    return ids;
+}
+
+void AssertSameResult(const std::vector<Document>& lhs, const std::vector<Document>& rhs) {
+    assert(lhs.size() == rhs.size());
+    for (size_t i = 0; i < lhs.size(); ++i) {
+        assert(lhs[i].id == rhs[i].id && lhs[i].relevance == rhs[i].relevance && lhs[i].rating == rhs[i].rating);
+    }
+}
+
+std::vector<int> GetIds(const SearchServer& search_server) {
+    return std::vector<int>(search_server.begin(), search_server.end());
+}
+
+std::vector<std::vector<Document>> RunQueries(const SearchServer& search_server, const std::vector<std::string>& queries) {
+    std::vector<std::vector<Document>> results;
+    results.reserve(queries.size());
+    for (const std::string& query : queries) {
+        results.push_back(search_server.FindTopDocuments(query));
+    }
+    return results;
+}
+
+// A clock for RequestQueue that moves by a microsecond on every call, so every request takes one
+RequestQueue::Clock::time_point fake_time;
+
+RequestQueue::Clock::time_point TickFakeClock() {
+    fake_time += std::chrono::microseconds(1);
+    return fake_time;
+}
+
+void AssertSameResults(const std::vector<std::vector<Document>>& lhs, const std::vector<std::vector<Document>>& rhs) {
+    assert(lhs.size() == rhs.size());
+    for (size_t i = 0; i < lhs.size(); ++i) {
+        AssertSameResult(lhs[i], rhs[i]);
+    }
+}
+
+} // namespace
+
 void AddDocument(SearchServer& search_server, int document_id, std::string_view document, DocumentStatus status,
     const std::vector<int>& ratings) {
     try {
@@ -39,4 +136,776 @@ void MatchDocuments(const SearchServer& search_server, std::string_view query) {
     catch (const std::invalid_argument& e) {
         std::cout << "Error in matchig request "s << query << ": "s << e.what() << std::endl;
     }
-}
\ No newline at end of file
+}
+
+void TestTokenizerKernels() {
+    // Short texts of spaces, control characters and bytes above 127 around 64-byte block bounds
+    std::mt19937 generator;
+    static constexpr char FUZZ_BYTES[] = { 'a', 'b', '-', ' ', ' ', '\0', '\t', '\x1f', '\x7f', '\x80', '\xff' };
+    std::vector<std::string> texts(2'000);
+    for (std::string& text : texts) {
+        text.resize(std::uniform_int_distribution<size_t>(0, 200)(generator));
+        for (char& c : text) {
+            c = FUZZ_BYTES[std::uniform_int_distribution<size_t>(0, std::size(FUZZ_BYTES) - 1)(generator)];
+        }
+    }
+    std::vector<TokenizedWords> expected;
+    for (const std::string& text : texts) {
+        expected.push_back(TokenizeAsBaseline(text));
+    }
+
+    const TokenizerKernel default_kernel = GetTokenizerKernel();
+    for (const TokenizerKernel kernel : { TokenizerKernel::SCALAR, TokenizerKernel::SSE2, TokenizerKernel::AVX2 }) {
+        if (!IsTokenizerKernelSupported(kernel)) {
+            continue;
+        }
+        SetTokenizerKernel(kernel);
+        assert((Tokenize("cat  d\tg"s) == TokenizedWords{ { "cat", true }, { "", true }, { "d\tg", false } }));
+        for (size_t i = 0; i < texts.size(); ++i) {
+            assert(Tokenize(texts[i]) == expected[i]);
+        }
+    }
+    SetTokenizerKernel(default_kernel);
+}
+
+void TestMaxScoreStrategy() {
+    SearchServer search_server(""s);
+    search_server.AddDocument(1, "cat common"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "cat cat dog"s, DocumentStatus::ACTUAL, { 2 });
+    search_server.AddDocument(3, "dog common"s, DocumentStatus::ACTUAL, { 3 });
+    for (int id = 4; id <= 10; ++id) {
+        search_server.AddDocument(id, "common bird"s, DocumentStatus::ACTUAL, { id });
+    }
+    const double rare_score = std::log(5.0) / 2;
+    const double common_score = std::log(10.0 / 9.0) / 2;
+
+    for (const QueryStrategy strategy : { QueryStrategy::EXHAUSTIVE, QueryStrategy::MAX_SCORE }) {
+        search_server.SetQueryStrategy(strategy);
+        const PruningStats stats_before = search_server.GetPruningStats();
+        // Documents 1 and 3 tie on relevance and are ordered by rating
+        std::vector<Document> documents = search_server.FindTopDocuments("cat dog common"s, DocumentStatus::ACTUAL, 3);
+        assert((GetIds(documents) == std::vector<int>{ 2, 3, 1 }));
+        assert(IsSameRelevance(documents[0].relevance, std::log(5.0)));
+        assert(IsSameRelevance(documents[1].relevance, rare_score + common_score));
+        assert(IsSameRelevance(documents[2].relevance, rare_score + common_score));
+        const PruningStats stats = search_server.GetPruningStats();
+        if (strategy == QueryStrategy::MAX_SCORE) {
+            // Once the top is full, "common" cannot lift a document into it
+            assert(stats.postings_scored - stats_before.postings_scored < stats.postings_total - stats_before.postings_total);
+        }
+
+        documents = search_server.FindTopDocuments("cat dog common -cat"s, DocumentStatus::ACTUAL, 3);
+        assert((GetIds(documents) == std::vector<int>{ 3, 10, 9 }));
+        assert(IsSameRelevance(documents[0].relevance, rare_score + common_score));
+        assert(IsSameRelevance(documents[1].relevance, common_score) && IsSameRelevance(documents[2].relevance, common_score));
+
+        documents = search_server.FindTopDocuments("cat bird"s, [](int document_id, DocumentStatus, int) {
+            return document_id % 2 == 1;
+            });
+        assert((GetIds(documents) == std::vector<int>{ 1, 9, 7, 5 }));
+        assert(IsSameRelevance(documents[0].relevance, rare_score));
+        assert(IsSameRelevance(documents[1].relevance, std::log(10.0 / 7.0) / 2));
+
+        // Queries with more than four plus words are exhaustive and skip nothing
+        const PruningStats stats_before_long = search_server.GetPruningStats();
+        documents = search_server.FindTopDocuments("cat dog common bird fish"s, DocumentStatus::ACTUAL, 3);
+        assert((GetIds(documents) == std::vector<int>{ 2, 3, 1 }));
+        const PruningStats stats_after_long = search_server.GetPruningStats();
+        assert(stats_after_long.postings_total == stats_before_long.postings_total);
+        assert(stats_after_long.postings_scored == stats_before_long.postings_scored);
+    }
+}
+
+void TestQueryCache() {
+    SearchServer search_server("and"s);
+    search_server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "black cat and cat"s, DocumentStatus::ACTUAL, { 2 });
+    search_server.AddDocument(3, "dog"s, DocumentStatus::ACTUAL, { 3 });
+    search_server.SetQueryCacheCapacity(16);
+
+    const std::vector<Document> documents = search_server.FindTopDocuments("cat"s);
+    assert((GetIds(documents) == std::vector<int>{ 2, 1 }));
+    assert(IsSameRelevance(documents[0].relevance, std::log(1.5) * 2 / 3) && IsSameRelevance(documents[1].relevance, std::log(1.5) / 2));
+    assert(search_server.GetQueryCacheStats().hits == 0 && search_server.GetQueryCacheStats().misses == 1);
+    AssertSameResult(documents, search_server.FindTopDocuments("cat"s));
+    // The same words in another order and with stop words are the same query
+    AssertSameResult(documents, search_server.FindTopDocuments("cat and cat"s));
+    assert(search_server.GetQueryCacheStats().hits == 2 && search_server.GetQueryCacheStats().misses == 1);
+    // Another status or top is another query
+    assert(search_server.FindTopDocuments("cat"s, DocumentStatus::BANNED).empty());
+    assert((GetIds(search_server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, 1)) == std::vector<int>{ 2 }));
+    assert(search_server.GetQueryCacheStats().hits == 2 && search_server.GetQueryCacheStats().misses == 3);
+
+    // A change makes the cached results stale
+    search_server.RemoveDocument(2);
+    const std::vector<Document> changed_documents = search_server.FindTopDocuments("cat"s);
+    assert((GetIds(changed_documents) == std::vector<int>{ 1 }));
+    assert(IsSameRelevance(changed_documents[0].relevance, std::log(2.0) / 2));
+    assert(search_server.GetQueryCacheStats().misses == 4);
+
+    search_server.SetQueryCacheCapacity(0);
+    AssertSameResult(changed_documents, search_server.FindTopDocuments("cat"s));
+    assert(search_server.GetQueryCacheStats().hits == 0 && search_server.GetQueryCacheStats().misses == 0);
+}
+
+void TestSnapshotRoundTrip() {
+    const std::string path = (std::filesystem::temp_directory_path() / "search_server_test.snapshot").string();
+    {
+        SearchServer search_server("and"s);
+        // Two sealed segments and the in-memory one
+        search_server.SetSegmentSize(2);
+        search_server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, { 1, 3 });
+        search_server.AddDocument(2, "black dog and cat"s, DocumentStatus::BANNED, { 5 });
+        search_server.AddDocument(3, "grey dog"s, DocumentStatus::ACTUAL, { -1 });
+        search_server.AddDocument(4, "dog"s, DocumentStatus::ACTUAL, { 4 });
+        search_server.AddDocument(5, "white bird"s, DocumentStatus::ACTUAL, { 5 });
+        search_server.RemoveDocument(4);
+        search_server.SaveSnapshot(path);
+    }
+
+    const std::unique_ptr<SearchServer> search_server = SearchServer::LoadSnapshot(path);
+    assert((GetIds(*search_server) == std::vector<int>{ 1, 2, 3, 5 }));
+    std::vector<Document> documents = search_server->FindTopDocuments("dog"s);
+    assert((GetIds(documents) == std::vector<int>{ 3 }));
+    assert(IsSameRelevance(documents[0].relevance, std::log(2.0) / 2) && documents[0].rating == -1);
+    // Stop words come with the snapshot
+    documents = search_server->FindTopDocuments("cat and"s, DocumentStatus::BANNED);
+    assert((GetIds(documents) == std::vector<int>{ 2 }));
+    assert(IsSameRelevance(documents[0].relevance, std::log(2.0) / 3) && documents[0].rating == 5);
+    const std::string query = "cat dog -grey"s;
+    const auto [words, status] = search_server->MatchDocument(query, 2);
+    assert((words == std::vector<std::string_view>{ "cat", "dog" }) && status == DocumentStatus::BANNED);
+    assert((*search_server->GetWordFrequencies(1) == std::map<std::string_view, double>{ { "cat", 0.5 }, { "white", 0.5 } }));
+
+    // The loaded server takes changes
+    search_server->AddDocument(4, "white dog"s, DocumentStatus::ACTUAL, { 4 });
+    search_server->RemoveDocument(1);
+    documents = search_server->FindTopDocuments("white"s);
+    assert((GetIds(documents) == std::vector<int>{ 5, 4 }));
+    assert(IsSameRelevance(documents[0].relevance, std::log(2.0) / 2));
+    std::filesystem::remove(path);
+
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << "not a snapshot"s;
+    }
+    bool is_rejected = false;
+    try {
+        SearchServer::LoadSnapshot(path);
+    }
+    catch (const std::invalid_argument&) {
+        is_rejected = true;
+    }
+    assert(is_rejected);
+    std::filesystem::remove(path);
+}
+
+void TestDocumentRemoval() {
+    SearchServer search_server("and"s);
+    // Removed documents stay in the postings of sealed segments until the explicit compaction
+    search_server.SetSegmentSize(2);
+    search_server.SetCompactionThreshold(1.0);
+    const std::vector<std::string> texts = { "white cat"s, "black cat"s, "grey dog"s, "white dog"s, "cat and dog"s, "black bird"s };
+    for (int id = 1; id <= 6; ++id) {
+        search_server.AddDocument(id, texts[id - 1], DocumentStatus::ACTUAL, { id });
+    }
+
+    search_server.RemoveDocument(2);
+    search_server.RemoveDocument(std::execution::par, 6);
+    // Unknown and repeated ids are skipped
+    search_server.RemoveDocuments({ 4, 9, 4 });
+    assert((GetIds(search_server) == std::vector<int>{ 1, 3, 5 }));
+    assert(search_server.GetWordFrequencies(2)->empty());
+    // Ties on relevance are ordered by rating
+    std::vector<Document> documents = search_server.FindTopDocuments("cat"s);
+    assert((GetIds(documents) == std::vector<int>{ 5, 1 }));
+    assert(IsSameRelevance(documents[0].relevance, std::log(1.5) / 2) && IsSameRelevance(documents[1].relevance, std::log(1.5) / 2));
+    documents = search_server.FindTopDocuments("white dog -grey"s);
+    assert((GetIds(documents) == std::vector<int>{ 1, 5 }));
+    assert(IsSameRelevance(documents[0].relevance, std::log(3.0) / 2) && IsSameRelevance(documents[1].relevance, std::log(1.5) / 2));
+    assert(search_server.FindTopDocuments("black"s).empty());
+
+    // A removed id takes a new document, the old postings of the id stay dead
+    search_server.AddDocument(2, "black bird"s, DocumentStatus::ACTUAL, { 2 });
+    const auto check_readded = [](const SearchServer& server) {
+        assert((GetIds(server) == std::vector<int>{ 1, 2, 3, 5 }));
+        const std::vector<Document> cat_documents = server.FindTopDocuments("cat"s);
+        assert((GetIds(cat_documents) == std::vector<int>{ 5, 1 }));
+        assert(IsSameRelevance(cat_documents[0].relevance, std::log(2.0) / 2));
+        const std::vector<Document> black_documents = server.FindTopDocuments("black"s);
+        assert((GetIds(black_documents) == std::vector<int>{ 2 }));
+        assert(IsSameRelevance(black_documents[0].relevance, std::log(4.0) / 2));
+    };
+    check_readded(search_server);
+    search_server.Compact();
+    check_readded(search_server);
+}
+
+void TestLeftRightUpdates() {
+    LeftRight<std::vector<int>> values;
+    const auto read = [&values] {
+        return values.Read([](const std::vector<int>& copy) { return copy; });
+    };
+    const auto push_back = [&values](int value) {
+        values.Update(
+            [](std::vector<int>& copy) {
+                copy.reserve(copy.size() + 1);
+                return 0;
+            },
+            [value](std::vector<int>& copy, int) {
+                copy.push_back(value);
+            });
+    };
+
+    // The second prepare runs after readers moved to the first prepared copy, its failure changes neither
+    int prepare_count = 0;
+    try {
+        values.Update(
+            [&prepare_count](std::vector<int>& copy) {
+                if (++prepare_count == 2) {
+                    throw std::bad_alloc();
+                }
+                copy.reserve(1);
+                return 0;
+            },
+            [](std::vector<int>& copy, int) {
+                copy.push_back(0);
+            });
+        assert(false);
+    }
+    catch (const std::bad_alloc&) {
+    }
+    assert(read().empty());
+
+    // Readers end on the other copy after an update without prepare, so both copies are checked
+    const auto increment = [&values] {
+        values.Update([](std::vector<int>& copy) {
+            for (int& value : copy) {
+                ++value;
+            }
+            });
+    };
+    push_back(1);
+    assert((read() == std::vector<int>{ 1 }));
+    increment();
+    assert((read() == std::vector<int>{ 2 }));
+    push_back(3);
+    assert((read() == std::vector<int>{ 2, 3 }));
+    increment();
+    assert((read() == std::vector<int>{ 3, 4 }));
+}
+
+void TestEmptyWordsInDocument() {
+    SearchServer search_server("and"s);
+    // Leading, repeated and trailing spaces give empty words, which are indexed as in the baseline
+    search_server.AddDocument(1, " cat  dog"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "dog and "s, DocumentStatus::ACTUAL, { 2 });
+
+    const std::vector<Document> documents = search_server.FindTopDocuments("cat"s);
+    assert(documents.size() == 1);
+    assert(documents[0].id == 1 && IsSameRelevance(documents[0].relevance, std::log(2.0) / 4));
+    const std::string query = "dog cat"s;
+    const auto [words, status] = search_server.MatchDocument(query, 1);
+    assert((words == std::vector<std::string_view>{ "cat", "dog" }) && status == DocumentStatus::ACTUAL);
+    assert(search_server.GetWordFrequencies(2)->count(""s) == 1);
+}
+
+void TestTopKLimits() {
+    SearchServer search_server(""s);
+    search_server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "black cat cat"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(3, "cat"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(4, "dog"s, DocumentStatus::ACTUAL, { 1 });
+    const double inverse_document_freq = std::log(4.0 / 3.0);
+
+    for (const QueryStrategy strategy : { QueryStrategy::EXHAUSTIVE, QueryStrategy::MAX_SCORE }) {
+        search_server.SetQueryStrategy(strategy);
+        assert(search_server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, 0).empty());
+        assert((GetIds(search_server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, 2)) == std::vector<int>{ 3, 2 }));
+        // A top larger than the number of matches, up to the largest size_t, returns all of them
+        for (const size_t top_k : { size_t{ 10 }, size_t{ 10'000'000 }, std::numeric_limits<size_t>::max() }) {
+            const std::vector<Document> documents = search_server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, top_k);
+            assert((GetIds(documents) == std::vector<int>{ 3, 2, 1 }));
+            assert(IsSameRelevance(documents[0].relevance, inverse_document_freq));
+            assert(IsSameRelevance(documents[1].relevance, inverse_document_freq * 2 / 3));
+            assert(IsSameRelevance(documents[2].relevance, inverse_document_freq / 2));
+            AssertSameResult(documents, search_server.FindTopDocuments(std::execution::par, "cat"s, DocumentStatus::ACTUAL, top_k));
+        }
+    }
+}
+
+void TestLogRecovery() {
+    const std::filesystem::path directory = std::filesystem::temp_directory_path() / "search_server_log_test";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directory(directory);
+    const std::string log_path = (directory / "log").string();
+    const std::string snapshot_path = (directory / "snapshot").string();
+
+    // A crash is a server that is dropped without a checkpoint
+    {
+        SearchServer search_server("and"s);
+        search_server.OpenLog(log_path);
+        search_server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, { 1 });
+        search_server.AddDocuments({ { 2, "black dog"s, DocumentStatus::ACTUAL, { 2 } }, { 3, "white dog"s, DocumentStatus::ACTUAL, { 3 } },
+            { 4, "black cat and"s, DocumentStatus::BANNED, { 4 } } });
+        search_server.RemoveDocument(1);
+        search_server.RemoveDocuments({ 3, 7 });
+    }
+    // The record being written at the crash is torn, recovery cuts it off
+    {
+        std::ofstream log(log_path, std::ios::binary | std::ios::app);
+        log << "\x20\x00\x00"s;
+    }
+    {
+        SearchServer search_server("and"s);
+        search_server.OpenLog(log_path);
+        assert((GetIds(search_server) == std::vector<int>{ 2, 4 }));
+        const std::vector<Document> documents = search_server.FindTopDocuments("dog"s);
+        assert((GetIds(documents) == std::vector<int>{ 2 }));
+        assert(IsSameRelevance(documents[0].relevance, std::log(2.0) / 2) && documents[0].rating == 2);
+        assert((GetIds(search_server.FindTopDocuments("cat"s, DocumentStatus::BANNED)) == std::vector<int>{ 4 }));
+        // The recovered log takes new changes
+        search_server.AddDocument(5, "grey cat"s, DocumentStatus::ACTUAL, { 5 });
+    }
+    {
+        SearchServer search_server("and"s);
+        search_server.OpenLog(log_path);
+        assert((GetIds(search_server) == std::vector<int>{ 2, 4, 5 }));
+
+        // After a checkpoint the log holds only later changes
+        search_server.Checkpoint(snapshot_path);
+        search_server.AddDocument(6, "grey dog"s, DocumentStatus::ACTUAL, { 6 });
+        search_server.RemoveDocument(2);
+    }
+    {
+        SearchServer search_server("and"s);
+        bool is_rejected = false;
+        try {
+            search_server.OpenLog(log_path);
+        }
+        catch (const std::invalid_argument&) {
+            is_rejected = true;
+        }
+        assert(is_rejected);
+    }
+    {
+        const std::unique_ptr<SearchServer> search_server = SearchServer::LoadSnapshot(snapshot_path);
+        search_server->OpenLog(log_path);
+        assert((GetIds(*search_server) == std::vector<int>{ 4, 5, 6 }));
+        const std::vector<Document> documents = search_server->FindTopDocuments("grey dog"s);
+        assert((GetIds(documents) == std::vector<int>{ 6, 5 }));
+        assert(IsSameRelevance(documents[0].relevance, std::log(3.0) / 2 + std::log(3.0 / 2.0) / 2));
+    }
+
+    // Writers that share syncs publish their changes in log order, replay gives the same index
+    std::filesystem::remove(log_path);
+    std::vector<std::vector<Document>> expected;
+    const std::vector<std::string> queries = { "cat"s, "dog -grey"s, "white bird"s };
+    {
+        static constexpr int THREAD_COUNT = 4;
+        static constexpr int DOCUMENT_COUNT = 100;
+
+        SearchServer search_server("and"s);
+        search_server.OpenLog(log_path);
+        std::vector<std::thread> threads;
+        for (int thread_index = 0; thread_index < THREAD_COUNT; ++thread_index) {
+            threads.emplace_back([&search_server, thread_index] {
+                static const std::vector<std::string> texts = { "white cat"s, "grey dog"s, "black bird"s, "white dog and cat"s };
+                for (int id = thread_index; id < DOCUMENT_COUNT; id += THREAD_COUNT) {
+                    search_server.AddDocument(id, texts[id % texts.size()], DocumentStatus::ACTUAL, { id });
+                    if (id % 3 == 0) {
+                        search_server.RemoveDocument(id);
+                    }
+                }
+                });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        assert(search_server.GetDocumentCount() == DOCUMENT_COUNT - (DOCUMENT_COUNT + 2) / 3);
+        expected = RunQueries(search_server, queries);
+    }
+    {
+        SearchServer search_server("and"s);
+        search_server.OpenLog(log_path);
+        AssertSameResults(expected, RunQueries(search_server, queries));
+    }
+    std::filesystem::remove_all(directory);
+}
+
+void TestBatchAddition() {
+    // DocumentToAdd refers to its text, so the texts are literals
+    const std::vector<DocumentToAdd> batch = {
+        { 5, "white cat and fluffy tail", DocumentStatus::ACTUAL, { 5, 1 } },
+        { 2, "black dog", DocumentStatus::IRRELEVANT, { 2 } },
+        { 9, "white dog dog", DocumentStatus::ACTUAL, { -3 } },
+        { 4, "grey cat", DocumentStatus::BANNED, { 0 } },
+        { 7, "fluffy white bird", DocumentStatus::ACTUAL, { 7, 8, 9 } },
+        { 3, "cat and dog", DocumentStatus::ACTUAL, { 3 } },
+    };
+    const std::vector<std::string> queries = { "cat"s, "white dog -bird"s, "fluffy tail cat"s, "grey"s };
+
+    SearchServer one_by_one("and"s);
+    for (const DocumentToAdd& document : batch) {
+        one_by_one.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    const auto assert_same_index = [&queries](const SearchServer& lhs, const SearchServer& rhs) {
+        assert(GetIds(lhs) == GetIds(rhs));
+        AssertSameResults(RunQueries(lhs, queries), RunQueries(rhs, queries));
+        for (const DocumentStatus status : { DocumentStatus::IRRELEVANT, DocumentStatus::BANNED }) {
+            AssertSameResult(lhs.FindTopDocuments("cat dog"s, status), rhs.FindTopDocuments("cat dog"s, status));
+        }
+        for (const int document_id : lhs) {
+            assert(*lhs.GetWordFrequencies(document_id) == *rhs.GetWordFrequencies(document_id));
+        }
+    };
+
+    // Every way to add a batch gives the same index as adding its documents one by one
+    const std::vector<std::function<void(SearchServer&, const std::vector<DocumentToAdd>&)>> add_batch = {
+        [](SearchServer& search_server, const std::vector<DocumentToAdd>& documents) {
+            search_server.AddDocuments(documents);
+        },
+        [](SearchServer& search_server, const std::vector<DocumentToAdd>& documents) {
+            search_server.AddDocuments(std::execution::par, documents);
+        },
+        [](SearchServer& search_server, const std::vector<DocumentToAdd>& documents) {
+            search_server.AddDocuments(search_server.PrepareDocuments(std::execution::par, documents));
+        },
+    };
+    for (const auto& add : add_batch) {
+        SearchServer search_server("and"s);
+        search_server.SetWorkerCount(2);
+        add(search_server, batch);
+        assert_same_index(search_server, one_by_one);
+    }
+    {
+        SearchServer search_server("and"s);
+        search_server.AddDocument(1, "cat"s, DocumentStatus::ACTUAL, { 1 });
+        search_server.AddDocuments({ batch.begin(), batch.begin() + 3 });
+        search_server.AddDocuments(std::execution::par, { batch.begin() + 3, batch.end() });
+        search_server.RemoveDocument(1);
+        assert_same_index(search_server, one_by_one);
+    }
+
+    // A rejected batch changes neither the index nor the log
+    const std::filesystem::path directory = std::filesystem::temp_directory_path() / "search_server_batch_test";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directory(directory);
+    const std::string log_path = (directory / "log").string();
+    const std::vector<std::vector<DocumentToAdd>> invalid_batches = {
+        { { 10, "red cat", DocumentStatus::ACTUAL, { 1 } }, { 3, "red dog", DocumentStatus::ACTUAL, { 1 } } },
+        { { 10, "red cat", DocumentStatus::ACTUAL, { 1 } }, { 10, "red dog", DocumentStatus::ACTUAL, { 1 } } },
+        { { 10, "red cat", DocumentStatus::ACTUAL, { 1 } }, { -1, "red dog", DocumentStatus::ACTUAL, { 1 } } },
+        { { 10, "red cat", DocumentStatus::ACTUAL, { 1 } }, { 11, "red d\x01g", DocumentStatus::ACTUAL, { 1 } } },
+    };
+    {
+        SearchServer search_server("and"s);
+        search_server.OpenLog(log_path);
+        search_server.AddDocuments(batch);
+        const auto log_size = std::filesystem::file_size(log_path);
+        for (const std::vector<DocumentToAdd>& invalid_batch : invalid_batches) {
+            for (const auto& add : add_batch) {
+                bool is_rejected = false;
+                try {
+                    add(search_server, invalid_batch);
+                }
+                catch (const std::invalid_argument&) {
+                    is_rejected = true;
+                }
+                assert(is_rejected);
+                assert(std::filesystem::file_size(log_path) == log_size);
+                assert_same_index(search_server, one_by_one);
+            }
+        }
+        // A prepared batch is rejected if one of its ids was added after it was prepared
+        const std::vector<DocumentToAdd> late_batch = { { 10, "red cat", DocumentStatus::ACTUAL, { 1 } } };
+        SearchServer::PreparedDocuments prepared = search_server.PrepareDocuments(late_batch);
+        search_server.AddDocument(10, "red dog"s, DocumentStatus::ACTUAL, { 1 });
+        const auto log_size_with_late = std::filesystem::file_size(log_path);
+        bool is_rejected = false;
+        try {
+            search_server.AddDocuments(std::move(prepared));
+        }
+        catch (const std::invalid_argument&) {
+            is_rejected = true;
+        }
+        assert(is_rejected);
+        assert(std::filesystem::file_size(log_path) == log_size_with_late);
+        assert((GetIds(search_server.FindTopDocuments("red"s)) == std::vector<int>{ 10 }));
+        search_server.RemoveDocument(10);
+        assert_same_index(search_server, one_by_one);
+    }
+    {
+        SearchServer search_server("and"s);
+        search_server.OpenLog(log_path);
+        assert_same_index(search_server, one_by_one);
+    }
+    std::filesystem::remove_all(directory);
+}
+
+void TestPagination() {
+    // Many documents tie on relevance, and on rating too, so pages are cut inside the ties.
+    // Half of the documents have "cat", so its idf is log(2)
+    SearchServer search_server(""s);
+    const std::vector<std::string> texts = { "cat dog"s, "cat cat dog"s, "bird dog fish"s, "dog"s };
+    for (int id = 0; id < 32; ++id) {
+        search_server.AddDocument(id, texts[id % texts.size()], DocumentStatus::ACTUAL, { id % 3 });
+    }
+    search_server.AddDocument(32, "cat"s, DocumentStatus::BANNED, { 1 });
+    search_server.AddDocument(33, "dog"s, DocumentStatus::BANNED, { 1 });
+    const auto is_even = [](int document_id, DocumentStatus, int) {
+        return document_id % 2 == 0;
+    };
+    const auto read_pages = [&search_server](std::string_view query, auto filter, size_t page_size) {
+        std::vector<Document> documents;
+        std::optional<SearchCursor> after;
+        do {
+            const DocumentPage page = search_server.FindTopDocumentsPage(query, filter, page_size, after);
+            assert(page.documents.size() <= page_size);
+            assert(page.next.has_value() == (page.documents.size() == page_size));
+            documents.insert(documents.end(), page.documents.begin(), page.documents.end());
+            after = page.next;
+        } while (after);
+        return documents;
+    };
+
+    for (const QueryStrategy strategy : { QueryStrategy::EXHAUSTIVE, QueryStrategy::MAX_SCORE }) {
+        search_server.SetQueryStrategy(strategy);
+        for (const std::string& query : { "cat"s, "cat fish"s, "dog -bird"s }) {
+            const std::vector<Document> all = search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, std::numeric_limits<size_t>::max());
+            assert(std::is_sorted(all.begin(), all.end(), IsMoreRelevant));
+            const std::vector<Document> all_even = search_server.FindTopDocuments(query, is_even, std::numeric_limits<size_t>::max());
+            // Page sizes that divide the result end with an empty page
+            for (const size_t page_size : { 1, 2, 3, 8, 100 }) {
+                AssertSameResult(read_pages(query, DocumentStatus::ACTUAL, page_size), all);
+                AssertSameResult(read_pages(query, is_even, page_size), all_even);
+            }
+        }
+    }
+
+    // The removed document of a cursor still marks the position. Without "cat" in one more
+    // document the idf stays log(2), so the next page follows the first one exactly
+    std::vector<Document> all = search_server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, std::numeric_limits<size_t>::max());
+    DocumentPage first_page = search_server.FindTopDocumentsPage("cat"s, 5);
+    AssertSameResult(first_page.documents, { all.begin(), all.begin() + 5 });
+    search_server.RemoveDocument(first_page.documents.back().id);
+    search_server.RemoveDocument(3);
+    DocumentPage second_page = search_server.FindTopDocumentsPage("cat"s, 5, first_page.next);
+    AssertSameResult(second_page.documents, { all.begin() + 5, all.begin() + 10 });
+
+    // Otherwise relevance moves with the idf and the cursor keeps the old one, so the next
+    // page holds what follows the old relevance and may skip or repeat documents
+    first_page = search_server.FindTopDocumentsPage("cat"s, 5);
+    search_server.RemoveDocument(first_page.documents.back().id);
+    all = search_server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, std::numeric_limits<size_t>::max());
+    all.erase(std::remove_if(all.begin(), all.end(), [&first_page](const Document& document) {
+        return !first_page.next->IsBefore(document);
+        }), all.end());
+    second_page = search_server.FindTopDocumentsPage("cat"s, 5, first_page.next);
+    AssertSameResult(second_page.documents, { all.begin(), all.begin() + 5 });
+}
+
+void TestDuplicateDetection() {
+    ThreadPool thread_pool(2);
+    const auto make_documents = [](const std::vector<std::vector<TermId>>& term_sets) {
+        std::vector<DocumentTerms> documents;
+        for (size_t i = 0; i < term_sets.size(); ++i) {
+            documents.push_back({ static_cast<int>(i) + 1, term_sets[i] });
+        }
+        return documents;
+    };
+
+    // The set size is hashed first, so only sets of equal size can collide. These two were
+    // found by a birthday search on the high half of the hash after two terms
+    const std::vector<TermId> colliding_terms = { 10, 2'033, 1'048'576 };
+    const std::vector<TermId> other_terms = { 9, 4'091, 2'535'340'232 };
+    const std::vector<TermId> short_terms = { 10, 2'033 };
+    assert(ComputeTermSetFingerprint(colliding_terms) == ComputeTermSetFingerprint(other_terms));
+    const std::vector<std::vector<TermId>> term_sets = { colliding_terms, other_terms, colliding_terms, short_terms, other_terms, short_terms, {}, {} };
+    assert((FindDuplicateDocuments(thread_pool, make_documents(term_sets)) == std::vector<int>{ 3, 5, 6, 8 }));
+    // Equal sets have equal signatures, so similarity 1 finds exactly the duplicates
+    assert((FindNearDuplicateDocuments(thread_pool, make_documents(term_sets), 1.0) == std::vector<int>{ 3, 5, 6, 8 }));
+
+    // A ~ B ~ C, but A and C are not similar: B is a duplicate of A and C is kept,
+    // since it is compared with the kept A and not with the removed B
+    std::vector<std::vector<TermId>> chain(3);
+    for (TermId term = 0; term < 10; ++term) {
+        chain[0].push_back(term);
+        chain[1].push_back(term + 1);
+        chain[2].push_back(term + 2);
+    }
+    for (const uint64_t seed : { 0, 1, 2 }) {
+        const MinHashOptions options{ 32, 4, seed };
+        assert((FindNearDuplicateDocuments(thread_pool, make_documents(chain), 0.75, options) == std::vector<int>{ 2 }));
+        assert((FindNearDuplicateDocuments(thread_pool, make_documents(chain), 0.6, options) == std::vector<int>{ 2, 3 }));
+    }
+
+    // The index compares sets of words, so word order, frequency and stop words do not matter
+    SearchServer search_server("and"s);
+    search_server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "black dog"s, DocumentStatus::ACTUAL, { 2 });
+    search_server.AddDocument(3, "cat white cat and"s, DocumentStatus::BANNED, { 3 });
+    search_server.AddDocument(4, "white cat dog"s, DocumentStatus::ACTUAL, { 4 });
+    search_server.AddDocument(5, "dog black"s, DocumentStatus::ACTUAL, { 5 });
+    assert((search_server.FindDuplicates() == std::vector<int>{ 3, 5 }));
+    assert((search_server.FindDuplicates(std::execution::par) == std::vector<int>{ 3, 5 }));
+    assert((search_server.FindNearDuplicates(std::execution::par, 0.6) == std::vector<int>{ 3, 4, 5 }));
+
+    const std::vector<std::pair<double, MinHashOptions>> invalid_arguments = {
+        { 0.5, MinHashOptions{ 0, 4, 0 } },
+        { 0.5, MinHashOptions{ 32, 0, 0 } },
+        { 0.0, MinHashOptions{} },
+        { -0.5, MinHashOptions{} },
+        { 1.5, MinHashOptions{} },
+        { std::nan(""), MinHashOptions{} },
+    };
+    for (const auto& [min_similarity, options] : invalid_arguments) {
+        bool is_rejected = false;
+        try {
+            search_server.FindNearDuplicates(min_similarity, options);
+        }
+        catch (const std::invalid_argument&) {
+            is_rejected = true;
+        }
+        assert(is_rejected);
+    }
+}
+
+void TestRequestStats() {
+    // Quantiles are bucket bounds: exact below 64 ns, at most 1/32 above the value otherwise
+    for (const uint64_t value : { uint64_t{ 0 }, uint64_t{ 63 }, uint64_t{ 64 }, uint64_t{ 1'000 }, uint64_t{ 1 } << 40,
+        std::numeric_limits<uint64_t>::max() }) {
+        const size_t bucket = LatencyHistogram::GetBucket(value);
+        assert(bucket < LatencyHistogram::BUCKET_COUNT);
+        const uint64_t bound = LatencyHistogram::GetBucketUpperBound(bucket);
+        assert(bound >= value && bound - value <= value / 32);
+    }
+    std::vector<uint64_t> counts(LatencyHistogram::BUCKET_COUNT, 0);
+    LatencyQuantiles quantiles = LatencyHistogram::ComputeQuantiles(counts);
+    assert(quantiles.p50 == 0 && quantiles.p99 == 0 && quantiles.p999 == 0 && quantiles.max == 0);
+    for (uint64_t value = 1; value <= 1'000; ++value) {
+        ++counts[LatencyHistogram::GetBucket(value)];
+    }
+    // The 500th, 990th and 999th values in buckets of 8 and 16 ns
+    quantiles = LatencyHistogram::ComputeQuantiles(counts);
+    assert(quantiles.p50 == 503 && quantiles.p99 == 991 && quantiles.p999 == 1'007 && quantiles.max == 1'007);
+    ++counts[LatencyHistogram::GetBucket(std::numeric_limits<uint64_t>::max())];
+    quantiles = LatencyHistogram::ComputeQuantiles(counts);
+    assert(quantiles.p999 == 1'007 && quantiles.max == std::numeric_limits<uint64_t>::max());
+
+    // A window of a minute moves in steps of a second
+    SearchServer search_server(""s);
+    search_server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, "black cat"s, DocumentStatus::ACTUAL, { 2 });
+    fake_time = {};
+    RequestQueue request_queue(search_server, std::chrono::minutes(1), TickFakeClock);
+    const auto assert_stats = [&request_queue](uint64_t request_count, uint64_t no_result_count, uint64_t document_count) {
+        const RequestStats stats = request_queue.GetStats();
+        assert(stats.request_count == request_count && stats.no_result_count == no_result_count && stats.document_count == document_count);
+    };
+    request_queue.AddFindRequest("cat"s);
+    request_queue.AddFindRequest("dog"s);
+    request_queue.AddFindRequest("dog"s, DocumentStatus::ACTUAL);
+    assert_stats(3, 2, 2);
+    assert(request_queue.GetNoResultRequests() == 2);
+    fake_time += std::chrono::seconds(30);
+    request_queue.AddFindRequest("white"s);
+    assert_stats(4, 2, 3);
+    // The first step is in the window for 60 s
+    fake_time += std::chrono::seconds(29);
+    assert_stats(4, 2, 3);
+    fake_time += std::chrono::seconds(1);
+    assert_stats(1, 0, 1);
+    // The first step is reused for the current one
+    request_queue.AddFindRequest("dog"s);
+    assert_stats(2, 1, 1);
+    fake_time += std::chrono::seconds(30);
+    assert_stats(1, 1, 0);
+    fake_time += std::chrono::hours(1);
+    assert_stats(0, 0, 0);
+
+    // Latencies are kept since the queue was created
+    quantiles = request_queue.GetStats().latency;
+    assert(quantiles.p50 == 1'007 && quantiles.max == 1'007);
+}
+
+void TestCorpusLoader() {
+    const std::filesystem::path directory = std::filesystem::temp_directory_path() / "search_server_corpus_test";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directory(directory);
+    const std::string path = (directory / "corpus").string();
+    const auto write_corpus = [&path](const std::string& text) {
+        std::ofstream out(path, std::ios::binary);
+        out << text;
+    };
+
+    // A line much longer than the first window, an empty line, a CRLF line and no newline at the end
+    std::string long_text;
+    for (int i = 0; i < 50; ++i) {
+        long_text += "word"s + std::to_string(i) + " "s;
+    }
+    long_text += "cat"s;
+    const std::vector<DocumentToAdd> expected = {
+        { 1, "white cat", DocumentStatus::ACTUAL, { 1, 2 } },
+        { 2, long_text, DocumentStatus::BANNED, { -3 } },
+        { 4, "black dog", DocumentStatus::ACTUAL, { 4 } },
+        { 3, "fluffy cat dog", DocumentStatus::IRRELEVANT, { 0, 7 } },
+        { 5, "grey cat", DocumentStatus::ACTUAL, { 5 } },
+    };
+    write_corpus("1\tACTUAL\t1 2\twhite cat\n2\tBANNED\t-3\t"s + long_text + "\n\n4\tACTUAL\t4\tblack dog\r\n3\tIRRELEVANT\t0 7\tfluffy cat dog\n5\tACTUAL\t5\tgrey cat"s);
+    SearchServer one_by_one(""s);
+    for (const DocumentToAdd& document : expected) {
+        one_by_one.AddDocument(document.id, document.text, document.status, document.ratings);
+    }
+    const std::vector<std::string> queries = { "cat"s, "dog"s, "word7 grey"s };
+    for (const size_t window_size : { size_t{ 16 }, size_t{ 64 << 20 } }) {
+        for (const size_t batch_size : { size_t{ 1 }, size_t{ 2 }, size_t{ 4096 } }) {
+            SearchServer search_server(""s);
+            const CorpusLoadStats stats = LoadCorpus(search_server, path, { batch_size, 1, window_size });
+            assert(stats.document_count == expected.size() && stats.byte_count == std::filesystem::file_size(path));
+            assert(GetIds(search_server) == GetIds(one_by_one));
+            AssertSameResults(RunQueries(search_server, queries), RunQueries(one_by_one, queries));
+            for (const DocumentStatus status : { DocumentStatus::BANNED, DocumentStatus::IRRELEVANT }) {
+                AssertSameResult(search_server.FindTopDocuments("cat"s, status), one_by_one.FindTopDocuments("cat"s, status));
+            }
+        }
+    }
+
+    // A malformed line fails with its number after the documents before it are added
+    const std::string head = "1\tACTUAL\t1\twhite cat\n2\tACTUAL\t2\tblack cat\n\n4\tACTUAL\t4\tgrey dog\n"s;
+    for (const std::string& malformed_line : { "x\tACTUAL\t5\tcat"s, "5\tLOST\t5\tcat"s, "5\tACTUAL\t\tcat"s, "5\tACTUAL\t1 x\tcat"s, "5"s }) {
+        write_corpus(head + malformed_line + "\n6\tACTUAL\t6\tcat\n"s);
+        for (const size_t window_size : { size_t{ 16 }, size_t{ 64 << 20 } }) {
+            for (const size_t batch_size : { size_t{ 1 }, size_t{ 2 }, size_t{ 4096 } }) {
+                SearchServer search_server(""s);
+                std::string error;
+                try {
+                    LoadCorpus(search_server, path, { batch_size, 1, window_size });
+                }
+                catch (const std::invalid_argument& e) {
+                    error = e.what();
+                }
+                assert(error == "corpus line 5 is malformed"s);
+                assert((GetIds(search_server) == std::vector<int>{ 1, 2, 4 }));
+            }
+        }
+    }
+    std::filesystem::remove_all(directory);
+}
+
+void TestSearchServer() {
+    TestEmptyWordsInDocument();
+    TestTopKLimits();
+    TestLogRecovery();
+    TestTokenizerKernels();
+    TestMaxScoreStrategy();
+    TestQueryCache();
+    TestSnapshotRoundTrip();
+    TestDocumentRemoval();
+    TestLeftRightUpdates();
+    TestBatchAddition();
+    TestPagination();
+    TestDuplicateDetection();
+    TestRequestStats();
+    TestCorpusLoader();
+}
@@ -9,3 +9,35 @@ void AddDocument(SearchServer& search_server, int document_id, std::string_view
 void FindTopDocuments(const SearchServer& search_server, std::string_view raw_query);
 
 void MatchDocuments(const SearchServer& search_server, std::string_view query);
+
+// Each test checks one feature on a small corpus with known results or against a reference
+// implementation, a mismatch fails an assert. TestSearchServer runs all of them, see --test
+void TestEmptyWordsInDocument();
+
+void TestTopKLimits();
+
+void TestLogRecovery();
+
+void TestTokenizerKernels();
+
+void TestMaxScoreStrategy();
+
+void TestQueryCache();
+
+void TestSnapshotRoundTrip();
+
+void TestDocumentRemoval();
+
+void TestLeftRightUpdates();
+
+void TestBatchAddition();
+
+void TestPagination();
+
+void TestDuplicateDetection();
+
+void TestRequestStats();
+
+void TestCorpusLoader();
+
+void TestSearchServer();
@@ -0,0 +1,92 @@
+#include "thread_pool.h"
+
+#include <utility>
+
+namespace {
+
+// Lets Submit put tasks of a worker into its own queue
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_worker_index = 0;
+
+} // namespace
+
+ThreadPool::ThreadPool(size_t worker_count) {
+    queues_.reserve(worker_count);
+    for (size_t i = 0; i < worker_count; ++i) {
+        queues_.push_back(std::make_unique<WorkerQueue>());
+    }
+    workers_.reserve(worker_count);
+    for (size_t i = 0; i < worker_count; ++i) {
+        workers_.emplace_back([this, i] { RunWorker(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard guard(sleep_mutex_);
+        is_stopping_ = true;
+    }
+    wake_condition_.notify_all();
+    for (std::thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::GetWorkerCount() const {
+    return workers_.size();
+}
+
+void ThreadPool::Submit(Task task) {
+    const size_t queue_index = current_pool == this ? current_worker_index : next_queue_++ % queues_.size();
+    {
+        std::lock_guard guard(queues_[queue_index]->mutex);
+        queues_[queue_index]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard guard(sleep_mutex_);
+        ++pending_task_count_;
+    }
+    wake_condition_.notify_one();
+}
+
+bool ThreadPool::TryPopTask(size_t worker_index, Task& task) {
+    // The newest own task first, its data is likely still in the cache
+    for (size_t i = 0; i < queues_.size(); ++i) {
+        WorkerQueue& queue = *queues_[(worker_index + i) % queues_.size()];
+        std::lock_guard guard(queue.mutex);
+        if (queue.tasks.empty()) {
+            continue;
+        }
+        if (i == 0) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::RunWorker(size_t worker_index) {
+    current_pool = this;
+    current_worker_index = worker_index;
+    while (true) {
+        Task task;
+        if (TryPopTask(worker_index, task)) {
+            {
+                std::lock_guard guard(sleep_mutex_);
+                --pending_task_count_;
+            }
+            task();
+            continue;
+        }
+        std::unique_lock lock(sleep_mutex_);
+        wake_condition_.wait(lock, [this] { return is_stopping_ || pending_task_count_ > 0; });
+        if (is_stopping_ && pending_task_count_ == 0) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent work-stealing pool. Every worker owns a deque: tasks submitted by a worker
+// go to its own deque and are taken from the back, idle workers steal from the front
+// of the other deques. Calls to ParallelFor may be nested
+class ThreadPool {
+public:
+    // With no workers ParallelFor runs everything in the calling thread
+    explicit ThreadPool(size_t worker_count);
+
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t GetWorkerCount() const;
+
+    // Calls function(i) for every i in [0, count) on the workers and the calling thread,
+    // returns when all calls finish and rethrows the first exception
+    template <typename Function>
+    void ParallelFor(size_t count, Function function);
+
+private:
+    using Task = std::function<void()>;
+
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues_;
+    std::vector<std::thread> workers_;
+    std::atomic<size_t> next_queue_ = 0;
+    std::mutex sleep_mutex_;
+    std::condition_variable wake_condition_;
+    size_t pending_task_count_ = 0;
+    bool is_stopping_ = false;
+
+    void Submit(Task task);
+
+    bool TryPopTask(size_t worker_index, Task& task);
+
+    void RunWorker(size_t worker_index);
+};
+
+template <typename Function>
+void ThreadPool::ParallelFor(size_t count, Function function) {
+    if (count == 0) {
+        return;
+    }
+
+    // Indexes are claimed one by one, so busy workers leave the rest to idle ones.
+    // Helper tasks may start after ParallelFor returns and only touch the shared job then
+    struct Job {
+        std::atomic<size_t> next_index = 0;
+        std::atomic<size_t> finished_count = 0;
+        std::mutex mutex;
+        std::condition_variable finished;
+        std::exception_ptr error;
+    };
+    const auto job = std::make_shared<Job>();
+    const auto run = [job, &function, count] {
+        for (size_t i = job->next_index++; i < count; i = job->next_index++) {
+            try {
+                function(i);
+            }
+            catch (...) {
+                std::lock_guard guard(job->mutex);
+                if (!job->error) {
+                    job->error = std::current_exception();
+                }
+            }
+            if (++job->finished_count == count) {
+                std::lock_guard guard(job->mutex);
+                job->finished.notify_all();
+            }
+        }
+    };
+
+    const size_t helper_count = std::min(workers_.size(), count - 1);
+    for (size_t i = 0; i < helper_count; ++i) {
+        Submit(run);
+    }
+    run();
+
+    std::unique_lock lock(job->mutex);
+    job->finished.wait(lock, [&job, count] { return job->finished_count.load() == count; });
+    if (job->error) {
+        std::rethrow_exception(job->error);
+    }
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include "document.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <optional>
+#include <vector>
+
+constexpr double STANDARD = 1e-6;
+
+// Documents with relevance closer than STANDARD are ordered by rating,
+// the id makes the order of complete ties independent of the scoring strategy
+inline bool IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    if (std::abs(lhs.relevance - rhs.relevance) < STANDARD) {
+        if (lhs.rating != rhs.rating) {
+            return lhs.rating > rhs.rating;
+        }
+        return lhs.id < rhs.id;
+    }
+    return lhs.relevance > rhs.relevance;
+}
+
+// Opaque position in a result list: the last document of a page. The next page holds
+// the documents that follow it in the IsMoreRelevant order
+class SearchCursor {
+public:
+    explicit SearchCursor(const Document& last)
+        : last_(last) {
+    }
+
+    // The document is on a later page than the cursor
+    bool IsBefore(const Document& document) const {
+        return IsMoreRelevant(last_, document);
+    }
+
+private:
+    Document last_;
+};
+
+// Keeps the top_k most relevant of the pushed documents in a binary heap
+// whose front is the least relevant of them. With a cursor only the documents
+// after it are kept, so a deep page costs as much as the first one.
+// The heap grows with the pushed documents, so a huge top_k costs nothing up front
+class TopDocuments {
+public:
+    explicit TopDocuments(size_t top_k, std::optional<SearchCursor> after = std::nullopt)
+        : top_k_(top_k)
+        , after_(after) {
+    }
+
+    void Push(const Document& document) {
+        if (after_ && !after_->IsBefore(document)) {
+            return;
+        }
+        if (heap_.size() < top_k_) {
+            heap_.push_back(document);
+            std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        }
+        else if (top_k_ > 0 && IsMoreRelevant(document, heap_.front())) {
+            std::pop_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+            heap_.back() = document;
+            std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        }
+    }
+
+    void Merge(const TopDocuments& other) {
+        for (const Document& document : other.heap_) {
+            Push(document);
+        }
+    }
+
+    bool IsFull() const {
+        return heap_.size() == top_k_;
+    }
+
+    // The least relevant of the kept documents, the heap must be non-empty
+    const Document& GetWorst() const {
+        return heap_.front();
+    }
+
+    // Returns the kept documents sorted from the most relevant
+    std::vector<Document> Extract() && {
+        std::sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        return std::move(heap_);
+    }
+
+private:
+    size_t top_k_;
+    std::optional<SearchCursor> after_;
+    std::vector<Document> heap_;
+};
+
+// Selects top_k most relevant documents after the cursor without sorting the whole range.
+// With a pool the top of every chunk is selected on it and the chunk heaps are merged
+inline std::vector<Document> SelectTopDocuments(const std::vector<Document>& documents, size_t top_k,
+    const std::optional<SearchCursor>& after = std::nullopt, ThreadPool* thread_pool = nullptr) {
+    static constexpr size_t MIN_CHUNK_SIZE = 4096;
+
+    size_t chunk_count = 1;
+    if (thread_pool != nullptr) {
+        chunk_count = std::clamp<size_t>(documents.size() / MIN_CHUNK_SIZE, 1, thread_pool->GetWorkerCount() + 1);
+    }
+    if (chunk_count == 1) {
+        TopDocuments top(top_k, after);
+        for (const Document& document : documents) {
+            top.Push(document);
+        }
+        return std::move(top).Extract();
+    }
+
+    std::vector<TopDocuments> chunk_tops(chunk_count, TopDocuments(top_k, after));
+    const size_t chunk_size = (documents.size() + chunk_count - 1) / chunk_count;
+    thread_pool->ParallelFor(chunk_count, [&documents, &chunk_tops, chunk_size](size_t chunk) {
+        const size_t begin = chunk * chunk_size;
+        const size_t end = std::min(documents.size(), begin + chunk_size);
+        for (size_t i = begin; i < end; ++i) {
+            chunk_tops[chunk].Push(documents[i]);
+        }
+        });
+
+    TopDocuments top(top_k);
+    for (const TopDocuments& chunk_top : chunk_tops) {
+        top.Merge(chunk_top);
+    }
+    return std::move(top).Extract();
+}
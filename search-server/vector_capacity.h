@@ -0,0 +1,14 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// Makes room for size elements, so that inserting up to size elements does not allocate.
+// The capacity at least doubles, reserving before every insertion stays amortized O(1)
+template <typename T>
+void GrowCapacity(std::vector<T>& values, size_t size) {
+    if (values.capacity() < size) {
+        values.reserve(std::max(size, values.capacity() * 2));
+    }
+}
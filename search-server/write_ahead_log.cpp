@@ -0,0 +1,234 @@
+#include "write_ahead_log.h"
+
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std::string_literals;
+
+namespace {
+
+std::array<uint32_t, 256> MakeCrc32Table() {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < table.size(); ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+
+void SyncFile(std::FILE* file) {
+#if defined(_WIN32)
+    const int result = _commit(_fileno(file));
+#else
+    const int result = fdatasync(fileno(file));
+#endif
+    if (result != 0) {
+        throw std::runtime_error("cannot sync the log"s);
+    }
+}
+
+// A rename is durable only once the directory that holds the file is synced
+void SyncDirectory(const std::string& file_path) {
+#if !defined(_WIN32)
+    std::string directory = std::filesystem::path(file_path).parent_path().string();
+    if (directory.empty()) {
+        directory = "."s;
+    }
+    const int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+    const bool is_synced = fd >= 0 && fsync(fd) == 0;
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (!is_synced) {
+        throw std::runtime_error("cannot sync directory "s + directory);
+    }
+#endif
+}
+
+} // namespace
+
+uint32_t ComputeCrc32(std::string_view data, uint32_t crc) {
+    static const std::array<uint32_t, 256> table = MakeCrc32Table();
+    crc = ~crc;
+    for (const char c : data) {
+        crc = table[(crc ^ static_cast<unsigned char>(c)) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+WriteAheadLog::WriteAheadLog(const std::string& path)
+    : path_(path) {
+    std::string data;
+    if (std::ifstream in(path, std::ios::binary); in) {
+        data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    if (!data.empty() && data.compare(0, sizeof(MAGIC), MAGIC, sizeof(MAGIC)) != 0) {
+        if (data.size() >= sizeof(MAGIC)) {
+            throw std::invalid_argument("file "s + path + " is not a log"s);
+        }
+        data.clear();
+    }
+
+    size_t valid_size = std::min(data.size(), sizeof(MAGIC));
+    while (valid_size + RECORD_HEADER_SIZE <= data.size()) {
+        uint32_t payload_size = 0;
+        uint32_t crc = 0;
+        uint64_t sequence = 0;
+        std::memcpy(&payload_size, data.data() + valid_size, sizeof(payload_size));
+        std::memcpy(&crc, data.data() + valid_size + 4, sizeof(crc));
+        std::memcpy(&sequence, data.data() + valid_size + 8, sizeof(sequence));
+        if (payload_size > data.size() - valid_size - RECORD_HEADER_SIZE || sequence <= appended_sequence_
+            || ComputeCrc32(std::string_view(data.data() + valid_size + 8, 8 + payload_size)) != crc) {
+            break;
+        }
+        appended_sequence_ = sequence;
+        valid_size += RECORD_HEADER_SIZE + payload_size;
+    }
+    synced_sequence_ = appended_sequence_;
+    if (valid_size < sizeof(MAGIC)) {
+        Reopen();
+        return;
+    }
+    records_ = data.substr(sizeof(MAGIC), valid_size - sizeof(MAGIC));
+    if (valid_size < data.size()) {
+        std::filesystem::resize_file(path, valid_size);
+    }
+    file_ = std::fopen(path.c_str(), "ab");
+    if (!file_) {
+        throw std::runtime_error("cannot open log "s + path);
+    }
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    if (file_) {
+        std::fclose(file_);
+    }
+}
+
+void WriteAheadLog::Append(uint64_t sequence, std::string_view payload) {
+    const auto payload_size = static_cast<uint32_t>(payload.size());
+    char header[RECORD_HEADER_SIZE];
+    std::memcpy(header, &payload_size, sizeof(payload_size));
+    std::memcpy(header + 8, &sequence, sizeof(sequence));
+    const uint32_t crc = ComputeCrc32(payload, ComputeCrc32(std::string_view(header + 8, 8)));
+    std::memcpy(header + 4, &crc, sizeof(crc));
+
+    std::lock_guard guard(mutex_);
+    buffer_.append(header, RECORD_HEADER_SIZE).append(payload);
+    appended_sequence_ = sequence;
+}
+
+void WriteAheadLog::Sync(uint64_t sequence) {
+    std::unique_lock lock(mutex_);
+    while (synced_sequence_ < sequence) {
+        if (!error_.empty()) {
+            throw std::runtime_error(error_);
+        }
+        if (is_syncing_) {
+            synced_.wait(lock);
+            continue;
+        }
+        // This thread writes the records of all waiting threads
+        is_syncing_ = true;
+        const std::string data = std::move(buffer_);
+        buffer_.clear();
+        const uint64_t target_sequence = appended_sequence_;
+        lock.unlock();
+        try {
+            Write(data);
+        }
+        catch (const std::exception& e) {
+            lock.lock();
+            error_ = e.what();
+            is_syncing_ = false;
+            synced_.notify_all();
+            throw;
+        }
+        lock.lock();
+        synced_sequence_ = std::max(synced_sequence_, target_sequence);
+        is_syncing_ = false;
+        synced_.notify_all();
+    }
+}
+
+void WriteAheadLog::Truncate() {
+    std::unique_lock lock(mutex_);
+    synced_.wait(lock, [this] { return !is_syncing_; });
+    buffer_.clear();
+    records_.clear();
+    synced_sequence_ = appended_sequence_;
+    Reopen();
+    synced_.notify_all();
+}
+
+void WriteAheadLog::Write(const std::string& data) {
+    if (std::fwrite(data.data(), 1, data.size(), file_) != data.size() || std::fflush(file_) != 0) {
+        throw std::runtime_error("cannot write log "s + path_);
+    }
+    SyncFile(file_);
+}
+
+void WriteAheadLog::Reopen() {
+    // The empty log is written aside and renamed over the old one, so a crash leaves
+    // either of them whole. The open file follows the rename and takes later appends
+    const std::string temporary_path = path_ + ".tmp"s;
+    std::FILE* old_file = file_;
+    file_ = std::fopen(temporary_path.c_str(), "wb");
+    if (!file_) {
+        file_ = old_file;
+        throw std::runtime_error("cannot open log "s + temporary_path);
+    }
+    try {
+        Write(std::string(MAGIC, sizeof(MAGIC)));
+        if (std::rename(temporary_path.c_str(), path_.c_str()) != 0) {
+            throw std::runtime_error("cannot replace log "s + path_);
+        }
+    }
+    catch (...) {
+        std::fclose(file_);
+        file_ = old_file;
+        throw;
+    }
+    if (old_file) {
+        std::fclose(old_file);
+    }
+    SyncDirectory(path_);
+}
+
+LogRecordReader::LogRecordReader(std::string_view data)
+    : data_(data) {
+}
+
+std::string_view LogRecordReader::GetString() {
+    return Take(Get<uint32_t>());
+}
+
+std::string_view LogRecordReader::Take(size_t size) {
+    if (size > data_.size()) {
+        throw std::invalid_argument("log record is too short"s);
+    }
+    const std::string_view result = data_.substr(0, size);
+    data_.remove_prefix(size);
+    return result;
+}
+
+void LogRecordWriter::PutString(std::string_view text) {
+    Put(static_cast<uint32_t>(text.size()));
+    data_.append(text);
+}
+
+const std::string& LogRecordWriter::GetData() const {
+    return data_;
+}
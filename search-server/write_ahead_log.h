@@ -0,0 +1,123 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Append-only log of records, each with a sequence number and a CRC-32 of its contents.
+// Append only buffers a record; Sync writes and flushes to disk everything appended so far.
+// A thread that calls Sync while another one is syncing waits for it and then syncs the
+// records appended meanwhile in one write, so concurrent writers share the cost of a sync
+class WriteAheadLog {
+public:
+    // Opens or creates the log. Records after a torn or corrupted one are cut off:
+    // they were never synced completely. Throws runtime_error on I/O errors
+    explicit WriteAheadLog(const std::string& path);
+
+    ~WriteAheadLog();
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    // Calls apply(sequence, payload) for every record of the log in order
+    template <typename Apply>
+    void Replay(Apply apply) const;
+
+    void Append(uint64_t sequence, std::string_view payload);
+
+    // Returns once the records up to sequence are on disk
+    void Sync(uint64_t sequence);
+
+    // Drops all records, e.g. after they are saved in a snapshot. After a crash the log
+    // holds either all of the records or none of them
+    void Truncate();
+
+private:
+    static constexpr char MAGIC[8] = { 'S', 'R', 'C', 'H', 'W', 'A', 'L', '1' };
+    // payload size, CRC-32 of the sequence and the payload, sequence
+    static constexpr size_t RECORD_HEADER_SIZE = 16;
+
+    std::string path_;
+    std::FILE* file_ = nullptr;
+    // Records of the log read at opening, kept for Replay
+    std::string records_;
+
+    std::mutex mutex_;
+    std::condition_variable synced_;
+    std::string buffer_;
+    uint64_t appended_sequence_ = 0;
+    uint64_t synced_sequence_ = 0;
+    bool is_syncing_ = false;
+    std::string error_;
+
+    void Write(const std::string& data);
+
+    // Replaces the file with an empty log
+    void Reopen();
+};
+
+// Serializes numbers and strings into a log record payload
+class LogRecordWriter {
+public:
+    template <typename T>
+    void Put(T value);
+
+    void PutString(std::string_view text);
+
+    const std::string& GetData() const;
+
+private:
+    std::string data_;
+};
+
+// Reads a payload written by LogRecordWriter. Throws invalid_argument if it ends too early.
+// Strings point into the payload
+class LogRecordReader {
+public:
+    explicit LogRecordReader(std::string_view data);
+
+    template <typename T>
+    T Get();
+
+    std::string_view GetString();
+
+private:
+    std::string_view data_;
+
+    std::string_view Take(size_t size);
+};
+
+uint32_t ComputeCrc32(std::string_view data, uint32_t crc = 0);
+
+template <typename Apply>
+void WriteAheadLog::Replay(Apply apply) const {
+    for (size_t pos = 0; pos < records_.size();) {
+        uint32_t payload_size = 0;
+        uint64_t sequence = 0;
+        std::memcpy(&payload_size, records_.data() + pos, sizeof(payload_size));
+        std::memcpy(&sequence, records_.data() + pos + 8, sizeof(sequence));
+        apply(sequence, std::string_view(records_.data() + pos + RECORD_HEADER_SIZE, payload_size));
+        pos += RECORD_HEADER_SIZE + payload_size;
+    }
+}
+
+template <typename T>
+void LogRecordWriter::Put(T value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    data_.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+T LogRecordReader::Get() {
+    static_assert(std::is_trivially_copyable_v<T>);
+    T value;
+    std::memcpy(&value, Take(sizeof(value)).data(), sizeof(value));
+    return value;
+}